@@ -32,7 +32,9 @@ f.len = ProtoField.uint32("canshark.len", "Message Length", base.DEC)
 f.data = ProtoField.bytes("canshark.datas", "Data")
 f.port = ProtoField.uint8("canshark.port", "Port", base.DEC, vs_port, 0x07)
 f.dir = ProtoField.uint8("canshark.dir", "Direction", base.DEC, vs_dir, 0x08)
-f.mbox = ProtoField.uint8("canshark.mbox", "Mailbox", base.DEC, nil, 0xF0)
+f.mbox = ProtoField.uint8("canshark.mbox", "Mailbox", base.DEC, nil, 0x30)
+f.passive = ProtoField.bool("canshark.passive", "Passive", 8, nil, 0x40)
+f.backlog = ProtoField.bool("canshark.backlog", "Backlog", 8, nil, 0x80)
 f.timestamp = ProtoField.uint16("canshark.timestamp", "Time", base.HEX)
 
 
@@ -75,6 +77,8 @@ function canshark_proto.dissector(buffer, pinfo, tree)
 	t:add(f.port, peripheral)
 	t:add(f.dir, peripheral)
 	t:add(f.mbox, peripheral)
+	t:add(f.passive, peripheral)
+	t:add(f.backlog, peripheral)
 	t:add_le(f.timestamp, timestamp)
 
 	if addr.err == 0 then
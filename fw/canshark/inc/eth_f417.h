@@ -5,9 +5,13 @@ struct ethf417_state {
 	uint8_t mac[6];
 };
 
+extern uint64_t ethf417_rx_time;	// us, last frame taken from the MAC
+
 void ethf417_gpio_init(void);
 int8_t ethf417_output(struct netif *nif, struct pbuf *p);
 void ethf417_poll(struct netif *nif);
+void ethf417_link_poll(struct netif *nif);
+bool ethf417_pending(void);
 int8_t ethf417_init(struct netif *nif);
 
 #endif // _ETH_F417_H__
@@ -0,0 +1,60 @@
+#ifndef MODBENCH_H_INCLUDED
+#define MODBENCH_H_INCLUDED
+
+/*
+ * Capture loss benchmark, the ports wired to each other, MODNET_TYPE_BENCH.
+ * The tx port generates sequence numbered frames of one id with the load
+ * rising step by step, the rx port captures them. After every step the
+ * generator stops until the capture drains, then MODNET_TYPE_BENCH_STEP tells
+ * where the frames of the step were lost, the last one with MODNET_FLAG_LAST.
+ * Frames the host does not get of the streamed ones are lost by the network.
+ */
+// 16
+struct modbench_config {
+	uint8_t tx;		// generating port
+	uint8_t rx;		// capturing port, acknowledges the frames
+	uint8_t dlc;		// 4..8, sequence number in the first 4 bytes
+	uint8_t status;		// MODCTL_STATUS_*, reply only
+	uint16_t first;		// load of the first step, permille, 0 stops the run
+	uint16_t last;		// load of the last step, permille
+	uint16_t increment;	// permille, 0 for the single step
+	uint16_t step;		// ms, duration of the step, 0 for default
+	uint16_t id;		// 11 bit identifier of the frames
+	uint16_t reserved;
+};
+
+#define MODBENCH_LATENCY_BUCKETS	16
+
+// 100
+struct modbench_report {
+	uint16_t load;		// target, permille
+	uint16_t achieved;	// permille, of the frames sent, stuff bits not counted
+	uint16_t max_ok;	// highest load without loss on the board so far, 0 none
+	uint16_t rate;		// frames/s sent
+	uint32_t sent;		// frames queued by the generator
+	uint32_t overrun;	// lost, hw FIFO full
+	uint32_t ring;		// lost, capture ring full
+	uint32_t seen;		// read from the ring
+	uint32_t pbuf;		// lost, datagram not allocated
+	uint32_t streamed;	// put into datagrams
+	uint32_t order;		// out of sequence when read from the ring
+	/*
+	 * rx isr delay after the fastest one of the run, log2 us buckets.
+	 * From the hw timestamp of the start of frame, stuff bits make the
+	 * lowest buckets jitter.
+	 */
+	uint32_t latency[MODBENCH_LATENCY_BUCKETS];
+};
+
+#define MODBENCH_STEP		1000	// ms
+#define MODBENCH_SETTLE		50	// ms, at least after the step
+#define MODBENCH_SETTLE_MAX	1000	// ms, capture not drained, rest counts as lost
+#define MODBENCH_CALIBRATE	64	// frames looking for the fastest isr first
+
+struct can_message;
+
+void modbench_request(const struct modbench_config *cfg);
+void modbench_frame(const struct can_message *msg, bool streamed);
+void modbench_step(void);
+
+#endif // MODBENCH_H_INCLUDED
@@ -4,21 +4,113 @@
 void modcan_init(void);
 void modcan_step(void);
 
-// 22
+/*
+ * time is the hw timestamp of the start of frame, bit times of the port.
+ * Its wraps are counted by the isr clock, time_mid and time_hi extend it to
+ * the 64 bit bit time, exact across any gap while the bitrate is kept.
+ */
+// 32
 struct can_message {
 	uint32_t mobid;		// 4
-	uint16_t time;
+	uint16_t time;		// bit time, bits 0..15
 	uint8_t source;
 	uint8_t zero;
 
 	uint8_t data[8];	// 8
 	uint8_t length;
 	bool isthere;
+	uint16_t time_hi;	// bit time, bits 48..63
 
-	uint64_t ticks;
+	uint32_t time_mid;	// bit time, bits 16..47
+	uint64_t ticks;		// us, isr
 };
 
-bool modcan_get(struct can_message *msg);
+#define MODCAN_BIT_TIME(msg)	((uint64_t)(msg)->time_hi << 48 | (uint64_t)(msg)->time_mid << 16 | (msg)->time)
+
+#define MODCAN_PORTS		2
+#define MODCAN_PORT(canport)	(((canport) == CAN1) ? 0 : 1)
+
+// 24
+struct modcan_stats {
+	uint32_t rx;		// frames received
+	uint32_t tx;		// frames transmitted
+	uint32_t lost;		// frames lost, capture ring full
+	uint32_t overrun[2];	// frames lost, hw FIFO0 (critical) and FIFO1 (bulk) full
+	uint32_t errors;	// bus errors, last error code changes
+};
+
+extern struct modcan_stats modcan_stats[MODCAN_PORTS];
+
+#define MODCAN_BITRATE_DEFAULT	500000
+#define MODCAN_SAMPLE_DEFAULT	750
+#define MODCAN_SILENT_DEFAULT	false	// true to never touch the bus until host says so
+
+enum {
+	MODCAN_AUTOBAUD_OFF,		// timing set by host or default
+	MODCAN_AUTOBAUD_RUNNING,	// silent, sweeping the candidates
+	MODCAN_AUTOBAUD_LOCKED,		// timing found by the sweep
+};
+
+// 8
+struct modcan_timing {
+	uint32_t bitrate;	// bit/s
+	uint16_t sample;	// sample point, permille
+	uint8_t autobaud;	// MODCAN_AUTOBAUD_*
+	uint8_t silent;		// listen only, never drives the bus
+};
+
+extern struct modcan_timing modcan_timing[MODCAN_PORTS];
+
+/* each autobaud candidate listens this long, must catch a frame at lowest rate */
+#define MODCAN_AUTOBAUD_DWELL	100	// ms
+
+/* capture rings, must be power of two */
+#define MODCAN_RING_SIZE	1024
+#define MODCAN_PRIO_SIZE	64
+
+/* bulk ring slots only critical frames may use */
+#define MODCAN_RING_RESERVE	64
+
+/* frames are classified into lanes by ID ranges */
+enum {
+	MODCAN_LANE_PRIO,	// sent immediately
+	MODCAN_LANE_BULK,	// batched
+	MODCAN_LANES
+};
+
+#define MODCAN_LANE_RANGES	4
+
+/* mobid without RTR and ERR bits */
+#define MODCAN_ID_MASK		0x9FFFFFFF
+
+struct modcan_range {
+	uint32_t first;		// mobid
+	uint32_t last;		// mobid, inclusive
+};
+
+/* critical IDs are received by FIFO0 with higher irq priority, rest by FIFO1 */
+#define MODCAN_FILTERS		4
+#define MODCAN_FILTER_BANKS	(MODCAN_FILTERS + 1)	// per port, last is catch-all
+
+struct modcan_filter {
+	uint32_t mobid;
+	uint32_t mask;		// mobid bits to match, 0 for unused entry
+};
+
+bool modcan_get(uint8_t lane, struct can_message *msg);
+uint16_t modcan_pending(uint8_t lane);
+uint64_t modcan_oldest(uint8_t lane);
+uint16_t modcan_ring_size(uint8_t lane);
+uint16_t modcan_ring_max(uint8_t lane);
+bool modcan_lane_set(uint8_t idx, uint32_t first, uint32_t last);
+bool modcan_lane_get(uint8_t idx, struct modcan_range *range);
+bool modcan_filter_set(uint8_t idx, uint32_t mobid, uint32_t mask);
+bool modcan_filter_get(uint8_t idx, struct modcan_filter *filter);
+bool modcan_timing_set(uint8_t port, uint32_t bitrate, uint16_t sample);
+bool modcan_silent_set(uint8_t port, bool silent);
+bool modcan_tx_enabled(uint8_t port);
+bool modcan_transmit(uint8_t port, uint32_t mobid, uint8_t *data, uint8_t len);
+void modcan_autobaud_start(uint8_t port);
 
 
 #endif // MODCAN_H_INCLUDED
@@ -0,0 +1,47 @@
+#ifndef MODCFG_H_INCLUDED
+#define MODCFG_H_INCLUDED
+
+/*
+ * Settings kept in flash, applied at power up over the defaults.
+ * Records are appended to the last sector, the newest valid one wins and
+ * the sector is erased only when full. Flash is not readable while written,
+ * the capture stalls for a while, for seconds when the sector is erased.
+ */
+#define MODCFG_MAGIC		0x43464731	// "CFG1"
+
+#define MODCFG_SECTOR		11		// last 128k, out of the firmware by ROM_LENGTH of the Makefile
+#define MODCFG_BASE		0x080E0000
+#define MODCFG_SIZE		0x20000
+
+// 8
+struct modcfg_port {
+	uint32_t bitrate;	// bit/s, found one when the autobaud locked
+	uint16_t sample;	// permille
+	uint8_t silent;
+	uint8_t nmt_filter;
+};
+
+// 104
+struct modcfg_record {
+	uint32_t magic;		// MODCFG_MAGIC
+	uint16_t size;		// of the record, other layouts are skipped
+	uint8_t defaults;	// settings dropped, nothing else is valid
+	uint8_t reserved;
+
+	struct modcfg_port port[MODCAN_PORTS];
+	struct modcan_filter filters[MODCAN_FILTERS];
+	struct modcan_range lanes[MODCAN_LANE_RANGES];
+
+	uint32_t batch_age;	// us
+	uint32_t dest_addr;	// a << 24 | b << 16 | c << 8 | d
+	uint16_t dest_port;
+	uint16_t telemetry;	// ms
+
+	uint32_t crc;		// crc-32 of the words above
+};
+
+void modcfg_load(void);
+bool modcfg_save(void);
+bool modcfg_defaults(void);
+
+#endif // MODCFG_H_INCLUDED
@@ -0,0 +1,57 @@
+#ifndef MODCTL_H_INCLUDED
+#define MODCTL_H_INCLUDED
+
+/*
+ * host request, MODNET_TYPE_CONTROL, answered by the same record with MODNET_FLAG_REPLY
+ * to the address it came from. Host retries with the same id, the board
+ * answers the repeated change again without applying it twice.
+ */
+// 16
+struct modctl_msg {
+	uint16_t id;		// request id, echoed in the reply
+	uint8_t cmd;		// MODCTL_CMD_*
+	uint8_t port;		// 0 CAN1, 1 CAN2, entry of the table commands
+	uint8_t status;		// MODCTL_STATUS_*, reply only
+	uint8_t reserved[3];
+	uint32_t arg[2];
+};
+
+enum {
+	MODCTL_CMD_TIMING_GET = 1,	// reply arg: bitrate, sample permille
+	MODCTL_CMD_TIMING_SET = 2,	// arg: bitrate, sample permille
+	MODCTL_CMD_AUTOBAUD = 3,	// replied PENDING, then again once locked
+	MODCTL_CMD_SILENT_SET = 4,	// arg: 1 listen only, 0 normal; reply arg: silent
+	MODCTL_CMD_NMT_FILTER = 5,	// arg: 1 heartbeats not captured, only NMT events; reply arg: filter
+	MODCTL_CMD_PARAM_GET = 6,	// arg: MODCTL_PARAM_*; reply arg: param, value
+	MODCTL_CMD_PARAM_SET = 7,	// arg: MODCTL_PARAM_*, value; reply arg: param, value applied
+	MODCTL_CMD_FILTER_GET = 8,	// port: entry; reply arg: mobid, mask
+	MODCTL_CMD_FILTER_SET = 9,	// port: entry; arg: mobid, mask, 0 unused; critical frames, FIFO0
+	MODCTL_CMD_LANE_GET = 10,	// port: entry; reply arg: first, last mobid
+	MODCTL_CMD_LANE_SET = 11,	// port: entry; arg: first, last mobid, first > last unused; priority lane
+	MODCTL_CMD_SAVE = 12,		// settings to flash, used from the next power up
+	MODCTL_CMD_DEFAULTS = 13,	// saved settings dropped, defaults from the next power up
+};
+
+/* board wide settings of MODCTL_CMD_PARAM_* */
+enum {
+	MODCTL_PARAM_BATCH_AGE = 1,	// us, bulk lane datagram is sent with the oldest frame this old
+	MODCTL_PARAM_TELEMETRY = 2,	// ms, telemetry record period, 0 off
+	MODCTL_PARAM_DEST_ADDR = 3,	// ipv4 of the stream, a << 24 | b << 16 | c << 8 | d
+	MODCTL_PARAM_DEST_PORT = 4,	// udp port of the stream
+};
+
+/* replies of the changes kept for the retries */
+#define MODCTL_HISTORY		8
+#define MODCTL_HISTORY_AGE	2000	// ms
+
+enum {
+	MODCTL_STATUS_OK = 0,
+	MODCTL_STATUS_PENDING = 1,	// final reply with the same id follows
+	MODCTL_STATUS_INVALID = 2,	// unknown command, port or argument
+	MODCTL_STATUS_FAILED = 3,
+};
+
+void modctl_request(const struct modctl_msg *req);
+void modctl_step(void);
+
+#endif // MODCTL_H_INCLUDED
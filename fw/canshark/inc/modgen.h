@@ -0,0 +1,49 @@
+#ifndef MODGEN_H_INCLUDED
+#define MODGEN_H_INCLUDED
+
+/*
+ * Traffic generator of the port, MODNET_TYPE_GEN.
+ * Host sends the config, the board answers the same record with the status.
+ * Frames carry the generator sequence number, little endian in the first
+ * min(dlc, 4) bytes, the rest is random. Same seed gives the same traffic.
+ */
+enum {
+	MODGEN_IDS_FIXED = 0,		// ids of the set one after another
+	MODGEN_IDS_RANDOM = 1,		// uniform from the set
+	MODGEN_IDS_SKEWED = 2,		// lower ids of the set, higher priority, more often
+};
+
+#define MODGEN_IDS_MODE		0x0F
+#define MODGEN_IDS_EXT		0x80	// extended ids
+
+// 24
+struct modgen_config {
+	uint8_t port;		// 0 CAN1, 1 CAN2
+	uint8_t ids;		// MODGEN_IDS_*
+	uint8_t dlc_min;
+	uint8_t dlc_max;
+	uint16_t load;		// target, permille of the bitrate, 0 stops
+	uint16_t burst;		// frames sent back to back, 0 or 1 evenly spaced
+	uint32_t id_first;	// 11 or 29 bit identifier
+	uint32_t id_count;	// size of the set
+	uint32_t seed;		// prng
+	uint8_t status;		// MODCTL_STATUS_*, reply only
+	uint8_t reserved[3];
+};
+
+// 12
+struct modgen_stats {
+	uint32_t sent;		// frames queued
+	uint32_t starved;	// frames waiting for the free mailbox
+	uint16_t load;		// achieved, permille, stuff bits not counted
+	uint16_t target;	// permille
+};
+
+extern struct modgen_stats modgen_stats[MODCAN_PORTS];
+
+uint8_t modgen_start(const struct modgen_config *cfg);
+void modgen_request(const struct modgen_config *cfg);
+void modgen_step(void);
+void modgen_measure(void);
+
+#endif // MODGEN_H_INCLUDED
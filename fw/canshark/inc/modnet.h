@@ -1,6 +1,90 @@
 #ifndef MODNET_H_INCLUDED
 #define MODNET_H_INCLUDED
 
+#define MODNET_PORT		6000
+#define MODNET_MAGIC		0xCA
+
+#define MODNET_PROTOCOL		1
+#define MODNET_FIRMWARE		((0 << 16) | (1 << 8) | 0)	// major, minor, patch
+
+struct netif;
+
+/* every datagram starts with this header, followed by count records */
+// 8
+struct modnet_header {
+	uint8_t magic;		// MODNET_MAGIC
+	uint8_t type;		// MODNET_TYPE_*
+	uint8_t flags;		// MODNET_FLAG_*
+	uint8_t count;		// number of records
+	uint32_t seq;		// datagram sequence number
+};
+
+enum {
+	MODNET_TYPE_FRAMES = 1,		// struct can_message[]
+	MODNET_TYPE_TELEMETRY = 2,	// struct modtelem_record
+	MODNET_TYPE_CONTROL = 3,	// struct modctl_msg, host to board and back
+	MODNET_TYPE_SYNC = 4,		// struct modsync_msg, clock sync with the host
+	MODNET_TYPE_SDO = 5,		// struct modsdo_job and entries, struct modsdo_result[] back
+	MODNET_TYPE_NMT = 6,		// struct modnmt_event[]
+	MODNET_TYPE_NODES = 7,		// struct modnmt_digest[], per port
+	MODNET_TYPE_GEN = 8,		// struct modgen_config, host to board and back
+	MODNET_TYPE_BENCH = 9,		// struct modbench_config, host to board and back
+	MODNET_TYPE_BENCH_STEP = 10,	// struct modbench_report
+	MODNET_TYPE_ANNOUNCE = 11,	// struct modnet_announce, host asks with no record
+};
+
+#define MODNET_FLAG_BACKLOG	0x01	// captured before receiver was available
+#define MODNET_FLAG_PRIORITY	0x02	// frames of the priority lane
+#define MODNET_FLAG_REPLY	0x04	// sent by the board, answer to the host request
+#define MODNET_FLAG_LAST	0x08	// last datagram of the reply
+#define MODNET_FLAG_SILENT(port) (0x10 << (port))	// port was listen only when sent
+
+/* what the board can do, announced */
+#define MODNET_CAP_SYNC		0x0001	// clock sync
+#define MODNET_CAP_SDO		0x0002	// object dictionary reads
+#define MODNET_CAP_NMT		0x0004	// node tracking, heartbeat filter
+#define MODNET_CAP_GEN		0x0008	// traffic generator
+#define MODNET_CAP_BENCH	0x0010	// capture loss benchmark
+#define MODNET_CAP_AUTOBAUD	0x0020
+#define MODNET_CAP_SILENT	0x0040	// listen only ports
+#define MODNET_CAP_CONFIG	0x0080	// settings kept in flash
+
+#define MODNET_ANNOUNCE_PORTS		2
+#define MODNET_ANNOUNCE_INTERVAL	2000	// ms, also right after the link comes up
+
+/* identity of the board, the mac is the stable serial */
+// 48
+struct modnet_announce {
+	uint8_t mac[6];
+	uint8_t ports;		// CAN ports, of the arrays below
+	uint8_t protocol;	// MODNET_PROTOCOL
+	uint32_t uid[3];	// mcu unique id, the mac is derived from it
+	uint32_t firmware;	// MODNET_FIRMWARE
+	uint32_t caps;		// MODNET_CAP_*
+	uint32_t uptime;	// s
+	uint32_t bitrate[MODNET_ANNOUNCE_PORTS];	// bit/s
+	uint16_t sample[MODNET_ANNOUNCE_PORTS];		// permille
+	uint8_t silent[MODNET_ANNOUNCE_PORTS];
+	uint8_t autobaud[MODNET_ANNOUNCE_PORTS];	// MODCAN_AUTOBAUD_*
+};
+
+/* max payload of the single udp datagram without fragmentation */
+#define MODNET_PAYLOAD		(1500 - 20 - 8 - sizeof(struct modnet_header))
+
+#define MODNET_LATENCY_BUCKETS	16
+
+extern uint32_t modnet_batch_age;
+extern uint32_t modnet_pbuf_failures;
+extern uint32_t modnet_latency[][MODNET_LATENCY_BUCKETS];
+
 void modnet_init(struct netif *netif);
+bool modnet_online(void);
+bool modnet_send(uint8_t type, uint8_t flags, const void *data, uint8_t count, uint16_t size);
+void modnet_announce(uint8_t flags);
+bool modnet_dest_set(uint32_t addr, uint16_t port);
+uint32_t modnet_dest_addr(void);
+uint16_t modnet_dest_udp(void);
+void modnet_stream(void);
+bool modnet_busy(void);
 
 #endif // MODNET_H_INCLUDED
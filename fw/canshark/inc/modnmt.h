@@ -0,0 +1,57 @@
+#ifndef MODNMT_H_INCLUDED
+#define MODNMT_H_INCLUDED
+
+/*
+ * NMT state and heartbeat period of every node, tracked from COB_GUARD frames.
+ * Host gets only the changes as MODNET_TYPE_NMT and the node table digest
+ * as MODNET_TYPE_NODES, the heartbeats may be kept out of the capture.
+ */
+enum {
+	MODNMT_EVENT_ALIVE = 1,		// first heartbeat, or first one after the timeout
+	MODNMT_EVENT_STATE = 2,		// state changed
+	MODNMT_EVENT_TIMEOUT = 3,	// heartbeat missed
+};
+
+#define MODNMT_STATE_UNKNOWN	0xFF	// prev of the node seen first time
+#define MODNMT_STATE_LOST	0x80	// digest, heartbeat missed, or-ed to the last state
+
+// 24
+struct modnmt_event {
+	uint8_t port;
+	uint8_t node;
+	uint8_t kind;		// MODNMT_EVENT_*
+	uint8_t state;		// CANOPEN_NMT_STATE_*
+	uint8_t prev;		// state reported before
+	uint8_t reserved[3];
+	uint64_t ticks;		// us, last heartbeat
+	uint32_t period;	// us, heartbeat period estimated, 0 unknown yet
+	uint32_t silence;	// us, since the last heartbeat
+};
+
+// 148
+struct modnmt_digest {
+	uint8_t port;
+	uint8_t alive;		// nodes sending heartbeat
+	uint8_t lost;		// nodes timed out
+	uint8_t reserved;
+	uint32_t seen[4];	// bit per node id
+	uint8_t state[128];	// by node id, MODNMT_STATE_LOST when timed out
+};
+
+#define MODNMT_NODES		127
+#define MODNMT_INTERVAL		1000	// ms, digest
+#define MODNMT_GAIN		8	// period filter
+
+/* heartbeat is missed when silent for 1.5 period plus slack */
+#define MODNMT_SLACK		5000	// us
+
+#define MODNMT_COB(mobid)	(((mobid) > COB_GUARD(0)) && ((mobid) <= COB_GUARD(MODNMT_NODES)))
+
+void modnmt_init(void);
+bool modnmt_rx(uint8_t port, uint32_t mobid, const uint8_t *data, uint8_t len);
+bool modnmt_filter_set(uint8_t port, bool filter);
+bool modnmt_filter_get(uint8_t port);
+void modnmt_step(void);
+void modnmt_digest(void);
+
+#endif // MODNMT_H_INCLUDED
@@ -0,0 +1,55 @@
+#ifndef MODSDO_H_INCLUDED
+#define MODSDO_H_INCLUDED
+
+/*
+ * SDO client reading object dictionaries at bus speed, MODNET_TYPE_SDO.
+ * Host sends the job followed by header count entries, the results come back
+ * packed in datagrams with MODNET_FLAG_REPLY, the last one with MODNET_FLAG_LAST
+ * ends with the node 0 record.
+ */
+// 8
+struct modsdo_job {
+	uint16_t id;		// echoed in the results
+	uint8_t port;		// 0 CAN1, 1 CAN2
+	uint8_t flags;		// MODSDO_FLAG_*
+	uint16_t timeout;	// ms, for every response, 0 for default
+	uint8_t sessions;	// nodes read at once, 0 for default
+	uint8_t retries;	// of the entry after timeout
+};
+
+#define MODSDO_FLAG_BLOCK	0x01	// try block upload, segmented when server refuses
+
+// 4
+struct modsdo_entry {
+	uint16_t index;
+	uint8_t subindex;
+	uint8_t node;		// 1..127
+};
+
+/* followed by length bytes of the value */
+// 16
+struct modsdo_result {
+	uint16_t id;		// job
+	uint16_t index;
+	uint8_t subindex;
+	uint8_t node;		// 0 ends the job, abort set when refused
+	uint16_t length;	// bytes following, value is cut to MODSDO_VALUE_MAX
+	uint32_t size;		// bytes read from the node
+	uint32_t abort;		// CANOPEN_SDOABORT_*, 0 when read
+};
+
+#define MODSDO_ENTRIES		255	// count of the header
+#define MODSDO_SESSIONS		8
+#define MODSDO_VALUE_MAX	256
+#define MODSDO_TIMEOUT		100	// ms
+#define MODSDO_BLKSIZE		32	// segments per block
+/* responses waiting for the main loop, a whole block of every session, power of two */
+#define MODSDO_QUEUE		(MODSDO_SESSIONS * MODSDO_BLKSIZE)
+
+struct pbuf;
+
+void modsdo_request(struct pbuf *p, uint16_t offset, uint8_t count);
+void modsdo_rx(uint8_t port, const struct can_message *msg);
+void modsdo_step(void);
+
+#endif // MODSDO_H_INCLUDED
@@ -0,0 +1,39 @@
+#ifndef MODSYNC_H_INCLUDED
+#define MODSYNC_H_INCLUDED
+
+/*
+ * PTP like clock sync with the host as master, MODNET_TYPE_SYNC.
+ * Board ticks are never adjusted, the host maps them by the reported status:
+ * master = ticks - offset - drift * (ticks - time) / 1e9
+ */
+enum {
+	MODSYNC_SYNC = 1,	// master, t1 taken when sent
+	MODSYNC_FOLLOW_UP = 2,	// master, time is t1
+	MODSYNC_DELAY_REQ = 3,	// board, t3 taken when sent
+	MODSYNC_DELAY_RESP = 4,	// master, time is t4 when the request arrived
+	MODSYNC_STATUS = 5,	// board, result of the exchange
+};
+
+// 32
+struct modsync_msg {
+	uint8_t kind;		// MODSYNC_*
+	uint8_t reserved;
+	uint16_t seq;		// exchange, given by SYNC
+	int32_t drift;		// STATUS: ppb, board clock runs faster
+	uint64_t time;		// us, master time or board ticks for STATUS
+	int64_t offset;		// STATUS: us, board - master at time
+	uint32_t delay;		// STATUS: us, one way path delay
+	uint32_t exchanges;	// STATUS: accepted exchanges
+};
+
+/* exchanges with delay over best * 2 + slack were queued somewhere */
+#define MODSYNC_DELAY_SLACK	100	// us
+#define MODSYNC_GAIN		8	// drift filter
+
+/* master clock stepped (NTP), the sync starts over from the next exchange */
+#define MODSYNC_STEP		10000	// us, off the predicted offset
+#define MODSYNC_DRIFT_MAX	1000000	// ppb, crystals are far better
+
+void modsync_recv(const struct modsync_msg *msg, uint64_t rx);
+
+#endif // MODSYNC_H_INCLUDED
@@ -0,0 +1,38 @@
+#ifndef MODTELEM_H_INCLUDED
+#define MODTELEM_H_INCLUDED
+
+#define MODTELEM_INTERVAL	1000	// ms, default
+#define MODTELEM_INTERVAL_MIN	10	// ms
+
+/* health of the board, sent as MODNET_TYPE_TELEMETRY */
+// 260
+struct modtelem_record {
+	uint32_t uptime;		// ms
+	uint32_t loops;			// main loop iterations in the last interval
+	uint32_t pbuf_failures;		// datagrams lost, no pbuf
+	uint32_t heap_used;		// lwip heap, bytes
+	uint32_t heap_max;
+	uint32_t heap_size;
+	uint32_t stack_max;		// bytes, high water mark
+	uint32_t stack_size;
+
+	uint16_t ring_used[MODCAN_LANES];	// frames
+	uint16_t ring_max[MODCAN_LANES];
+	uint16_t ring_size[MODCAN_LANES];
+
+	struct modcan_stats port[MODCAN_PORTS];
+	struct modcan_timing timing[MODCAN_PORTS];
+
+	uint32_t latency[MODCAN_LANES][MODNET_LATENCY_BUCKETS];
+
+	struct modgen_stats gen[MODCAN_PORTS];
+};
+
+extern uint16_t modtelem_interval;
+
+void modtelem_init(void);
+void modtelem_start(uint16_t ms);
+void modtelem_loop(void);
+void modtelem_send(void);
+
+#endif // MODTELEM_H_INCLUDED
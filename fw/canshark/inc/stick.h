@@ -1,6 +1,15 @@
 #ifndef __STICK_H_INCLUDED
 #define __STICK_H_INCLUDED
 
+struct stick_task {
+	struct stick_task *next;
+	struct stick_task **prev;
+	uint64_t when;		// tick
+	uint32_t period;	// ticks, 0 for single shot
+	void (*fn)(void *arg);
+	void *arg;
+};
+
 void stick_init(int32_t hz);
 
 uint64_t stick_get(void);	// one interrupt resolution
@@ -11,6 +20,15 @@ bool stick_fire(uint64_t *when, const uint64_t period);
 bool stick_timeout(uint64_t *last, const uint64_t timeout);
 void stick_update(void);
 
+void stick_task_add(struct stick_task *task, uint32_t delay, uint32_t period,
+		    void (*fn)(void *arg), void *arg);
+void stick_task_cancel(struct stick_task *task);
+uint64_t stick_run(void);
+uint64_t stick_now(void);
+uint64_t stick_next(void);
+void stick_sleep(uint64_t until);
+
 #define STICK_HZ	1000
+#define STICK_WHEEL_SIZE	64	// power of two
 
 #endif // __STICK_H_INCLUDED
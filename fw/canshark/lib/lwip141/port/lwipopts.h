@@ -86,7 +86,14 @@ a lot of data that needs to be copied, this should be set high. */
 
 
 /* ---------- Statistics options ---------- */
-#define LWIP_STATS		0
+/* only the heap usage is collected, reported in telemetry */
+#define LWIP_STATS		1
+#define MEM_STATS		1
+#define MEMP_STATS		0
+#define LINK_STATS		0
+#define IP_STATS		0
+#define ICMP_STATS		0
+#define UDP_STATS		0
 #define LWIP_PROVIDE_ERRNO	0
 
 #define IP_REASSEMBLY		0
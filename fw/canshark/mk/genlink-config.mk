@@ -28,6 +28,11 @@ GENLINK_ARCH	:=$(shell awk -v PAT="$(DEVICE)" -v MODE="ARCH" -f $(OPENCM3_DIR)sc
 GENLINK_LIB	:=$(shell awk -v PAT="$(DEVICE)" -v MODE="LIB" -f $(OPENCM3_DIR)scripts/genlink.awk $(OPENCM3_DIR)ld/devices.data 2>/dev/null)
 GENLINK_SIZE	:=$(shell awk -v PAT="$(DEVICE)" -v MODE="SIZE" -f $(OPENCM3_DIR)scripts/genlink.awk $(OPENCM3_DIR)ld/devices.data 2>/dev/null)
 
+# rom region cut short of the device flash, the rest is not linked to
+ifneq ($(ROM_LENGTH),)
+GENLINK_DEFS	:= $(filter-out -D_ROM=%,$(GENLINK_DEFS)) -D_ROM=$(ROM_LENGTH)
+endif
+
 DEFS		+= $(GENLINK_DEFS)
 ARCH_FLAGS	:= $(GENLINK_ARCH)
 OPENCM3_LIBNAME	:= $(strip $(subst -l,,$(GENLINK_LIB)))
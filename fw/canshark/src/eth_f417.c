@@ -6,6 +6,7 @@
 #include <libopencm3/stm32/usart.h>
 #include <libopencm3/cm3/nvic.h>
 #include <libopencm3/ethernet/mac.h>
+#include <libopencm3/ethernet/phy.h>
 #include <libopencm3/ethernet/phy_ksz8051mll.h>
 
 #include "lwip/memp.h"
@@ -17,6 +18,7 @@
 #include "netif/etharp.h"
 
 #include "eth_f417.h"
+#include "stick.h"
 
 #define ETH_RX_BUF_SIZE    1536 /* buffer size for receive */
 #define ETH_TX_BUF_SIZE    1536 /* buffer size for transmit */
@@ -60,6 +62,8 @@ void ethf417_gpio_init(void)
 static uint8_t pkt[1600];
 static uint8_t pkr[1600];
 
+uint64_t ethf417_rx_time;
+
 int8_t ethf417_output(struct netif *nif, struct pbuf *p)
 {
 	(void)nif;
@@ -84,6 +88,9 @@ void ethf417_poll(struct netif *nif)
 		return;
 	}
 
+	/* as close to the wire as the sw gets, used by the clock sync */
+	ethf417_rx_time = stick_get_us();
+
 	struct pbuf *p = pbuf_alloc(PBUF_RAW, len, PBUF_RAM);
 	if (p == NULL) {
 		return;
@@ -98,6 +105,25 @@ void ethf417_poll(struct netif *nif)
 	return;
 }
 
+bool ethf417_pending(void)
+{
+	return eth_irq_is_pending(ETH_DMASR_RS);
+}
+
+/* PHY auto-negotiation finishes long after init, track the link state */
+void ethf417_link_poll(struct netif *nif)
+{
+	bool up = phy_link_isup(PHY0);
+
+	bool was = (nif->flags & NETIF_FLAG_LINK_UP) != 0;
+
+	if (up && !was) {
+		netif_set_link_up(nif);
+	} else if (!up && was) {
+		netif_set_link_down(nif);
+	}
+}
+
 int8_t ethf417_init(struct netif *nif)
 {
 	struct ethf417_state *state = (struct ethf417_state *)nif->state;
@@ -114,7 +140,7 @@ int8_t ethf417_init(struct netif *nif)
 	ETHADDR32_COPY(nif->hwaddr, state->mac);
 
 	nif->mtu = 1500;
-	nif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_LINK_UP;
+	nif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP;
 
 
 	ethf417_gpio_init();
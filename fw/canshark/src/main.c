@@ -5,6 +5,7 @@
 #include <libopencm3/cm3/nvic.h>
 #include <libopencm3/cm3/systick.h>
 #include <libopencm3/cm3/dwt.h>
+#include <libopencm3/cm3/cortex.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/flash.h>
@@ -19,8 +20,15 @@
 #include "modled.h"
 #include "stick.h"
 #include "eth_f417.h"
+#include "modbench.h"
 #include "modcan.h"
+#include "modcfg.h"
 #include "modnet.h"
+#include "modnmt.h"
+#include "modctl.h"
+#include "modgen.h"
+#include "modsdo.h"
+#include "modtelem.h"
 
 #include "can_canopen.h"
 
@@ -44,74 +52,109 @@ void sys_tick_handler(void)
 {
 	stick_update();
 
-	canopen_sync(CAN1);
+	if (modcan_tx_enabled(0)) {
+		canopen_sync(CAN1);
+	}
 	//canopen_sync(CAN2);
 
 	//uint64_t ticks = stick_get();
 	//can_transmit(CAN2, CAN_ID_STDID(0x100), (uint8_t*)&ticks, 8);
 }
 
-uint64_t arp_tmr;
-uint64_t led_tmr;
+struct stick_task arp_task;
+struct stick_task led_task;
+struct stick_task link_task;
+struct stick_task nmt_task;
+struct stick_task announce_task;
+
+#define LINK_TMR_INTERVAL	100	// ms
 
 #define BENCHMARK_START(a)	a = dwt_read_cycle_counter()
 #define BENCHMARK_END(a)	a = dwt_read_cycle_counter() - a;
 
-struct can_message modcan_buffer[8];
+static void arp_run(void *arg)
+{
+	(void)arg;
+	etharp_tmr();
+}
+
+static void led_run(void *arg)
+{
+	(void)arg;
+	LED_TGL(LED0);
+}
+
+static void link_run(void *arg)
+{
+	ethf417_link_poll((struct netif *)arg);
+}
+
+static void nmt_run(void *arg)
+{
+	(void)arg;
+	if (modnet_online()) {
+		modnmt_digest();
+	}
+}
+
+static void announce_run(void *arg)
+{
+	(void)arg;
+	if (modnet_online()) {
+		modnet_announce(0);
+	}
+}
 
 int main(void)
 {
+	modtelem_init();
+
 	rcc_clock_setup_hse_3v3(&myclock168);
 
 	dwt_enable_cycle_counter();
 
 	stick_init(STICK_HZ);
 	modled_init();
-	modnet_init(&netif);
-	modcan_init();
 
-	stick_prepare(&arp_tmr, ARP_TMR_INTERVAL * STICK_HZ / 1000);
-	stick_prepare(&led_tmr, STICK_HZ);
+	modnmt_init();
 
-	struct udp_pcb *udp = udp_new();
-	udp->so_options |= SOF_BROADCAST;
+	/* capture from power on, frames wait in the ring until link is up */
+	modcan_init();
+	modnet_init(&netif);
 
-	struct ip_addr ipa = { IPADDR_ANY };
-	udp_bind(udp, &ipa, 6000);
+	stick_task_add(&arp_task, ARP_TMR_INTERVAL * STICK_HZ / 1000, ARP_TMR_INTERVAL * STICK_HZ / 1000, arp_run, NULL);
+	stick_task_add(&led_task, STICK_HZ, STICK_HZ, led_run, NULL);
+	stick_task_add(&link_task, LINK_TMR_INTERVAL * STICK_HZ / 1000, LINK_TMR_INTERVAL * STICK_HZ / 1000, link_run, &netif);
+	modtelem_start(MODTELEM_INTERVAL);
+	stick_task_add(&nmt_task, MODNMT_INTERVAL * STICK_HZ / 1000, MODNMT_INTERVAL * STICK_HZ / 1000, nmt_run, NULL);
+	stick_task_add(&announce_task, MODNET_ANNOUNCE_INTERVAL * STICK_HZ / 1000, MODNET_ANNOUNCE_INTERVAL * STICK_HZ / 1000, announce_run, NULL);
 
-	IP4_ADDR(&ipa, 255, 255, 255, 255);  // the IP to send data to
+	/* saved settings over the defaults */
+	modcfg_load();
 
 	while (1) {
 
 		ethf417_poll(&netif);
 
-		int n = 0;
-		while (modcan_get(&modcan_buffer[n]) && (n < 8)) {
-			n++;
-		}
-
-		if (n > 0) {
-			struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, n * sizeof(struct can_message), PBUF_RAM);
-			if (p == NULL) {
-				/* packets are lost ! */
-				continue;
-			}
+		modnet_stream();
 
-			// allocated is always single pbuf in PBUF_RAM, read the buffer into pbuf
-			memcpy(p->payload, modcan_buffer, n * sizeof(struct can_message));
-			p->len = n * sizeof(struct can_message);
-			udp_sendto(udp, p, &ipa, 6000);
+		modcan_step();
+		modctl_step();
+		modsdo_step();
+		modnmt_step();
+		modgen_step();
+		modbench_step();
 
-			pbuf_free(p);
-		}
+		stick_run();
 
-		if (stick_fire(&arp_tmr, ARP_TMR_INTERVAL * STICK_HZ / 1000)) {
-			etharp_tmr();
-		}
+		modtelem_loop();
 
-		if (stick_fire(&led_tmr, STICK_HZ)) {
-			LED_TGL(LED0);
+		/* nothing to send, wait for the next interrupt, WFI wakes even when masked */
+		cm_disable_interrupts();
+		if (!modnet_busy() && !ethf417_pending()) {
+			stick_sleep(stick_next());
 		}
+		cm_enable_interrupts();
 	}
 
 	return 0;
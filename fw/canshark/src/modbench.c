@@ -0,0 +1,239 @@
+#include <string.h>
+
+#include <libopencm3/stm32/can.h>
+
+#include "modbench.h"
+#include "modcan.h"
+#include "modctl.h"
+#include "modgen.h"
+#include "modnet.h"
+#include "stick.h"
+
+/* frame length without stuff bits, including the interframe space */
+#define MODBENCH_BITS(dlc)	(47 + (dlc) * 8)
+
+enum {
+	MODBENCH_STATE_IDLE,
+	MODBENCH_STATE_RUN,		// generator sends
+	MODBENCH_STATE_SETTLE,	// generator stopped, capture drains
+};
+
+static struct {
+	struct modbench_config cfg;
+	uint8_t state;
+	uint16_t load;
+	uint64_t until;		// us, end of the phase
+	uint64_t drained;	// us, settle gives up
+	bool failed;		// a step lost frames
+
+	/* rx port counters when the step started */
+	uint32_t overrun;
+	uint32_t lost;
+
+	/* stream stage of the step */
+	uint32_t expect;	// next sequence number
+
+	int64_t fastest;	// us, isr time less the start of frame
+	uint32_t calibrate;	// frames left
+
+	struct modbench_report rep;
+} modbench;
+
+static bool modbench_valid(const struct modbench_config *cfg)
+{
+	return (cfg->tx < MODCAN_PORTS) && (cfg->rx < MODCAN_PORTS) && (cfg->tx != cfg->rx) &&
+	       (cfg->dlc >= 4) && (cfg->dlc <= 8) && (cfg->id < 0x800) &&
+	       (cfg->first <= cfg->last) && (cfg->last <= 1000);
+}
+
+static void modbench_generate(uint16_t load)
+{
+	struct modgen_config gen;
+	memset(&gen, 0, sizeof(gen));
+
+	gen.port = modbench.cfg.tx;
+	gen.ids = MODGEN_IDS_FIXED;
+	gen.dlc_min = modbench.cfg.dlc;
+	gen.dlc_max = modbench.cfg.dlc;
+	gen.load = load;
+	gen.id_first = modbench.cfg.id;
+	gen.id_count = 1;
+	gen.seed = 1;
+
+	modgen_start(&gen);
+}
+
+static void modbench_begin(uint16_t load)
+{
+	struct modcan_stats *st = &modcan_stats[modbench.cfg.rx];
+	uint16_t max_ok = modbench.rep.max_ok;
+
+	memset(&modbench.rep, 0, sizeof(modbench.rep));
+	modbench.rep.load = load;
+	modbench.rep.max_ok = max_ok;
+
+	modbench.overrun = st->overrun[0] + st->overrun[1];
+	modbench.lost = st->lost;
+	modbench.expect = 0;
+	modbench.load = load;
+
+	modbench.state = MODBENCH_STATE_RUN;
+	modbench.until = stick_get_us() + modbench.cfg.step * 1000ULL;
+	modbench_generate(load);
+}
+
+void modbench_request(const struct modbench_config *cfg)
+{
+	struct modbench_config rep;
+	memcpy(&rep, cfg, sizeof(rep));
+	rep.reserved = 0;
+
+	if (modbench.state != MODBENCH_STATE_IDLE) {
+		/* any request ends the run in progress */
+		modbench_generate(0);
+		modbench.state = MODBENCH_STATE_IDLE;
+	}
+
+	if (!modbench_valid(cfg)) {
+		rep.status = MODCTL_STATUS_INVALID;
+	} else if ((cfg->first > 0) && (!modcan_tx_enabled(cfg->tx) || !modcan_tx_enabled(cfg->rx))) {
+		rep.status = MODCTL_STATUS_FAILED;
+	} else {
+		rep.status = MODCTL_STATUS_OK;
+	}
+
+	if ((rep.status == MODCTL_STATUS_OK) && (cfg->first > 0)) {
+		memset(&modbench, 0, sizeof(modbench));
+		memcpy(&modbench.cfg, cfg, sizeof(modbench.cfg));
+
+		if (modbench.cfg.step == 0) {
+			modbench.cfg.step = MODBENCH_STEP;
+		}
+		modbench.calibrate = MODBENCH_CALIBRATE;
+		modbench_begin(cfg->first);
+	}
+
+	modnet_send(MODNET_TYPE_BENCH, MODNET_FLAG_REPLY, &rep, 1, sizeof(rep));
+}
+
+/* isr time less the start of frame, the constant offset is unknown */
+static int64_t modbench_delay(const struct can_message *msg)
+{
+	uint32_t bitrate = modcan_timing[modbench.cfg.rx].bitrate;
+
+	return (int64_t)msg->ticks - (int64_t)(MODCAN_BIT_TIME(msg) * 1000000 / bitrate);
+}
+
+static void modbench_latency(const struct can_message *msg)
+{
+	int64_t delay = modbench_delay(msg);
+
+	if ((modbench.calibrate == MODBENCH_CALIBRATE) || (delay < modbench.fastest)) {
+		modbench.fastest = delay;
+	}
+
+	if (modbench.calibrate > 0) {
+		modbench.calibrate--;
+		return;
+	}
+
+	uint32_t us = delay - modbench.fastest;
+	uint8_t bucket = (us == 0) ? 0 : 32 - __builtin_clz(us);
+
+	if (bucket >= MODBENCH_LATENCY_BUCKETS) {
+		bucket = MODBENCH_LATENCY_BUCKETS - 1;
+	}
+
+	modbench.rep.latency[bucket]++;
+}
+
+/* every frame read from the ring, streamed when the datagram was allocated */
+void modbench_frame(const struct can_message *msg, bool streamed)
+{
+	if ((modbench.state == MODBENCH_STATE_IDLE) ||
+	    ((msg->source & 0x0F) != modbench.cfg.rx + 1) ||	// received, not the own tx
+	    ((msg->mobid & MODCAN_ID_MASK) != CAN_ID_STDID(modbench.cfg.id)) ||
+	    (msg->length < 4)) {
+		return;
+	}
+
+	uint32_t seq = msg->data[0] | (msg->data[1] << 8) | (msg->data[2] << 16) | ((uint32_t)msg->data[3] << 24);
+	if (seq != modbench.expect) {
+		modbench.rep.order++;
+	}
+	modbench.expect = seq + 1;
+
+	modbench.rep.seen++;
+	if (streamed) {
+		modbench.rep.streamed++;
+	} else {
+		modbench.rep.pbuf++;
+	}
+
+	modbench_latency(msg);
+}
+
+static void modbench_report(void)
+{
+	struct modbench_report *rep = &modbench.rep;
+	struct modcan_stats *st = &modcan_stats[modbench.cfg.rx];
+	uint32_t bitrate = modcan_timing[modbench.cfg.tx].bitrate;
+	uint32_t ms = modbench.cfg.step;
+
+	rep->overrun = st->overrun[0] + st->overrun[1] - modbench.overrun;
+	rep->ring = st->lost - modbench.lost;
+	rep->rate = (uint64_t)rep->sent * 1000 / ms;
+	rep->achieved = (uint64_t)rep->sent * MODBENCH_BITS(modbench.cfg.dlc) * 1000000 / ((uint64_t)bitrate * ms);
+
+	if (!modbench.failed && (rep->streamed == rep->sent) && (rep->order == 0)) {
+		rep->max_ok = modbench.load;
+	} else {
+		modbench.failed = true;
+	}
+
+	uint16_t next = modbench.load + modbench.cfg.increment;
+	bool last = (modbench.cfg.increment == 0) || (next > modbench.cfg.last) ||
+		    !modcan_tx_enabled(modbench.cfg.tx);
+
+	modnet_send(MODNET_TYPE_BENCH_STEP, last ? MODNET_FLAG_LAST : 0, rep, 1, sizeof(*rep));
+
+	if (last) {
+		modbench.state = MODBENCH_STATE_IDLE;
+	} else {
+		modbench_begin(next);
+	}
+}
+
+void modbench_step(void)
+{
+	uint64_t now = stick_get_us();
+
+	switch (modbench.state) {
+	case MODBENCH_STATE_RUN:
+		if ((now < modbench.until) && (modgen_stats[modbench.cfg.tx].target != 0)) {
+			break;
+		}
+
+		/* taken before the stop clears it, the mailboxes send the rest meanwhile */
+		modbench.rep.sent = modgen_stats[modbench.cfg.tx].sent;
+		modbench_generate(0);
+
+		modbench.state = MODBENCH_STATE_SETTLE;
+		modbench.until = now + MODBENCH_SETTLE * 1000;
+		modbench.drained = now + MODBENCH_SETTLE_MAX * 1000;
+		break;
+
+	case MODBENCH_STATE_SETTLE:
+		if ((now < modbench.until) ||
+		    ((now < modbench.drained) && (modcan_pending(MODCAN_LANE_PRIO) + modcan_pending(MODCAN_LANE_BULK) > 0))) {
+			break;
+		}
+
+		modbench_report();
+		break;
+
+	case MODBENCH_STATE_IDLE:
+	default:
+		break;
+	}
+}
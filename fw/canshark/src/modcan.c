@@ -7,16 +7,187 @@
 
 #include "modcan.h"
 #include "modled.h"
+#include "modnmt.h"
+#include "modsdo.h"
 #include "stick.h"
 
 #include "can_canopen.h"
 
 uint32_t MOB_ANY = 0;
 
-struct can_message msgs[8];
-uint8_t msgs_w = 0;
-uint8_t msgs_r = 0;
+struct modcan_ring {
+	struct can_message *msgs;
+	uint16_t mask;
+	uint16_t w;
+	uint16_t r;
+};
+
+struct can_message msgs_prio[MODCAN_PRIO_SIZE];
+struct can_message msgs_bulk[MODCAN_RING_SIZE];
+
+struct modcan_ring rings[MODCAN_LANES] = {
+	[MODCAN_LANE_PRIO] = { msgs_prio, MODCAN_PRIO_SIZE - 1, 0, 0 },
+	[MODCAN_LANE_BULK] = { msgs_bulk, MODCAN_RING_SIZE - 1, 0, 0 },
+};
+
+struct modcan_stats modcan_stats[MODCAN_PORTS];
+uint16_t modcan_ring_high[MODCAN_LANES];
+
+struct modcan_timing modcan_timing[MODCAN_PORTS];
+
+/* standard rates, also the autobaud candidates */
+static const struct {
+	uint32_t bitrate;
+	uint32_t freq;
+} modcan_rates[] = {
+	{ 1000000, CAN_FREQ_1M },
+	{ 800000, CAN_FREQ_800K },
+	{ 500000, CAN_FREQ_500K },
+	{ 250000, CAN_FREQ_250K },
+	{ 125000, CAN_FREQ_125K },
+	{ 50000, CAN_FREQ_50K },
+	{ 20000, CAN_FREQ_20K },
+	{ 10000, CAN_FREQ_10K },
+};
+
+/* on equal score the first one wins, CiA recommended point goes first */
+static const struct {
+	uint16_t sample;
+	uint32_t point;
+} modcan_samples[] = {
+	{ 875, CAN_SAMPLE_875 },
+	{ 800, CAN_SAMPLE_80 },
+	{ 750, CAN_SAMPLE_75 },
+};
+
+#define MODCAN_RATES		(sizeof(modcan_rates) / sizeof(modcan_rates[0]))
+#define MODCAN_SAMPLES		(sizeof(modcan_samples) / sizeof(modcan_samples[0]))
+#define MODCAN_CANDIDATES	(MODCAN_RATES * MODCAN_SAMPLES)
+
+struct modcan_autobaud {
+	uint8_t candidate;	// rate * MODCAN_SAMPLES + sample
+	uint8_t best;		// MODCAN_CANDIDATES if none
+	int32_t score;		// of the best, frames - errors
+	uint64_t until;		// tick, end of the candidate dwell
+	uint32_t rx;		// counters at the start of the dwell
+	uint32_t errors;
+};
+
+static struct modcan_autobaud autobaud[MODCAN_PORTS];
+
+/* ID ranges going to the priority lane, unused entries have first > last */
+struct modcan_range lanes[MODCAN_LANE_RANGES] = {
+	{ COB_NMT, COB_NMT },			// NMT
+	{ COB_SYNC, COB_EMCY(0x7F) },		// SYNC + EMCY
+	{ 1, 0 },
+	{ 1, 0 },
+};
+
+#define MOB_STD_EXACT	(CAN_ID_STDID(0x7FF) | CAN_ID_IDE | CAN_ID_RTR)
+
+/* critical IDs, never dropped in favor of bulk traffic */
+struct modcan_filter filters[MODCAN_FILTERS] = {
+	{ COB_NMT, MOB_STD_EXACT },				// NMT
+	{ COB_SYNC, CAN_ID_STDID(0x780) | CAN_ID_IDE | CAN_ID_RTR },	// SYNC + EMCY
+	{ 0, 0 },						// safety PDOs
+	{ 0, 0 },
+};
+
+/*
+ * Banks of the port are filled with used critical filters to FIFO0, then by
+ * catch-all to FIFO1. On multiple match the lower bank wins, so critical IDs
+ * never reach FIFO1.
+ */
+static void modcan_filter_apply(void)
+{
+	can_filter_init_enter(CAN1);
+
+	for (uint8_t port = 0; port < MODCAN_PORTS; port++) {
+		uint32_t bank = port * MODCAN_FILTER_BANKS;
+		uint32_t last = bank + MODCAN_FILTER_BANKS;
+
+		for (int i = 0; i < MODCAN_FILTERS; i++) {
+			if (filters[i].mask != 0) {
+				can_filter_set_mask32(CAN1, bank++, 0, filters[i].mobid, filters[i].mask);
+			}
+		}
+
+		while (bank < last) {
+			can_filter_set_mask32(CAN1, bank++, 1, MOB_ANY, MOB_ANY);
+		}
+	}
+
+	can_filter_init_leave(CAN1);
+}
+
+
+/* last frame of the port, reference of the bit time unwrap */
+static struct {
+	bool valid;
+	uint64_t ticks;		// us
+	uint64_t bits;		// bit times
+} modcan_clock[MODCAN_PORTS];
+
+static uint32_t modcan_canport(uint8_t port)
+{
+	return (port == 0) ? CAN1 : CAN2;
+}
+
+/* reprograms the bit timing, the port is off the bus for a while */
+static bool modcan_configure(uint8_t port, uint32_t bitrate, uint16_t sample, bool silent)
+{
+	uint8_t r, s;
+
+	for (r = 0; r < MODCAN_RATES; r++) {
+		if (modcan_rates[r].bitrate == bitrate) {
+			break;
+		}
+	}
+
+	for (s = 0; s < MODCAN_SAMPLES; s++) {
+		if (modcan_samples[s].sample == sample) {
+			break;
+		}
+	}
+
+	if ((r == MODCAN_RATES) || (s == MODCAN_SAMPLES)) {
+		return false;
+	}
+
+	struct can_timing ct;
+	can_timing_init(&ct, modcan_rates[r].freq, modcan_samples[s].point);
+
+	uint32_t canport = modcan_canport(port);
 
+	/* pending frames would be looped back as sent in silent mode */
+	if (silent) {
+		CAN_TSR(canport) = CAN_TSR_ABRQ0 | CAN_TSR_ABRQ1 | CAN_TSR_ABRQ2;
+	}
+
+	if (!can_enter_init_mode_blocking(canport)) {
+		return false;
+	}
+
+	/* mailboxes leave in the order queued, not by identifier */
+	CAN_MCR(canport) |= CAN_MCR_TXFP;
+
+	/* timing rewrites whole BTR, including the mode bits */
+	can_timing_set(canport, &ct);
+	if (silent) {
+		CAN_BTR(canport) |= CAN_BTR_SILM;
+	} else {
+		CAN_BTR(canport) &= ~CAN_BTR_SILM;
+	}
+
+	can_leave_init_mode_blocking(canport);
+
+	/* bit times of the new rate, the unwrap starts over from the isr clock */
+	modcan_clock[port].valid = false;
+
+	modcan_timing[port].bitrate = bitrate;
+	modcan_timing[port].sample = sample;
+	return true;
+}
 
 void modcan_init(void)
 {
@@ -40,23 +211,14 @@ void modcan_init(void)
 	can_leave_sleep_mode(CAN1);
 	can_leave_sleep_mode(CAN2);
 
-	struct can_timing ct;
-	can_timing_init(&ct, CAN_FREQ_500K, CAN_SAMPLE_75);
-
-	//uint32_t canfreq = can_timing_getfreq(&ct);
-
 	if (can_enter_init_mode_blocking(CAN1)) {
 		can_mode_set_autobusoff(CAN1, true);
 		can_mode_set_timetriggered(CAN1, true);
-		can_timing_set(CAN1, &ct);
-		can_filter_set_slave_start(CAN1, 5);
+		can_filter_set_slave_start(CAN1, MODCAN_FILTER_BANKS);
 
 		//CAN_MCR(CAN1) &= ~CAN_MCR_DBF;
 
-		can_filter_init_enter(CAN1);
-		can_filter_set_mask32(CAN1, 0, 0, MOB_ANY, MOB_ANY);
-		can_filter_set_mask32(CAN1, 5, 0, MOB_ANY, MOB_ANY);
-		can_filter_init_leave(CAN1);
+		modcan_filter_apply();
 
 		can_leave_init_mode_blocking(CAN1);
 	}
@@ -64,12 +226,14 @@ void modcan_init(void)
 	if (can_enter_init_mode_blocking(CAN2)) {
 		can_mode_set_autobusoff(CAN2, true);
 		can_mode_set_timetriggered(CAN2, true);
-		can_timing_set(CAN2, &ct);
-
-
 		can_leave_init_mode_blocking(CAN2);
 	}
 
+	modcan_timing[0].silent = MODCAN_SILENT_DEFAULT;
+	modcan_timing[1].silent = MODCAN_SILENT_DEFAULT;
+	modcan_configure(0, MODCAN_BITRATE_DEFAULT, MODCAN_SAMPLE_DEFAULT, MODCAN_SILENT_DEFAULT);
+	modcan_configure(1, MODCAN_BITRATE_DEFAULT, MODCAN_SAMPLE_DEFAULT, MODCAN_SILENT_DEFAULT);
+
 	nvic_enable_irq(NVIC_CAN1_RX0_IRQ);
 	nvic_enable_irq(NVIC_CAN1_RX1_IRQ);
 	nvic_enable_irq(NVIC_CAN2_RX0_IRQ);
@@ -79,41 +243,148 @@ void modcan_init(void)
 	nvic_enable_irq(NVIC_CAN1_TX_IRQ);
 	nvic_enable_irq(NVIC_CAN2_TX_IRQ);
 
-	nvic_set_priority(NVIC_CAN1_RX0_IRQ, 1);
-	nvic_set_priority(NVIC_CAN1_RX1_IRQ, 1);
-	nvic_set_priority(NVIC_CAN2_RX0_IRQ, 1);
-	nvic_set_priority(NVIC_CAN2_RX1_IRQ, 1);
-	nvic_set_priority(NVIC_CAN1_SCE_IRQ, 1);
-	nvic_set_priority(NVIC_CAN2_SCE_IRQ, 1);
-	nvic_set_priority(NVIC_CAN1_TX_IRQ, 1);
-	nvic_set_priority(NVIC_CAN2_TX_IRQ, 1);
+	/* critical FIFO0 preempts the bulk traffic, only upper 4 bits implemented */
+	nvic_set_priority(NVIC_CAN1_RX0_IRQ, 0x40);
+	nvic_set_priority(NVIC_CAN1_RX1_IRQ, 0x80);
+	nvic_set_priority(NVIC_CAN2_RX0_IRQ, 0x40);
+	nvic_set_priority(NVIC_CAN2_RX1_IRQ, 0x80);
+	nvic_set_priority(NVIC_CAN1_SCE_IRQ, 0x80);
+	nvic_set_priority(NVIC_CAN2_SCE_IRQ, 0x80);
+	nvic_set_priority(NVIC_CAN1_TX_IRQ, 0x80);
+	nvic_set_priority(NVIC_CAN2_TX_IRQ, 0x80);
 
 	/* Enable CAN RX interrupt. */
-	can_enable_irq(CAN1, CAN_IER_FMPIE0 | CAN_IER_FMPIE1 | CAN_IER_TMEIE);
-	can_enable_irq(CAN2, CAN_IER_FMPIE0 | CAN_IER_FMPIE1 | CAN_IER_TMEIE);
+	can_enable_irq(CAN1, CAN_IER_FMPIE0 | CAN_IER_FMPIE1 | CAN_IER_FOVIE0 | CAN_IER_FOVIE1 | CAN_IER_TMEIE);
+	can_enable_irq(CAN2, CAN_IER_FMPIE0 | CAN_IER_FMPIE1 | CAN_IER_FOVIE0 | CAN_IER_FOVIE1 | CAN_IER_TMEIE);
+
+	/* bus errors are counted for autobaud and telemetry */
+	can_enable_irq(CAN1, CAN_IER_ERRIE | CAN_IER_LECIE);
+	can_enable_irq(CAN2, CAN_IER_ERRIE | CAN_IER_LECIE);
 }
 
 static void can_isr_sce(uint32_t canport)
 {
-	(void)canport;
+	uint32_t lec = CAN_ESR(canport) & CAN_ESR_LEC_MASK;
+
+	if ((lec != CAN_ESR_LEC_NO_ERROR) && (lec != CAN_ESR_LEC_USER)) {
+		modcan_stats[MODCAN_PORT(canport)].errors++;
+	}
+
+	/* hw never sets the user code, so the next error is seen as a change */
+	CAN_ESR(canport) = CAN_ESR_LEC_USER;
+	CAN_MSR(canport) = CAN_MSR_ERRI;
 	//LED_TGL(LED2);
 }
 
-static struct can_message *canmsg_get(void)
+static uint8_t canmsg_lane(uint32_t mobid)
+{
+	mobid &= MODCAN_ID_MASK;
+
+	for (int i = 0; i < MODCAN_LANE_RANGES; i++) {
+		if ((mobid >= lanes[i].first) && (mobid <= lanes[i].last)) {
+			return MODCAN_LANE_PRIO;
+		}
+	}
+
+	return MODCAN_LANE_BULK;
+}
+
+/* isr of FIFO0 preempts the others, slot is reserved atomically */
+static struct can_message *canmsg_get(uint8_t source, uint32_t mobid)
 {
-	if (msgs[msgs_w].isthere) {
+	CM_ATOMIC_CONTEXT();
+
+	uint8_t port = (source & 0x07) - 1;
+	bool tx = (source & 0x08) != 0;
+	bool critical = !tx && ((source & 0x30) == 0);	// FIFO0
+
+	uint8_t lane = critical ? MODCAN_LANE_PRIO : canmsg_lane(mobid);
+	struct modcan_ring *ring = &rings[lane];
+
+	/* priority lane overflows into the bulk one */
+	if (ring->msgs[ring->w].isthere) {
+		lane = MODCAN_LANE_BULK;
+		ring = &rings[lane];
+	}
+
+	if (ring->msgs[ring->w].isthere) {
+		modcan_stats[port].lost++;
+		return NULL;
+	}
+
+	/* headroom of the bulk lane is kept for critical frames */
+	if (!critical && (lane == MODCAN_LANE_BULK) &&
+	    (((ring->w - ring->r) & ring->mask) >= ring->mask + 1 - MODCAN_RING_RESERVE)) {
+		modcan_stats[port].lost++;
 		return NULL;
 	}
 
-	struct can_message *msg = &msgs[msgs_w];
-	msgs_w = (msgs_w + 1) & 7;
+	if (tx) {
+		modcan_stats[port].tx++;
+	} else {
+		modcan_stats[port].rx++;
+	}
+
+	struct can_message *msg = &ring->msgs[ring->w];
+	ring->w = (ring->w + 1) & ring->mask;
+
+	uint16_t used = (ring->w - ring->r) & ring->mask;
+	if (used == 0) {
+		used = ring->mask + 1;
+	}
+	if (used > modcan_ring_high[lane]) {
+		modcan_ring_high[lane] = used;
+	}
 
+	msg->mobid = mobid;
+	msg->source = source;
 	msg->ticks = stick_get_us();
 	msg->zero = 0;
 	msg->isthere = true;
 	return msg;
 }
 
+/*
+ * Extends the 16 bit hw timestamp. The isr clock tells the bit times elapsed
+ * since the previous frame, the wraps are the count nearest to it. It holds
+ * while the isr latency jitters less than the half of the wrap, 32 ms at 1 Mbit/s.
+ */
+static void canmsg_unwrap(uint8_t port, struct can_message *msg)
+{
+	CM_ATOMIC_CONTEXT();
+
+	uint32_t bitrate = modcan_timing[port].bitrate;
+	int64_t expect;
+
+	if (modcan_clock[port].valid) {
+		int64_t elapsed = (int64_t)(msg->ticks - modcan_clock[port].ticks) * bitrate / 1000000;
+		expect = modcan_clock[port].bits + elapsed;
+	} else {
+		/* first frame, close to the isr clock so the ports are comparable */
+		expect = msg->ticks * bitrate / 1000000;
+	}
+
+	int64_t base = expect - (expect & 0xFFFF);
+	int64_t bits = base + msg->time;
+
+	if (bits - expect > 0x8000) {
+		bits -= 0x10000;
+	} else if (expect - bits > 0x8000) {
+		bits += 0x10000;
+	}
+
+	if (bits < 0) {
+		bits += 0x10000;
+	}
+
+	modcan_clock[port].valid = true;
+	modcan_clock[port].ticks = msg->ticks;
+	modcan_clock[port].bits = bits;
+
+	msg->time_mid = bits >> 16;
+	msg->time_hi = bits >> 48;
+}
+
 static void can_isr_tx(uint32_t canport)
 {
 	int mailbox=0;
@@ -130,16 +401,16 @@ static void can_isr_tx(uint32_t canport)
 
 	CAN_TSR(canport) = CAN_TSR_RQCP(mailbox);
 
-	struct can_message *msg = canmsg_get();
+	uint8_t source = (mailbox << 4) | ((canport == CAN1) ? 1 : 2) | 0x08;
+	struct can_message *msg = canmsg_get(source, can_mailbox_get_mobid(canport, mailbox));
 
 	if (msg == NULL) {
 		//LED_TGL(LED4);
 		return;
 	}
 
-	msg->source = (mailbox << 4) | ((canport == CAN1) ? 1 : 2) | 0x08;
-	msg->mobid = can_mailbox_get_mobid(canport, mailbox);
 	msg->time = can_mailbox_get_timestamp(canport, mailbox);
+	canmsg_unwrap(MODCAN_PORT(canport), msg);
 	can_mailbox_read_data(canport, mailbox, msg->data, &msg->length);
 }
 
@@ -148,7 +419,39 @@ static void can_isr_tx(uint32_t canport)
 
 static void can_isr_rx(uint32_t canport, uint32_t fifo)
 {
-	struct can_message *msg = canmsg_get();
+	/* FOVR is at the same position in both FIFO registers */
+	if (fifo == 0) {
+		if (CAN_RF0R(canport) & CAN_RF0R_FOVR0) {
+			CAN_RF0R(canport) = CAN_RF0R_FOVR0;
+			modcan_stats[MODCAN_PORT(canport)].overrun[0]++;
+		}
+	} else {
+		if (CAN_RF1R(canport) & CAN_RF1R_FOVR1) {
+			CAN_RF1R(canport) = CAN_RF1R_FOVR1;
+			modcan_stats[MODCAN_PORT(canport)].overrun[1]++;
+		}
+	}
+
+	uint8_t port = MODCAN_PORT(canport);
+	uint32_t mobid = can_fifo_get_mobid(canport, fifo);
+
+	if (MODNMT_COB(mobid)) {
+		uint8_t data[8];
+		uint8_t len;
+
+		can_fifo_read_data(canport, fifo, data, &len);
+		if (modnmt_rx(port, mobid, data, len)) {
+			/* heartbeat kept out of the capture */
+			CM_ATOMIC_BLOCK() {
+				modcan_stats[port].rx++;
+			}
+			can_fifo_release(canport, fifo);
+			return;
+		}
+	}
+
+	uint8_t source = (fifo << 4) | ((canport == CAN1) ? 1 : 2);
+	struct can_message *msg = canmsg_get(source, mobid);
 
 	if (msg == NULL) {
 		//LED_TGL(LED4);
@@ -156,12 +459,13 @@ static void can_isr_rx(uint32_t canport, uint32_t fifo)
 		return;
 	}
 
-	msg->source = (fifo << 4) | ((canport == CAN1) ? 1 : 2);
-	msg->mobid = can_fifo_get_mobid(canport, fifo);
 	msg->time = can_fifo_get_timestamp(canport, fifo);
+	canmsg_unwrap(port, msg);
 
 	can_fifo_read_data(canport, fifo, msg->data, &msg->length);
 	can_fifo_release(canport, fifo);
+
+	modsdo_rx(port, msg);
 }
 
 void can1_sce_isr(void) { can_isr_sce(CAN1); }
@@ -175,22 +479,214 @@ void can2_rx1_isr(void) { LED_TGL(LED2); can_isr_rx(CAN2, 1); }
 
 
 
+/* listen silently with the candidate timing for a while */
+static void modcan_autobaud_try(uint8_t port)
+{
+	struct modcan_autobaud *ab = &autobaud[port];
+	uint8_t r = ab->candidate / MODCAN_SAMPLES;
+	uint8_t s = ab->candidate % MODCAN_SAMPLES;
+
+	modcan_configure(port, modcan_rates[r].bitrate, modcan_samples[s].sample, true);
+
+	ab->rx = modcan_stats[port].rx;
+	ab->errors = modcan_stats[port].errors;
+	ab->until = stick_now() + MODCAN_AUTOBAUD_DWELL * STICK_HZ / 1000;
+}
+
+void modcan_autobaud_start(uint8_t port)
+{
+	if (port >= MODCAN_PORTS) {
+		return;
+	}
+
+	struct modcan_autobaud *ab = &autobaud[port];
+	ab->candidate = 0;
+	ab->best = MODCAN_CANDIDATES;
+	ab->score = 0;
+
+	modcan_timing[port].autobaud = MODCAN_AUTOBAUD_RUNNING;
+	modcan_autobaud_try(port);
+}
+
+/* score the candidate by valid frames and bus errors, lock after the sweep */
+static void modcan_autobaud_step(uint8_t port)
+{
+	struct modcan_autobaud *ab = &autobaud[port];
+
+	if ((modcan_timing[port].autobaud != MODCAN_AUTOBAUD_RUNNING) || (stick_now() < ab->until)) {
+		return;
+	}
+
+	int32_t score = (int32_t)(modcan_stats[port].rx - ab->rx) - (int32_t)(modcan_stats[port].errors - ab->errors);
+	if (score > ab->score) {
+		ab->score = score;
+		ab->best = ab->candidate;
+	}
+
+	if (++ab->candidate < MODCAN_CANDIDATES) {
+		modcan_autobaud_try(port);
+		return;
+	}
+
+	if (ab->best == MODCAN_CANDIDATES) {
+		/* bus idle or no rate matched, sweep again */
+		ab->candidate = 0;
+		modcan_autobaud_try(port);
+		return;
+	}
+
+	uint8_t r = ab->best / MODCAN_SAMPLES;
+	uint8_t s = ab->best % MODCAN_SAMPLES;
+
+	modcan_configure(port, modcan_rates[r].bitrate, modcan_samples[s].sample, modcan_timing[port].silent);
+	modcan_timing[port].autobaud = MODCAN_AUTOBAUD_LOCKED;
+}
+
 void modcan_step(void)
 {
+	for (uint8_t port = 0; port < MODCAN_PORTS; port++) {
+		modcan_autobaud_step(port);
+	}
+}
+
+/* host requested timing, stops the autobaud */
+bool modcan_timing_set(uint8_t port, uint32_t bitrate, uint16_t sample)
+{
+	if (port >= MODCAN_PORTS) {
+		return false;
+	}
+
+	modcan_timing[port].autobaud = MODCAN_AUTOBAUD_OFF;
+	return modcan_configure(port, bitrate, sample, modcan_timing[port].silent);
+}
+
+/* listen only mode, the running autobaud applies it when locked */
+bool modcan_silent_set(uint8_t port, bool silent)
+{
+	if (port >= MODCAN_PORTS) {
+		return false;
+	}
+
+	modcan_timing[port].silent = silent;
+
+	if (modcan_timing[port].autobaud == MODCAN_AUTOBAUD_RUNNING) {
+		return true;
+	}
+
+	return modcan_configure(port, modcan_timing[port].bitrate, modcan_timing[port].sample, silent);
+}
+
+/* the port may drive the bus */
+bool modcan_tx_enabled(uint8_t port)
+{
+	return (port < MODCAN_PORTS) && !modcan_timing[port].silent &&
+	       (modcan_timing[port].autobaud != MODCAN_AUTOBAUD_RUNNING);
+}
+
+/* all frames of the board go through here, blocked when passive */
+bool modcan_transmit(uint8_t port, uint32_t mobid, uint8_t *data, uint8_t len)
+{
+	if (!modcan_tx_enabled(port)) {
+		return false;
+	}
 
+	return can_transmit(modcan_canport(port), mobid, data, len) >= 0;
 }
 
-bool modcan_get(struct can_message *msg)
+bool modcan_get(uint8_t lane, struct can_message *msg)
 {
 	CM_ATOMIC_CONTEXT();
+	struct modcan_ring *ring = &rings[lane];
 
-	if (!msgs[msgs_r].isthere) {
+	if (!ring->msgs[ring->r].isthere) {
 		return false;
 	}
 
-	memcpy(msg, &msgs[msgs_r], sizeof(struct can_message));
-	msgs[msgs_r].isthere = false;
+	memcpy(msg, &ring->msgs[ring->r], sizeof(struct can_message));
+	ring->msgs[ring->r].isthere = false;
+
+	ring->r = (ring->r + 1) & ring->mask;
+	return true;
+}
+
+uint16_t modcan_pending(uint8_t lane)
+{
+	CM_ATOMIC_CONTEXT();
+	struct modcan_ring *ring = &rings[lane];
+
+	if (!ring->msgs[ring->r].isthere) {
+		return 0;
+	}
+
+	return ((ring->w - ring->r - 1) & ring->mask) + 1;
+}
+
+/* capture time of the oldest frame in the lane, 0 if empty */
+uint64_t modcan_oldest(uint8_t lane)
+{
+	CM_ATOMIC_CONTEXT();
+	struct modcan_ring *ring = &rings[lane];
+
+	if (!ring->msgs[ring->r].isthere) {
+		return 0;
+	}
+
+	return ring->msgs[ring->r].ticks;
+}
+
+/* size and high water mark of the lane */
+uint16_t modcan_ring_size(uint8_t lane)
+{
+	return rings[lane].mask + 1;
+}
+
+uint16_t modcan_ring_max(uint8_t lane)
+{
+	return modcan_ring_high[lane];
+}
+
+bool modcan_lane_set(uint8_t idx, uint32_t first, uint32_t last)
+{
+	CM_ATOMIC_CONTEXT();
+
+	if (idx >= MODCAN_LANE_RANGES) {
+		return false;
+	}
+
+	lanes[idx].first = first;
+	lanes[idx].last = last;
+	return true;
+}
+
+bool modcan_lane_get(uint8_t idx, struct modcan_range *range)
+{
+	if (idx >= MODCAN_LANE_RANGES) {
+		return false;
+	}
+
+	memcpy(range, &lanes[idx], sizeof(*range));
+	return true;
+}
+
+/* reprograms the hw filters, frames are not received for a while */
+bool modcan_filter_set(uint8_t idx, uint32_t mobid, uint32_t mask)
+{
+	if (idx >= MODCAN_FILTERS) {
+		return false;
+	}
+
+	filters[idx].mobid = mobid;
+	filters[idx].mask = mask;
+	modcan_filter_apply();
+	return true;
+}
+
+bool modcan_filter_get(uint8_t idx, struct modcan_filter *filter)
+{
+	if (idx >= MODCAN_FILTERS) {
+		return false;
+	}
 
-	msgs_r = (msgs_r + 1) & 7;
+	memcpy(filter, &filters[idx], sizeof(*filter));
 	return true;
 }
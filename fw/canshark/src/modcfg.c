@@ -0,0 +1,150 @@
+#include <string.h>
+
+#include <libopencm3/stm32/flash.h>
+
+#include "modcan.h"
+#include "modcfg.h"
+#include "modgen.h"
+#include "modnet.h"
+#include "modnmt.h"
+#include "modtelem.h"
+
+#define MODCFG_WORDS		(sizeof(struct modcfg_record) / sizeof(uint32_t))
+
+static uint32_t modcfg_crc(const uint32_t *words, uint32_t count)
+{
+	uint32_t crc = 0xFFFFFFFF;
+
+	for (uint32_t i = 0; i < count * sizeof(uint32_t); i++) {
+		crc ^= ((const uint8_t *)words)[i];
+		for (uint8_t b = 0; b < 8; b++) {
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+		}
+	}
+
+	return ~crc;
+}
+
+static bool modcfg_valid(const struct modcfg_record *rec)
+{
+	return (rec->size == sizeof(*rec)) &&
+	       (rec->crc == modcfg_crc((const uint32_t *)rec, MODCFG_WORDS - 1));
+}
+
+/* newest valid record, NULL if none; free space starts at *end */
+static const struct modcfg_record *modcfg_find(uint32_t *end)
+{
+	const struct modcfg_record *found = NULL;
+	uint32_t offset = 0;
+
+	while (offset + sizeof(struct modcfg_record) <= MODCFG_SIZE) {
+		const struct modcfg_record *rec = (const struct modcfg_record *)(MODCFG_BASE + offset);
+
+		if ((rec->magic != MODCFG_MAGIC) || (rec->size < 8) || (rec->size & 3)) {
+			break;
+		}
+
+		if (modcfg_valid(rec)) {
+			found = rec;
+		}
+		offset += rec->size;
+	}
+
+	*end = offset;
+	return found;
+}
+
+/* over the defaults set by the modules at init */
+void modcfg_load(void)
+{
+	uint32_t end;
+	const struct modcfg_record *rec = modcfg_find(&end);
+
+	if ((rec == NULL) || rec->defaults) {
+		return;
+	}
+
+	for (uint8_t port = 0; port < MODCAN_PORTS; port++) {
+		modcan_silent_set(port, rec->port[port].silent);
+		modcan_timing_set(port, rec->port[port].bitrate, rec->port[port].sample);
+		modnmt_filter_set(port, rec->port[port].nmt_filter);
+	}
+
+	for (uint8_t i = 0; i < MODCAN_FILTERS; i++) {
+		modcan_filter_set(i, rec->filters[i].mobid, rec->filters[i].mask);
+	}
+
+	for (uint8_t i = 0; i < MODCAN_LANE_RANGES; i++) {
+		modcan_lane_set(i, rec->lanes[i].first, rec->lanes[i].last);
+	}
+
+	modnet_batch_age = rec->batch_age;
+	modnet_dest_set(rec->dest_addr, rec->dest_port);
+	modtelem_start(rec->telemetry);
+}
+
+static bool modcfg_write(struct modcfg_record *rec)
+{
+	uint32_t end;
+	modcfg_find(&end);
+
+	rec->magic = MODCFG_MAGIC;
+	rec->size = sizeof(*rec);
+	rec->crc = modcfg_crc((const uint32_t *)rec, MODCFG_WORDS - 1);
+
+	flash_unlock();
+
+	if (end + sizeof(*rec) > MODCFG_SIZE) {
+		flash_erase_sector(MODCFG_SECTOR, FLASH_CR_PROGRAM_X32);
+		end = 0;
+	}
+
+	const uint32_t *words = (const uint32_t *)rec;
+	for (uint32_t i = 0; i < MODCFG_WORDS; i++) {
+		flash_program_word(MODCFG_BASE + end + i * sizeof(uint32_t), words[i]);
+	}
+
+	flash_lock();
+
+	/* read back, the record is valid only if it made it whole */
+	return memcmp((const void *)(MODCFG_BASE + end), rec, sizeof(*rec)) == 0;
+}
+
+/* current settings of the modules */
+bool modcfg_save(void)
+{
+	struct modcfg_record rec;
+	memset(&rec, 0, sizeof(rec));
+
+	for (uint8_t port = 0; port < MODCAN_PORTS; port++) {
+		rec.port[port].bitrate = modcan_timing[port].bitrate;
+		rec.port[port].sample = modcan_timing[port].sample;
+		rec.port[port].silent = modcan_timing[port].silent;
+		rec.port[port].nmt_filter = modnmt_filter_get(port);
+	}
+
+	for (uint8_t i = 0; i < MODCAN_FILTERS; i++) {
+		modcan_filter_get(i, &rec.filters[i]);
+	}
+
+	for (uint8_t i = 0; i < MODCAN_LANE_RANGES; i++) {
+		modcan_lane_get(i, &rec.lanes[i]);
+	}
+
+	rec.batch_age = modnet_batch_age;
+	rec.dest_addr = modnet_dest_addr();
+	rec.dest_port = modnet_dest_udp();
+	rec.telemetry = modtelem_interval;
+
+	return modcfg_write(&rec);
+}
+
+/* the record marks the older ones dropped, no erase needed */
+bool modcfg_defaults(void)
+{
+	struct modcfg_record rec;
+	memset(&rec, 0, sizeof(rec));
+	rec.defaults = 1;
+
+	return modcfg_write(&rec);
+}
@@ -0,0 +1,279 @@
+#include <string.h>
+
+#include "lwip/netif.h"
+
+#include "modcan.h"
+#include "modcfg.h"
+#include "modctl.h"
+#include "modgen.h"
+#include "modnet.h"
+#include "modnmt.h"
+#include "modtelem.h"
+#include "stick.h"
+
+/* autobaud requests waiting for the lock */
+static bool modctl_autobaud_pending[MODCAN_PORTS];
+static uint16_t modctl_autobaud_id[MODCAN_PORTS];
+
+/* changes done, a retry gets the reply again */
+struct modctl_done {
+	uint64_t time;		// stick, 0 unused
+	struct modctl_msg req;
+	struct modctl_msg rep;
+};
+
+static struct modctl_done modctl_history[MODCTL_HISTORY];
+static uint8_t modctl_history_next;
+
+static bool modctl_change(uint8_t cmd)
+{
+	return (cmd != MODCTL_CMD_TIMING_GET) && (cmd != MODCTL_CMD_PARAM_GET) &&
+	       (cmd != MODCTL_CMD_FILTER_GET) && (cmd != MODCTL_CMD_LANE_GET);
+}
+
+static struct modctl_done *modctl_done_find(const struct modctl_msg *msg, bool args)
+{
+	uint64_t now = stick_get();
+
+	for (uint8_t i = 0; i < MODCTL_HISTORY; i++) {
+		struct modctl_done *d = &modctl_history[i];
+
+		if ((d->time == 0) || (now - d->time > MODCTL_HISTORY_AGE * STICK_HZ / 1000)) {
+			continue;
+		}
+
+		if ((d->req.id == msg->id) && (d->req.cmd == msg->cmd) && (d->req.port == msg->port) &&
+		    (!args || (memcmp(d->req.arg, msg->arg, sizeof(msg->arg)) == 0))) {
+			return d;
+		}
+	}
+
+	return NULL;
+}
+
+static void modctl_done_add(const struct modctl_msg *req, const struct modctl_msg *rep)
+{
+	struct modctl_done *d = &modctl_history[modctl_history_next];
+	modctl_history_next = (modctl_history_next + 1) % MODCTL_HISTORY;
+
+	d->time = stick_get();
+	memcpy(&d->req, req, sizeof(d->req));
+	memcpy(&d->rep, rep, sizeof(d->rep));
+}
+
+static void modctl_reply(struct modctl_msg *rep, uint8_t status)
+{
+	rep->status = status;
+	modnet_send(MODNET_TYPE_CONTROL, MODNET_FLAG_REPLY, rep, 1, sizeof(*rep));
+
+	/* the final reply of the pending change replaces the PENDING one */
+	struct modctl_done *d = modctl_done_find(rep, false);
+	if (d != NULL) {
+		memcpy(&d->rep, rep, sizeof(d->rep));
+	}
+}
+
+static void modctl_timing_reply(struct modctl_msg *rep, uint8_t status)
+{
+	rep->arg[0] = modcan_timing[rep->port].bitrate;
+	rep->arg[1] = modcan_timing[rep->port].sample;
+	modctl_reply(rep, status);
+}
+
+static bool modctl_param_get(uint32_t param, uint32_t *value)
+{
+	switch (param) {
+	case MODCTL_PARAM_BATCH_AGE:
+		*value = modnet_batch_age;
+		return true;
+
+	case MODCTL_PARAM_TELEMETRY:
+		*value = modtelem_interval;
+		return true;
+
+	case MODCTL_PARAM_DEST_ADDR:
+		*value = modnet_dest_addr();
+		return true;
+
+	case MODCTL_PARAM_DEST_PORT:
+		*value = modnet_dest_udp();
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+static bool modctl_param_set(uint32_t param, uint32_t value)
+{
+	switch (param) {
+	case MODCTL_PARAM_BATCH_AGE:
+		if (value > 1000000) {
+			return false;
+		}
+		modnet_batch_age = value;
+		return true;
+
+	case MODCTL_PARAM_TELEMETRY:
+		if ((value > 0xFFFF) || ((value != 0) && (value < MODTELEM_INTERVAL_MIN))) {
+			return false;
+		}
+		modtelem_start(value);
+		return true;
+
+	case MODCTL_PARAM_DEST_ADDR:
+		return modnet_dest_set(value, modnet_dest_udp());
+
+	case MODCTL_PARAM_DEST_PORT:
+		return (value <= 0xFFFF) && modnet_dest_set(modnet_dest_addr(), value);
+
+	default:
+		return false;
+	}
+}
+
+static bool modctl_port_cmd(uint8_t cmd)
+{
+	return (cmd >= MODCTL_CMD_TIMING_GET) && (cmd <= MODCTL_CMD_NMT_FILTER);
+}
+
+static void modctl_execute(const struct modctl_msg *req, struct modctl_msg *rep)
+{
+	struct modcan_filter filter;
+	struct modcan_range range;
+
+	if (modctl_port_cmd(req->cmd) && (req->port >= MODCAN_PORTS)) {
+		modctl_reply(rep, MODCTL_STATUS_INVALID);
+		return;
+	}
+
+	switch (req->cmd) {
+	case MODCTL_CMD_TIMING_GET:
+		modctl_timing_reply(rep, MODCTL_STATUS_OK);
+		break;
+
+	case MODCTL_CMD_TIMING_SET:
+		modctl_autobaud_pending[req->port] = false;
+		if (modcan_timing_set(req->port, req->arg[0], req->arg[1])) {
+			modctl_timing_reply(rep, MODCTL_STATUS_OK);
+		} else {
+			modctl_timing_reply(rep, MODCTL_STATUS_INVALID);
+		}
+		break;
+
+	case MODCTL_CMD_AUTOBAUD:
+		modctl_autobaud_pending[req->port] = true;
+		modctl_autobaud_id[req->port] = req->id;
+		modcan_autobaud_start(req->port);
+		modctl_timing_reply(rep, MODCTL_STATUS_PENDING);
+		break;
+
+	case MODCTL_CMD_SILENT_SET:
+		if (modcan_silent_set(req->port, req->arg[0] != 0)) {
+			rep->arg[0] = modcan_timing[req->port].silent;
+			modctl_reply(rep, MODCTL_STATUS_OK);
+		} else {
+			modctl_reply(rep, MODCTL_STATUS_FAILED);
+		}
+		break;
+
+	case MODCTL_CMD_NMT_FILTER:
+		modnmt_filter_set(req->port, req->arg[0] != 0);
+		rep->arg[0] = req->arg[0] != 0;
+		modctl_reply(rep, MODCTL_STATUS_OK);
+		break;
+
+	case MODCTL_CMD_PARAM_GET:
+		modctl_reply(rep, modctl_param_get(req->arg[0], &rep->arg[1]) ? MODCTL_STATUS_OK : MODCTL_STATUS_INVALID);
+		break;
+
+	case MODCTL_CMD_PARAM_SET: {
+		uint8_t status = modctl_param_set(req->arg[0], req->arg[1]) ? MODCTL_STATUS_OK : MODCTL_STATUS_INVALID;
+		modctl_param_get(req->arg[0], &rep->arg[1]);
+		modctl_reply(rep, status);
+		break;
+	}
+
+	case MODCTL_CMD_FILTER_GET:
+		if (modcan_filter_get(req->port, &filter)) {
+			rep->arg[0] = filter.mobid;
+			rep->arg[1] = filter.mask;
+			modctl_reply(rep, MODCTL_STATUS_OK);
+		} else {
+			modctl_reply(rep, MODCTL_STATUS_INVALID);
+		}
+		break;
+
+	case MODCTL_CMD_FILTER_SET:
+		modctl_reply(rep, modcan_filter_set(req->port, req->arg[0], req->arg[1]) ? MODCTL_STATUS_OK : MODCTL_STATUS_INVALID);
+		break;
+
+	case MODCTL_CMD_LANE_GET:
+		if (modcan_lane_get(req->port, &range)) {
+			rep->arg[0] = range.first;
+			rep->arg[1] = range.last;
+			modctl_reply(rep, MODCTL_STATUS_OK);
+		} else {
+			modctl_reply(rep, MODCTL_STATUS_INVALID);
+		}
+		break;
+
+	case MODCTL_CMD_LANE_SET:
+		modctl_reply(rep, modcan_lane_set(req->port, req->arg[0], req->arg[1]) ? MODCTL_STATUS_OK : MODCTL_STATUS_INVALID);
+		break;
+
+	case MODCTL_CMD_SAVE:
+		modctl_reply(rep, modcfg_save() ? MODCTL_STATUS_OK : MODCTL_STATUS_FAILED);
+		break;
+
+	case MODCTL_CMD_DEFAULTS:
+		modctl_reply(rep, modcfg_defaults() ? MODCTL_STATUS_OK : MODCTL_STATUS_FAILED);
+		break;
+
+	default:
+		modctl_reply(rep, MODCTL_STATUS_INVALID);
+		break;
+	}
+}
+
+void modctl_request(const struct modctl_msg *req)
+{
+	struct modctl_msg rep;
+	memcpy(&rep, req, sizeof(rep));
+	memset(rep.reserved, 0, sizeof(rep.reserved));
+
+	if (modctl_change(req->cmd)) {
+		struct modctl_done *d = modctl_done_find(req, true);
+		if (d != NULL) {
+			/* retry, the reply got lost */
+			modnet_send(MODNET_TYPE_CONTROL, MODNET_FLAG_REPLY, &d->rep, 1, sizeof(d->rep));
+			return;
+		}
+	}
+
+	modctl_execute(req, &rep);
+
+	if (modctl_change(req->cmd)) {
+		modctl_done_add(req, &rep);
+	}
+}
+
+/* completes the requests finished in the background */
+void modctl_step(void)
+{
+	for (uint8_t port = 0; port < MODCAN_PORTS; port++) {
+		if (!modctl_autobaud_pending[port] ||
+		    (modcan_timing[port].autobaud != MODCAN_AUTOBAUD_LOCKED)) {
+			continue;
+		}
+
+		struct modctl_msg rep;
+		memset(&rep, 0, sizeof(rep));
+		rep.id = modctl_autobaud_id[port];
+		rep.cmd = MODCTL_CMD_AUTOBAUD;
+		rep.port = port;
+
+		modctl_autobaud_pending[port] = false;
+		modctl_timing_reply(&rep, MODCTL_STATUS_OK);
+	}
+}
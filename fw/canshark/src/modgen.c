@@ -0,0 +1,212 @@
+#include <string.h>
+
+#include <libopencm3/stm32/can.h>
+
+#include "modcan.h"
+#include "modctl.h"
+#include "modgen.h"
+#include "modnet.h"
+#include "stick.h"
+
+/* frame length without stuff bits, including the interframe space */
+#define MODGEN_BITS_STD		47
+#define MODGEN_BITS_EXT		67
+#define MODGEN_BITS_MAX		(MODGEN_BITS_EXT + 64)
+
+struct modgen_port {
+	struct modgen_config cfg;
+	uint32_t prng;		// xorshift32 state
+	uint32_t seq;
+	uint32_t next;		// fixed ids, index of the set
+	int64_t budget;		// millibits allowed to send
+	uint64_t last;		// us, budget updated
+	uint16_t left;		// frames of the burst
+	bool starving;		// frame is waiting for the mailbox
+
+	/* next frame */
+	bool ready;
+	uint32_t mobid;
+	uint8_t data[8];
+	uint8_t dlc;
+	uint8_t bits;
+};
+
+static struct modgen_port modgen[MODCAN_PORTS];
+static uint32_t modgen_bits[MODCAN_PORTS];
+static uint64_t modgen_measured;
+
+struct modgen_stats modgen_stats[MODCAN_PORTS];
+
+static uint32_t modgen_rand(struct modgen_port *g)
+{
+	uint32_t x = g->prng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	g->prng = x;
+	return x;
+}
+
+static void modgen_frame(struct modgen_port *g)
+{
+	struct modgen_config *cfg = &g->cfg;
+	uint32_t k;
+
+	switch (cfg->ids & MODGEN_IDS_MODE) {
+	case MODGEN_IDS_RANDOM:
+		k = modgen_rand(g) % cfg->id_count;
+		break;
+
+	case MODGEN_IDS_SKEWED: {
+		/* lower of two uniform picks, probability falls linearly with the id */
+		uint32_t a = modgen_rand(g) % cfg->id_count;
+		uint32_t b = modgen_rand(g) % cfg->id_count;
+		k = (a < b) ? a : b;
+		break;
+	}
+
+	case MODGEN_IDS_FIXED:
+	default:
+		k = g->next;
+		g->next = (g->next + 1) % cfg->id_count;
+		break;
+	}
+
+	bool ext = (cfg->ids & MODGEN_IDS_EXT) != 0;
+	g->mobid = ext ? CAN_ID_EXTID(cfg->id_first + k) : CAN_ID_STDID(cfg->id_first + k);
+	g->dlc = cfg->dlc_min + modgen_rand(g) % (cfg->dlc_max - cfg->dlc_min + 1);
+	g->bits = (ext ? MODGEN_BITS_EXT : MODGEN_BITS_STD) + g->dlc * 8;
+
+	/* sequence tag, capture side checks loss and order by it */
+	for (uint8_t i = 0; i < g->dlc; i++) {
+		g->data[i] = (i < 4) ? (g->seq >> (i * 8)) & 0xFF : modgen_rand(g) & 0xFF;
+	}
+
+	g->seq++;
+	g->ready = true;
+}
+
+static bool modgen_valid(const struct modgen_config *cfg)
+{
+	uint32_t max = (cfg->ids & MODGEN_IDS_EXT) ? 0x20000000 : 0x800;
+
+	return (cfg->port < MODCAN_PORTS) &&
+	       ((cfg->ids & MODGEN_IDS_MODE) <= MODGEN_IDS_SKEWED) &&
+	       (cfg->dlc_min <= cfg->dlc_max) && (cfg->dlc_max <= 8) &&
+	       (cfg->load <= 1000) && (cfg->id_count > 0) &&
+	       (cfg->id_first < max) && (cfg->id_count <= max - cfg->id_first);
+}
+
+/* restarts the sequence and the prng, MODCTL_STATUS_* */
+uint8_t modgen_start(const struct modgen_config *cfg)
+{
+	if (!modgen_valid(cfg)) {
+		return MODCTL_STATUS_INVALID;
+	}
+
+	if ((cfg->load > 0) && !modcan_tx_enabled(cfg->port)) {
+		return MODCTL_STATUS_FAILED;
+	}
+
+	struct modgen_port *g = &modgen[cfg->port];
+	memset(g, 0, sizeof(*g));
+	memcpy(&g->cfg, cfg, sizeof(g->cfg));
+
+	g->prng = (cfg->seed != 0) ? cfg->seed : 1;
+	g->last = stick_get_us();
+
+	modgen_stats[cfg->port].sent = 0;
+	modgen_stats[cfg->port].starved = 0;
+	modgen_stats[cfg->port].target = cfg->load;
+	return MODCTL_STATUS_OK;
+}
+
+/* host config, answered with the status */
+void modgen_request(const struct modgen_config *cfg)
+{
+	struct modgen_config rep;
+	memcpy(&rep, cfg, sizeof(rep));
+	memset(rep.reserved, 0, sizeof(rep.reserved));
+
+	rep.status = modgen_start(cfg);
+
+	modnet_send(MODNET_TYPE_GEN, MODNET_FLAG_REPLY, &rep, 1, sizeof(rep));
+}
+
+/* bursts go back to back, the budget pays them off afterwards */
+static void modgen_port_step(uint8_t port, uint64_t now)
+{
+	struct modgen_port *g = &modgen[port];
+
+	if (g->cfg.load == 0) {
+		return;
+	}
+
+	if (!modcan_tx_enabled(port)) {
+		/* port went passive, the host restarts the generator */
+		g->cfg.load = 0;
+		modgen_stats[port].target = 0;
+		return;
+	}
+
+	g->budget += (int64_t)(now - g->last) * (modcan_timing[port].bitrate / 1000) * g->cfg.load / 1000;
+	g->last = now;
+
+	/* no catching up after the mailboxes were full */
+	if (g->budget > MODGEN_BITS_MAX * 1000) {
+		g->budget = MODGEN_BITS_MAX * 1000;
+	}
+
+	if (g->left == 0) {
+		if (g->budget < 0) {
+			return;
+		}
+		g->left = (g->cfg.burst > 1) ? g->cfg.burst : 1;
+	}
+
+	while (g->left > 0) {
+		if (!g->ready) {
+			modgen_frame(g);
+		}
+
+		if (!modcan_transmit(port, g->mobid, g->data, g->dlc)) {
+			if (!g->starving) {
+				modgen_stats[port].starved++;
+				g->starving = true;
+			}
+			return;
+		}
+
+		g->starving = false;
+		g->ready = false;
+		g->left--;
+		g->budget -= g->bits * 1000;
+
+		modgen_bits[port] += g->bits;
+		modgen_stats[port].sent++;
+	}
+}
+
+void modgen_step(void)
+{
+	uint64_t now = stick_get_us();
+
+	for (uint8_t port = 0; port < MODCAN_PORTS; port++) {
+		modgen_port_step(port, now);
+	}
+}
+
+/* achieved load since the last call */
+void modgen_measure(void)
+{
+	uint64_t now = stick_get_us();
+	uint64_t us = now - modgen_measured;
+	modgen_measured = now;
+
+	for (uint8_t port = 0; port < MODCAN_PORTS; port++) {
+		uint64_t capacity = us * modcan_timing[port].bitrate / 1000000;
+
+		modgen_stats[port].load = (capacity == 0) ? 0 : (uint64_t)modgen_bits[port] * 1000 / capacity;
+		modgen_bits[port] = 0;
+	}
+}
@@ -1,6 +1,7 @@
 #include <string.h>
 
 #include <libopencm3/ethernet/mac.h>
+#include <libopencm3/stm32/desig.h>
 
 #include "lwip/udp.h"
 #include "lwip/init.h"
@@ -8,9 +9,129 @@
 #include "netif/etharp.h"
 
 #include "eth_f417.h"
+#include "modbench.h"
+#include "modcan.h"
+#include "modctl.h"
+#include "modgen.h"
+#include "modsdo.h"
+#include "modsync.h"
 #include "modnet.h"
+#include "stick.h"
 
-const uint8_t mac[] = {0xE6, 0x00, 0x00, 0x00, 0x00, 0x01};
+/* locally administered, the rest is hashed from the mcu unique id */
+static uint8_t modnet_mac[6] = {0xE6, 0x00, 0x00, 0x00, 0x00, 0x01};
+static uint32_t modnet_uid[3];
+
+static struct netif *modnet_netif;
+static struct udp_pcb *modnet_udp;
+static struct ip_addr modnet_dest;
+static uint16_t modnet_dest_port = MODNET_PORT;
+
+/* replies go back to the last requester, broadcast until the first request */
+static struct ip_addr modnet_host;
+static uint16_t modnet_host_port = MODNET_PORT;
+static uint32_t modnet_seq;
+
+#define MODNET_FRAMES		(MODNET_PAYLOAD / sizeof(struct can_message))
+
+static struct can_message modnet_frames[MODNET_FRAMES];
+static bool modnet_was_online;
+static uint16_t modnet_backlog[MODCAN_LANES];
+
+/* bulk lane is sent when datagram is full or the oldest frame is this old */
+uint32_t modnet_batch_age = 2000;	// us
+
+uint32_t modnet_pbuf_failures;
+
+/* send latency of the lanes, log2 us buckets */
+uint32_t modnet_latency[MODCAN_LANES][MODNET_LATENCY_BUCKETS];
+
+/*
+ * Replies go to the sender of the last host request only. The broadcasts of the
+ * other boards come in as well, from the same port as the host uses, so the
+ * address is taken by the kind of the datagram.
+ */
+static void modnet_requester(const ip_addr_t *addr, uint16_t port)
+{
+	ip_addr_copy(modnet_host, *addr);
+	modnet_host_port = port;
+}
+
+static bool modnet_sync_master(const struct modsync_msg *sync)
+{
+	return (sync->kind == MODSYNC_SYNC) || (sync->kind == MODSYNC_FOLLOW_UP) ||
+	       (sync->kind == MODSYNC_DELAY_RESP);
+}
+
+/* host requests, the own broadcasts are not looped back */
+static void modnet_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, ip_addr_t *addr, uint16_t port)
+{
+	(void)arg;
+	(void)pcb;
+
+	struct modnet_header hdr;
+	struct modctl_msg req;
+	struct modsync_msg sync;
+	struct modgen_config gen;
+	struct modbench_config bench;
+
+	if ((pbuf_copy_partial(p, &hdr, sizeof(hdr), 0) != sizeof(hdr)) || (hdr.magic != MODNET_MAGIC)) {
+		pbuf_free(p);
+		return;
+	}
+
+	if ((hdr.type == MODNET_TYPE_CONTROL) && ((hdr.flags & MODNET_FLAG_REPLY) == 0)) {
+		modnet_requester(addr, port);
+		for (uint8_t i = 0; i < hdr.count; i++) {
+			uint16_t offset = sizeof(hdr) + i * sizeof(req);
+			if (pbuf_copy_partial(p, &req, sizeof(req), offset) != sizeof(req)) {
+				break;
+			}
+			modctl_request(&req);
+		}
+	} else if ((hdr.type == MODNET_TYPE_SYNC) &&
+		   (pbuf_copy_partial(p, &sync, sizeof(sync), sizeof(hdr)) == sizeof(sync))) {
+		if (modnet_sync_master(&sync)) {
+			modnet_requester(addr, port);
+		}
+		modsync_recv(&sync, ethf417_rx_time);
+	} else if ((hdr.type == MODNET_TYPE_SDO) && ((hdr.flags & MODNET_FLAG_REPLY) == 0)) {
+		modnet_requester(addr, port);
+		modsdo_request(p, sizeof(hdr), hdr.count);
+	} else if ((hdr.type == MODNET_TYPE_GEN) && ((hdr.flags & MODNET_FLAG_REPLY) == 0) &&
+		   (pbuf_copy_partial(p, &gen, sizeof(gen), sizeof(hdr)) == sizeof(gen))) {
+		modnet_requester(addr, port);
+		modgen_request(&gen);
+	} else if ((hdr.type == MODNET_TYPE_BENCH) && ((hdr.flags & MODNET_FLAG_REPLY) == 0) &&
+		   (pbuf_copy_partial(p, &bench, sizeof(bench), sizeof(hdr)) == sizeof(bench))) {
+		modnet_requester(addr, port);
+		modbench_request(&bench);
+	} else if ((hdr.type == MODNET_TYPE_ANNOUNCE) && ((hdr.flags & MODNET_FLAG_REPLY) == 0) && (hdr.count == 0)) {
+		/* announcements of the other boards carry the record */
+		modnet_requester(addr, port);
+		modnet_announce(MODNET_FLAG_REPLY);
+	}
+
+	pbuf_free(p);
+}
+
+/* fnv-1a, same board gets the same mac and address on every power up */
+static void modnet_identity(void)
+{
+	const uint8_t *uid = (const uint8_t *)modnet_uid;
+	uint64_t hash = 0xCBF29CE484222325ULL;
+
+	desig_get_unique_id(modnet_uid);
+
+	for (uint8_t i = 0; i < sizeof(modnet_uid); i++) {
+		hash ^= uid[i];
+		hash *= 0x100000001B3ULL;
+	}
+
+	for (uint8_t i = 1; i < sizeof(modnet_mac); i++) {
+		modnet_mac[i] = hash >> (i * 8);
+	}
+}
 
 void modnet_init(struct netif *netif)
 {
@@ -19,15 +140,212 @@ void modnet_init(struct netif *netif)
 	struct ip_addr gw;
 	struct ethf417_state ethstate;
 
-	IP4_ADDR(&ipaddr, 10, 0, 1, 56);
+	modnet_identity();
+
+	/* boards of the rack differ, the host finds them by the broadcasts anyway */
+	IP4_ADDR(&ipaddr, 10, 0, 1 + modnet_mac[4] % 254, 1 + modnet_mac[5] % 254);
 	IP4_ADDR(&netmask, 255, 255, 0, 0);
 	IP4_ADDR(&gw, 10, 0, 0, 1);
-	ETHADDR32_COPY(&ethstate.mac, mac);
+	ETHADDR32_COPY(&ethstate.mac, modnet_mac);
 
 	lwip_init();
 
 	netif_add(netif, &ipaddr, &netmask, &gw, &ethstate, &ethf417_init, &ethernet_input);
 	netif_set_default(netif);
 	netif_set_up(netif);
+
+	modnet_netif = netif;
+
+	modnet_udp = udp_new();
+	modnet_udp->so_options |= SOF_BROADCAST;
+
+	struct ip_addr ipa = { IPADDR_ANY };
+	udp_bind(modnet_udp, &ipa, MODNET_PORT);
+	udp_recv(modnet_udp, modnet_recv, NULL);
+
+	IP4_ADDR(&modnet_dest, 255, 255, 255, 255);  // the IP to send data to
+	IP4_ADDR(&modnet_host, 255, 255, 255, 255);
+}
+
+/* receiver is reachable, the link is negotiated */
+bool modnet_online(void)
+{
+	return (modnet_netif->flags & NETIF_FLAG_LINK_UP) != 0;
+}
+
+bool modnet_send(uint8_t type, uint8_t flags, const void *data, uint8_t count, uint16_t size)
+{
+	uint16_t len = sizeof(struct modnet_header) + size;
+
+	struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
+	if (p == NULL) {
+		/* packets are lost ! */
+		modnet_pbuf_failures++;
+		return false;
+	}
+
+	for (uint8_t port = 0; port < MODCAN_PORTS; port++) {
+		if (modcan_timing[port].silent) {
+			flags |= MODNET_FLAG_SILENT(port);
+		}
+	}
+
+	struct modnet_header *hdr = (struct modnet_header *)p->payload;
+	hdr->magic = MODNET_MAGIC;
+	hdr->type = type;
+	hdr->flags = flags;
+	hdr->count = count;
+	hdr->seq = modnet_seq++;
+
+	// allocated is always single pbuf in PBUF_RAM, read the buffer into pbuf
+	memcpy(hdr + 1, data, size);
+	if (flags & MODNET_FLAG_REPLY) {
+		udp_sendto(modnet_udp, p, &modnet_host, modnet_host_port);
+	} else {
+		udp_sendto(modnet_udp, p, &modnet_dest, modnet_dest_port);
+	}
+
+	pbuf_free(p);
+	return true;
 }
 
+/* stream and the board messages, ipv4 as a << 24 | b << 16 | c << 8 | d */
+bool modnet_dest_set(uint32_t addr, uint16_t port)
+{
+	if ((addr == 0) || (port == 0)) {
+		return false;
+	}
+
+	ip4_addr_set_u32(&modnet_dest, htonl(addr));
+	modnet_dest_port = port;
+	return true;
+}
+
+uint32_t modnet_dest_addr(void)
+{
+	return ntohl(ip4_addr_get_u32(&modnet_dest));
+}
+
+uint16_t modnet_dest_udp(void)
+{
+	return modnet_dest_port;
+}
+
+/* periodic, on the link up and when the host asks */
+void modnet_announce(uint8_t flags)
+{
+	struct modnet_announce ann;
+	memset(&ann, 0, sizeof(ann));
+
+	memcpy(ann.mac, modnet_mac, sizeof(ann.mac));
+	memcpy(ann.uid, modnet_uid, sizeof(ann.uid));
+	ann.ports = MODCAN_PORTS;
+	ann.protocol = MODNET_PROTOCOL;
+	ann.firmware = MODNET_FIRMWARE;
+	ann.caps = MODNET_CAP_SYNC | MODNET_CAP_SDO | MODNET_CAP_NMT | MODNET_CAP_GEN |
+		   MODNET_CAP_BENCH | MODNET_CAP_AUTOBAUD | MODNET_CAP_SILENT | MODNET_CAP_CONFIG;
+	ann.uptime = stick_get_us() / 1000000;
+
+	for (uint8_t port = 0; (port < MODCAN_PORTS) && (port < MODNET_ANNOUNCE_PORTS); port++) {
+		ann.bitrate[port] = modcan_timing[port].bitrate;
+		ann.sample[port] = modcan_timing[port].sample;
+		ann.silent[port] = modcan_timing[port].silent;
+		ann.autobaud[port] = modcan_timing[port].autobaud;
+	}
+
+	modnet_send(MODNET_TYPE_ANNOUNCE, flags, &ann, 1, sizeof(ann));
+}
+
+static void modnet_latency_add(uint8_t lane, uint64_t now, uint64_t ticks)
+{
+	uint32_t us = (now > ticks) ? now - ticks : 0;
+	uint8_t bucket = (us == 0) ? 0 : 32 - __builtin_clz(us);
+
+	if (bucket >= MODNET_LATENCY_BUCKETS) {
+		bucket = MODNET_LATENCY_BUCKETS - 1;
+	}
+
+	modnet_latency[lane][bucket]++;
+}
+
+static void modnet_stream_lane(uint8_t lane, uint8_t flags)
+{
+	uint16_t max = MODNET_FRAMES;
+
+	if (modnet_backlog[lane] > 0) {
+		flags |= MODNET_FLAG_BACKLOG;
+		if (max > modnet_backlog[lane]) {
+			max = modnet_backlog[lane];
+		}
+	}
+
+	uint16_t n = 0;
+	while ((n < max) && modcan_get(lane, &modnet_frames[n])) {
+		n++;
+	}
+
+	if (n == 0) {
+		return;
+	}
+
+	bool sent = modnet_send(MODNET_TYPE_FRAMES, flags, modnet_frames, n, n * sizeof(struct can_message));
+
+	for (uint16_t i = 0; i < n; i++) {
+		modbench_frame(&modnet_frames[i], sent);
+	}
+
+	if (modnet_backlog[lane] > 0) {
+		modnet_backlog[lane] -= n;
+		return;
+	}
+
+	uint64_t now = stick_get_us();
+	for (uint16_t i = 0; i < n; i++) {
+		modnet_latency_add(lane, now, modnet_frames[i].ticks);
+	}
+}
+
+/* frames are waiting to be sent */
+bool modnet_busy(void)
+{
+	return modnet_online() &&
+	       ((modcan_pending(MODCAN_LANE_PRIO) > 0) || (modcan_pending(MODCAN_LANE_BULK) > 0));
+}
+
+/* drain the capture lanes into datagrams */
+void modnet_stream(void)
+{
+	if (!modnet_online()) {
+		modnet_was_online = false;
+		return;
+	}
+
+	if (!modnet_was_online) {
+		/* host knows the board before its backlog comes */
+		modnet_was_online = true;
+		modnet_announce(0);
+
+		/* everything captured so far is flushed as backlog */
+		modnet_backlog[MODCAN_LANE_PRIO] = modcan_pending(MODCAN_LANE_PRIO);
+		modnet_backlog[MODCAN_LANE_BULK] = modcan_pending(MODCAN_LANE_BULK);
+	}
+
+	/* priority lane bypasses coalescing */
+	if (modcan_pending(MODCAN_LANE_PRIO) > 0) {
+		modnet_stream_lane(MODCAN_LANE_PRIO, MODNET_FLAG_PRIORITY);
+	}
+
+	uint16_t pending = modcan_pending(MODCAN_LANE_BULK);
+	if (pending == 0) {
+		return;
+	}
+
+	if ((pending < MODNET_FRAMES) && (modnet_backlog[MODCAN_LANE_BULK] == 0)) {
+		uint64_t oldest = modcan_oldest(MODCAN_LANE_BULK);
+		if (stick_get_us() < oldest + modnet_batch_age) {
+			return;
+		}
+	}
+
+	modnet_stream_lane(MODCAN_LANE_BULK, 0);
+}
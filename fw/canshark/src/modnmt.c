@@ -0,0 +1,183 @@
+#include <string.h>
+
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/stm32/can.h>
+
+#include "modcan.h"
+#include "modnet.h"
+#include "modnmt.h"
+#include "stick.h"
+
+#include "can_canopen.h"
+
+struct modnmt_node {
+	uint64_t last;		// us, by isr
+	uint32_t period;	// us, by isr
+	uint8_t state;		// by isr
+	uint8_t reported;	// last told to the host
+	bool lost;
+};
+
+static struct modnmt_node modnmt_nodes[MODCAN_PORTS][MODNMT_NODES];
+
+/* heartbeats are not captured, host sees only the changes */
+static bool modnmt_filter[MODCAN_PORTS];
+
+#define MODNMT_EVENTS		(MODNET_PAYLOAD / sizeof(struct modnmt_event))
+
+static struct modnmt_event modnmt_events[MODNMT_EVENTS];
+static uint8_t modnmt_count;
+
+void modnmt_init(void)
+{
+	for (uint8_t port = 0; port < MODCAN_PORTS; port++) {
+		for (uint8_t i = 0; i < MODNMT_NODES; i++) {
+			modnmt_nodes[port][i].reported = MODNMT_STATE_UNKNOWN;
+		}
+	}
+}
+
+/* rx isr, true when the frame is kept out of the capture */
+bool modnmt_rx(uint8_t port, uint32_t mobid, const uint8_t *data, uint8_t len)
+{
+	if (len < 1) {
+		return false;
+	}
+
+	uint8_t id = (mobid - COB_GUARD(0)) / (COB_GUARD(1) - COB_GUARD(0));
+	struct modnmt_node *n = &modnmt_nodes[port][id - 1];
+	uint8_t state = data[0] & CANOPEN_NMT_STATE;
+	uint64_t now = stick_get_us();
+
+	if (state == CANOPEN_NMT_STATE_INITIALISING) {
+		/* boot up, the period starts again */
+		n->period = 0;
+	} else if ((n->last != 0) && !n->lost && (n->state != CANOPEN_NMT_STATE_INITIALISING)) {
+		uint32_t interval = now - n->last;
+		if (n->period == 0) {
+			n->period = interval;
+		} else {
+			n->period += ((int32_t)(interval - n->period)) / MODNMT_GAIN;
+		}
+	}
+
+	n->last = now;
+	n->state = state;
+
+	return modnmt_filter[port];
+}
+
+bool modnmt_filter_set(uint8_t port, bool filter)
+{
+	if (port >= MODCAN_PORTS) {
+		return false;
+	}
+
+	modnmt_filter[port] = filter;
+	return true;
+}
+
+bool modnmt_filter_get(uint8_t port)
+{
+	return (port < MODCAN_PORTS) && modnmt_filter[port];
+}
+
+static void modnmt_flush(void)
+{
+	if (modnmt_count == 0) {
+		return;
+	}
+
+	modnet_send(MODNET_TYPE_NMT, 0, modnmt_events, modnmt_count, modnmt_count * sizeof(struct modnmt_event));
+	modnmt_count = 0;
+}
+
+static void modnmt_event(uint8_t port, uint8_t id, uint8_t kind, const struct modnmt_node *n, uint64_t now)
+{
+	if (modnmt_count == MODNMT_EVENTS) {
+		modnmt_flush();
+	}
+
+	struct modnmt_event *e = &modnmt_events[modnmt_count++];
+	memset(e, 0, sizeof(*e));
+
+	e->port = port;
+	e->node = id;
+	e->kind = kind;
+	e->state = n->state;
+	e->prev = n->reported;
+	e->ticks = n->last;
+	e->period = n->period;
+	e->silence = now - n->last;
+}
+
+/* timeouts are detected here, the same way for all nodes */
+void modnmt_step(void)
+{
+	uint64_t now = stick_get_us();
+
+	for (uint8_t port = 0; port < MODCAN_PORTS; port++) {
+		for (uint8_t i = 0; i < MODNMT_NODES; i++) {
+			struct modnmt_node *n = &modnmt_nodes[port][i];
+			struct modnmt_node copy;
+
+			{
+				CM_ATOMIC_CONTEXT();
+				memcpy(&copy, n, sizeof(copy));
+			}
+
+			if (copy.last == 0) {
+				continue;
+			}
+
+			uint64_t silence = (now > copy.last) ? now - copy.last : 0;
+			bool missed = (copy.period != 0) && (silence > copy.period + copy.period / 2 + MODNMT_SLACK);
+
+			if (copy.lost && !missed) {
+				modnmt_event(port, i + 1, MODNMT_EVENT_ALIVE, &copy, now);
+				n->lost = false;
+				n->reported = copy.state;
+			} else if (!copy.lost && missed) {
+				modnmt_event(port, i + 1, MODNMT_EVENT_TIMEOUT, &copy, now);
+				n->lost = true;
+			} else if (!copy.lost && (copy.reported != copy.state)) {
+				modnmt_event(port, i + 1, (copy.reported == MODNMT_STATE_UNKNOWN) ? MODNMT_EVENT_ALIVE : MODNMT_EVENT_STATE, &copy, now);
+				n->reported = copy.state;
+			}
+		}
+	}
+
+	modnmt_flush();
+}
+
+/* compact node table of both ports */
+void modnmt_digest(void)
+{
+	struct modnmt_digest digest[MODCAN_PORTS];
+	memset(digest, 0, sizeof(digest));
+
+	for (uint8_t port = 0; port < MODCAN_PORTS; port++) {
+		struct modnmt_digest *d = &digest[port];
+		d->port = port;
+
+		for (uint8_t i = 0; i < MODNMT_NODES; i++) {
+			struct modnmt_node *n = &modnmt_nodes[port][i];
+			if (n->last == 0) {
+				continue;
+			}
+
+			uint8_t id = i + 1;
+			d->seen[id / 32] |= 1UL << (id % 32);
+			d->state[id] = n->reported;
+
+			if (n->lost) {
+				d->state[id] |= MODNMT_STATE_LOST;
+				d->lost++;
+			} else {
+				d->alive++;
+			}
+		}
+	}
+
+	modnet_send(MODNET_TYPE_NODES, 0, digest, MODCAN_PORTS, sizeof(digest));
+}
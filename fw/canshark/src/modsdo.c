@@ -0,0 +1,508 @@
+#include <string.h>
+
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/stm32/can.h>
+
+#include "lwip/pbuf.h"
+
+#include "modcan.h"
+#include "modnet.h"
+#include "modsdo.h"
+#include "stick.h"
+
+#include "can_canopen.h"
+
+enum {
+	MODSDO_IDLE,
+	MODSDO_UPLOAD,		// initiate sent
+	MODSDO_SEGMENT,		// segment requested
+	MODSDO_BLOCK_INIT,	// block initiate sent
+	MODSDO_BLOCK_DATA,	// segments of the block coming
+	MODSDO_BLOCK_END,	// waiting for the end of the transfer
+	MODSDO_RETRY,		// abort waiting for the mailbox, initiate goes after it
+};
+
+enum {
+	MODSDO_ENTRY_PENDING,
+	MODSDO_ENTRY_RUNNING,
+	MODSDO_ENTRY_DONE,
+};
+
+/* one transfer at a time per node, the COB IDs are shared */
+struct modsdo_session {
+	uint8_t state;		// MODSDO_*
+	uint8_t node;
+	uint8_t entry;
+	uint8_t tries;
+	bool block;		// block upload allowed for the entry
+	bool crc;		// block: server computes the crc
+	uint8_t toggle;		// segmented: expected toggle
+	uint8_t seq;		// block: last segment received in order
+	bool last;		// block: final segment received
+	bool held;		// block: segment kept until its padding is known
+	uint8_t hold[7];
+	bool tx;		// request waiting for the free mailbox
+	uint8_t req[8];
+	uint16_t crcval;
+	uint32_t size;
+	uint64_t until;		// stick
+	uint8_t value[MODSDO_VALUE_MAX];
+};
+
+struct modsdo_frame {
+	uint8_t node;
+	uint8_t data[8];
+};
+
+static volatile bool modsdo_active;
+static struct modsdo_job modsdo_job;
+static struct modsdo_entry modsdo_entries[MODSDO_ENTRIES];
+static uint8_t modsdo_state[MODSDO_ENTRIES];
+static uint8_t modsdo_count;
+static struct modsdo_session modsdo_sessions[MODSDO_SESSIONS];
+
+/* responses caught by the rx isr */
+static struct modsdo_frame modsdo_queue[MODSDO_QUEUE];
+static uint16_t modsdo_qr;
+static uint16_t modsdo_qw;
+
+/* results are packed until the datagram is full */
+static uint8_t modsdo_out[MODNET_PAYLOAD];
+static uint16_t modsdo_out_len;
+static uint8_t modsdo_out_count;
+
+/* CRC-16-CCITT of the block transfer */
+static uint16_t modsdo_crc(uint16_t crc, const uint8_t *data, uint8_t len)
+{
+	while (len--) {
+		crc ^= (uint16_t)*data++ << 8;
+		for (uint8_t i = 0; i < 8; i++) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+static void modsdo_flush(uint8_t flags)
+{
+	modnet_send(MODNET_TYPE_SDO, MODNET_FLAG_REPLY | flags, modsdo_out, modsdo_out_count, modsdo_out_len);
+	modsdo_out_len = 0;
+	modsdo_out_count = 0;
+}
+
+static void modsdo_result(const struct modsdo_entry *e, uint32_t size, uint32_t abort, const uint8_t *value)
+{
+	struct modsdo_result res;
+	res.id = modsdo_job.id;
+	res.index = e->index;
+	res.subindex = e->subindex;
+	res.node = e->node;
+	res.size = size;
+	res.abort = abort;
+	res.length = (abort != 0) ? 0 : (size > MODSDO_VALUE_MAX) ? MODSDO_VALUE_MAX : size;
+
+	if (modsdo_out_len + sizeof(res) + res.length > sizeof(modsdo_out)) {
+		modsdo_flush(0);
+	}
+
+	memcpy(&modsdo_out[modsdo_out_len], &res, sizeof(res));
+	if (res.length) {
+		memcpy(&modsdo_out[modsdo_out_len + sizeof(res)], value, res.length);
+	}
+	modsdo_out_len += sizeof(res) + res.length;
+	modsdo_out_count++;
+}
+
+/* whole job not accepted, only the end record */
+static void modsdo_refuse(uint16_t id)
+{
+	struct modsdo_result res;
+	memset(&res, 0, sizeof(res));
+	res.id = id;
+	res.abort = CANOPEN_SDOABORT_GENERAL_ERROR;
+
+	modnet_send(MODNET_TYPE_SDO, MODNET_FLAG_REPLY | MODNET_FLAG_LAST, &res, 1, sizeof(res));
+}
+
+static void modsdo_send(struct modsdo_session *s, const uint8_t *req)
+{
+	memcpy(s->req, req, sizeof(s->req));
+	s->tx = !modcan_transmit(modsdo_job.port, COB_RSDO(s->node), s->req, 8);
+	s->until = stick_now() + modsdo_job.timeout * STICK_HZ / 1000;
+}
+
+static void modsdo_abort(struct modsdo_session *s, uint32_t abort)
+{
+	const struct modsdo_entry *e = &modsdo_entries[s->entry];
+	uint8_t req[8] = { 0x80, e->index & 0xFF, e->index >> 8, e->subindex,
+			   abort & 0xFF, (abort >> 8) & 0xFF, (abort >> 16) & 0xFF, abort >> 24 };
+
+	modsdo_send(s, req);
+}
+
+static void modsdo_finish(struct modsdo_session *s, uint32_t abort)
+{
+	modsdo_result(&modsdo_entries[s->entry], s->size, abort, s->value);
+	modsdo_state[s->entry] = MODSDO_ENTRY_DONE;
+	s->state = MODSDO_IDLE;
+}
+
+static void modsdo_store(struct modsdo_session *s, const uint8_t *data, uint8_t len)
+{
+	for (uint8_t i = 0; i < len; i++) {
+		if (s->size + i < MODSDO_VALUE_MAX) {
+			s->value[s->size + i] = data[i];
+		}
+	}
+
+	s->crcval = modsdo_crc(s->crcval, data, len);
+	s->size += len;
+}
+
+static void modsdo_start(struct modsdo_session *s)
+{
+	const struct modsdo_entry *e = &modsdo_entries[s->entry];
+	uint8_t req[8] = { 0x40, e->index & 0xFF, e->index >> 8, e->subindex, 0, 0, 0, 0 };
+
+	s->size = 0;
+	s->crcval = 0;
+
+	if (s->block) {
+		req[0] = 0xA4;			// block upload, crc supported
+		req[4] = MODSDO_BLKSIZE;
+		req[5] = 0;			// no protocol switch
+		s->state = MODSDO_BLOCK_INIT;
+	} else {
+		s->state = MODSDO_UPLOAD;
+	}
+
+	modsdo_send(s, req);
+}
+
+/* first pending entry of the node nobody talks to */
+static bool modsdo_next(struct modsdo_session *s)
+{
+	for (uint16_t i = 0; i < modsdo_count; i++) {
+		if (modsdo_state[i] != MODSDO_ENTRY_PENDING) {
+			continue;
+		}
+
+		uint8_t node = modsdo_entries[i].node;
+		bool busy = false;
+		for (uint8_t j = 0; j < modsdo_job.sessions; j++) {
+			if ((modsdo_sessions[j].state != MODSDO_IDLE) && (modsdo_sessions[j].node == node)) {
+				busy = true;
+				break;
+			}
+		}
+
+		if (busy) {
+			continue;
+		}
+
+		modsdo_state[i] = MODSDO_ENTRY_RUNNING;
+		s->entry = i;
+		s->node = node;
+		s->tries = 0;
+		s->block = (modsdo_job.flags & MODSDO_FLAG_BLOCK) != 0;
+		modsdo_start(s);
+		return true;
+	}
+
+	return false;
+}
+
+static bool modsdo_mux(const struct modsdo_session *s, const uint8_t *d)
+{
+	const struct modsdo_entry *e = &modsdo_entries[s->entry];
+	return (d[1] == (e->index & 0xFF)) && (d[2] == (e->index >> 8)) && (d[3] == e->subindex);
+}
+
+static void modsdo_block_data(struct modsdo_session *s, const uint8_t *d)
+{
+	uint8_t seqno = d[0] & 0x7F;
+	bool end = (d[0] & 0x80) != 0;
+
+	if (!s->last && (seqno == s->seq + 1)) {
+		if (s->held) {
+			modsdo_store(s, s->hold, 7);
+		}
+		memcpy(s->hold, &d[1], 7);
+		s->held = true;
+		s->seq = seqno;
+		s->last = end;
+	}
+
+	s->until = stick_now() + modsdo_job.timeout * STICK_HZ / 1000;
+
+	if (!end && (seqno < MODSDO_BLKSIZE)) {
+		return;
+	}
+
+	/* end of the block, server repeats everything after the acknowledged one */
+	uint8_t req[8] = { 0xA2, s->seq, MODSDO_BLKSIZE, 0, 0, 0, 0, 0 };
+	s->state = s->last ? MODSDO_BLOCK_END : MODSDO_BLOCK_DATA;
+	s->seq = 0;
+	modsdo_send(s, req);
+}
+
+static void modsdo_response(struct modsdo_session *s, const uint8_t *d)
+{
+	uint8_t cmd = d[0];
+
+	if (cmd == 0x80) {
+		uint32_t abort = d[4] | (d[5] << 8) | (d[6] << 16) | ((uint32_t)d[7] << 24);
+
+		/* server without block transfer, read the entry again segmented */
+		if ((s->state == MODSDO_BLOCK_INIT) && (abort == CANOPEN_SDOABORT_UNKNOWN_SPECIFIER)) {
+			s->block = false;
+			modsdo_start(s);
+			return;
+		}
+
+		modsdo_finish(s, abort);
+		return;
+	}
+
+	switch (s->state) {
+	case MODSDO_UPLOAD:
+		if (((cmd & 0xE0) != 0x40) || !modsdo_mux(s, d)) {
+			return;
+		}
+
+		if (cmd & 0x02) {
+			/* expedited, size indicated or all four bytes */
+			modsdo_store(s, &d[4], (cmd & 0x01) ? 4 - ((cmd >> 2) & 0x03) : 4);
+			modsdo_finish(s, 0);
+			return;
+		}
+
+		s->toggle = 0;
+		s->state = MODSDO_SEGMENT;
+		modsdo_send(s, (const uint8_t[8]){ 0x60 });
+		break;
+
+	case MODSDO_SEGMENT:
+		if ((cmd & 0xE0) != 0x00) {
+			return;
+		}
+
+		if (((cmd >> 4) & 0x01) != s->toggle) {
+			modsdo_abort(s, CANOPEN_SDOABORT_TOGGLE_BIT_NOT_ALTERNATED);
+			modsdo_finish(s, CANOPEN_SDOABORT_TOGGLE_BIT_NOT_ALTERNATED);
+			return;
+		}
+
+		modsdo_store(s, &d[1], 7 - ((cmd >> 1) & 0x07));
+
+		if (cmd & 0x01) {
+			modsdo_finish(s, 0);
+			return;
+		}
+
+		s->toggle ^= 1;
+		modsdo_send(s, (const uint8_t[8]){ 0x60 | (s->toggle << 4) });
+		break;
+
+	case MODSDO_BLOCK_INIT:
+		/* scs and ss only, the size indicated bit is up to the server */
+		if (((cmd & 0xE1) != 0xC0) || !modsdo_mux(s, d)) {
+			return;
+		}
+
+		s->crc = (cmd & 0x04) != 0;
+		s->seq = 0;
+		s->last = false;
+		s->held = false;
+		s->state = MODSDO_BLOCK_DATA;
+		modsdo_send(s, (const uint8_t[8]){ 0xA3 });
+		break;
+
+	case MODSDO_BLOCK_DATA:
+		modsdo_block_data(s, d);
+		break;
+
+	case MODSDO_BLOCK_END:
+		if ((cmd & 0xE3) != 0xC1) {
+			return;
+		}
+
+		if (s->held) {
+			modsdo_store(s, s->hold, 7 - ((cmd >> 2) & 0x07));
+		}
+
+		if (s->crc && (s->crcval != (d[1] | (d[2] << 8)))) {
+			modsdo_abort(s, CANOPEN_SDOABORT_CRC_ERROR);
+			modsdo_finish(s, CANOPEN_SDOABORT_CRC_ERROR);
+			return;
+		}
+
+		modsdo_send(s, (const uint8_t[8]){ 0xA1 });
+		modsdo_finish(s, 0);
+		break;
+
+	case MODSDO_IDLE:
+	default:
+		break;
+	}
+}
+
+static void modsdo_timeout(struct modsdo_session *s)
+{
+	if (s->state == MODSDO_RETRY) {
+		/* abort not sent for the whole timeout, the mailboxes stay full */
+		modsdo_finish(s, CANOPEN_SDOABORT_PROTOCOL_TIMEOUT);
+		return;
+	}
+
+	modsdo_abort(s, CANOPEN_SDOABORT_PROTOCOL_TIMEOUT);
+
+	if (s->tries < modsdo_job.retries) {
+		/* silent on block initiate, node may just not know the block transfer */
+		s->tries++;
+		s->block = s->block && (s->state != MODSDO_BLOCK_INIT);
+
+		/* the request buffer holds the abort until it is sent */
+		if (s->tx) {
+			s->state = MODSDO_RETRY;
+		} else {
+			modsdo_start(s);
+		}
+		return;
+	}
+
+	modsdo_finish(s, CANOPEN_SDOABORT_PROTOCOL_TIMEOUT);
+}
+
+static bool modsdo_pop(struct modsdo_frame *f)
+{
+	CM_ATOMIC_CONTEXT();
+
+	if (modsdo_qr == modsdo_qw) {
+		return false;
+	}
+
+	memcpy(f, &modsdo_queue[modsdo_qr], sizeof(*f));
+	modsdo_qr = (modsdo_qr + 1) & (MODSDO_QUEUE - 1);
+	return true;
+}
+
+/* host job, refused while another one runs */
+void modsdo_request(struct pbuf *p, uint16_t offset, uint8_t count)
+{
+	struct modsdo_job job;
+
+	if (pbuf_copy_partial(p, &job, sizeof(job), offset) != sizeof(job)) {
+		return;
+	}
+
+	uint16_t len = count * sizeof(struct modsdo_entry);
+	if (modsdo_active || (count == 0) || (job.port >= MODCAN_PORTS) || !modcan_tx_enabled(job.port) ||
+	    (pbuf_copy_partial(p, modsdo_entries, len, offset + sizeof(job)) != len)) {
+		modsdo_refuse(job.id);
+		return;
+	}
+
+	for (uint8_t i = 0; i < count; i++) {
+		if ((modsdo_entries[i].node == 0) || (modsdo_entries[i].node > 127)) {
+			modsdo_refuse(job.id);
+			return;
+		}
+		modsdo_state[i] = MODSDO_ENTRY_PENDING;
+	}
+
+	if (job.timeout == 0) {
+		job.timeout = MODSDO_TIMEOUT;
+	}
+	if ((job.sessions == 0) || (job.sessions > MODSDO_SESSIONS)) {
+		job.sessions = MODSDO_SESSIONS;
+	}
+
+	memcpy(&modsdo_job, &job, sizeof(job));
+	memset(modsdo_sessions, 0, sizeof(modsdo_sessions));
+	modsdo_count = count;
+	modsdo_out_len = 0;
+	modsdo_out_count = 0;
+	modsdo_qr = modsdo_qw = 0;
+	modsdo_active = true;
+}
+
+/* rx isr, responses of the job port */
+void modsdo_rx(uint8_t port, const struct can_message *msg)
+{
+	if (!modsdo_active || (port != modsdo_job.port) || (msg->length != 8) ||
+	    (msg->mobid <= COB_TSDO(0)) || (msg->mobid > COB_TSDO(127))) {
+		return;
+	}
+
+	CM_ATOMIC_CONTEXT();
+
+	uint16_t w = (modsdo_qw + 1) & (MODSDO_QUEUE - 1);
+	if (w == modsdo_qr) {
+		/* lost, the transfer times out or the block is repeated */
+		return;
+	}
+
+	modsdo_queue[modsdo_qw].node = (msg->mobid - COB_TSDO(0)) / (COB_TSDO(1) - COB_TSDO(0));
+	memcpy(modsdo_queue[modsdo_qw].data, msg->data, 8);
+	modsdo_qw = w;
+}
+
+void modsdo_step(void)
+{
+	if (!modsdo_active) {
+		return;
+	}
+
+	struct modsdo_frame f;
+	while (modsdo_pop(&f)) {
+		for (uint8_t i = 0; i < modsdo_job.sessions; i++) {
+			struct modsdo_session *s = &modsdo_sessions[i];
+			if ((s->state != MODSDO_IDLE) && (s->node == f.node)) {
+				modsdo_response(s, f.data);
+				break;
+			}
+		}
+	}
+
+	bool running = false;
+	uint64_t now = stick_now();
+
+	for (uint8_t i = 0; i < modsdo_job.sessions; i++) {
+		struct modsdo_session *s = &modsdo_sessions[i];
+
+		/* mailboxes were full */
+		if (s->tx) {
+			s->tx = !modcan_transmit(modsdo_job.port, COB_RSDO(s->node), s->req, 8);
+		}
+
+		if (s->state == MODSDO_IDLE) {
+			running = running || s->tx || modsdo_next(s);
+			continue;
+		}
+
+		if ((s->state == MODSDO_RETRY) && !s->tx) {
+			modsdo_start(s);
+		}
+
+		if (now >= s->until) {
+			modsdo_timeout(s);
+		}
+
+		running = running || (s->state != MODSDO_IDLE) || s->tx;
+	}
+
+	if (!running) {
+		for (uint16_t i = 0; i < modsdo_count; i++) {
+			if (modsdo_state[i] != MODSDO_ENTRY_DONE) {
+				return;
+			}
+		}
+
+		struct modsdo_entry end = { 0, 0, 0 };
+		modsdo_result(&end, 0, 0, NULL);
+
+		modsdo_active = false;
+		modsdo_flush(MODNET_FLAG_LAST);
+	}
+}
@@ -0,0 +1,146 @@
+#include <string.h>
+
+#include "modnet.h"
+#include "modsync.h"
+#include "stick.h"
+
+enum {
+	MODSYNC_IDLE,
+	MODSYNC_WAIT_FOLLOW_UP,
+	MODSYNC_WAIT_DELAY_RESP,
+};
+
+static uint8_t modsync_state;
+static uint16_t modsync_seq;
+static uint64_t modsync_t1;	// master, sync sent
+static uint64_t modsync_t2;	// board, sync received
+static uint64_t modsync_t3;	// board, delay request sent
+
+static uint32_t modsync_exchanges;
+static uint64_t modsync_ref;	// board ticks of the last accepted exchange
+static int64_t modsync_offset;	// at ref
+static int32_t modsync_drift;	// ppb
+static uint32_t modsync_delay;
+static uint32_t modsync_delay_best;
+
+static void modsync_send(struct modsync_msg *msg)
+{
+	modnet_send(MODNET_TYPE_SYNC, 0, msg, 1, sizeof(*msg));
+}
+
+static void modsync_status(void)
+{
+	struct modsync_msg msg;
+	memset(&msg, 0, sizeof(msg));
+
+	msg.kind = MODSYNC_STATUS;
+	msg.seq = modsync_seq;
+	msg.drift = modsync_drift;
+	msg.time = modsync_ref;
+	msg.offset = modsync_offset;
+	msg.delay = modsync_delay;
+	msg.exchanges = modsync_exchanges;
+
+	modsync_send(&msg);
+}
+
+static void modsync_update(uint64_t t4)
+{
+	int64_t ms = (int64_t)(modsync_t2 - modsync_t1);	// offset + delay
+	int64_t sm = (int64_t)(t4 - modsync_t3);		// delay - offset
+
+	int64_t offset = (ms - sm) / 2;
+	int64_t delay = (ms + sm) / 2;
+
+	if (delay < 0) {
+		return;
+	}
+
+	/* best delay slowly ages, so a changed path is accepted later */
+	if ((modsync_exchanges == 0) || (delay < modsync_delay_best)) {
+		modsync_delay_best = delay;
+	} else {
+		modsync_delay_best++;
+	}
+
+	if (delay > modsync_delay_best * 2 + MODSYNC_DELAY_SLACK) {
+		return;
+	}
+
+	if (modsync_exchanges > 0) {
+		int64_t dt = (int64_t)(modsync_t2 - modsync_ref);
+		if (dt <= 0) {
+			return;
+		}
+
+		int64_t pred = modsync_offset + (int64_t)modsync_drift * dt / 1000000000;
+		if ((offset - pred > MODSYNC_STEP) || (pred - offset > MODSYNC_STEP)) {
+			/* master clock stepped, the offset starts over, the drift of the crystal holds */
+		} else {
+			int64_t drift = (offset - modsync_offset) * 1000000000 / dt;
+			if (drift > MODSYNC_DRIFT_MAX) {
+				drift = MODSYNC_DRIFT_MAX;
+			} else if (drift < -MODSYNC_DRIFT_MAX) {
+				drift = -MODSYNC_DRIFT_MAX;
+			}
+
+			if (modsync_exchanges == 1) {
+				modsync_drift = drift;
+			} else {
+				modsync_drift += (drift - modsync_drift) / MODSYNC_GAIN;
+			}
+
+			offset = pred + (offset - pred) / 2;
+		}
+	}
+
+	modsync_ref = modsync_t2;
+	modsync_offset = offset;
+	modsync_delay = delay;
+	modsync_exchanges++;
+
+	modsync_status();
+}
+
+/* rx is the board time the datagram was taken from the MAC */
+void modsync_recv(const struct modsync_msg *msg, uint64_t rx)
+{
+	struct modsync_msg req;
+
+	switch (msg->kind) {
+	case MODSYNC_SYNC:
+		modsync_seq = msg->seq;
+		modsync_t2 = rx;
+		modsync_state = MODSYNC_WAIT_FOLLOW_UP;
+		break;
+
+	case MODSYNC_FOLLOW_UP:
+		if ((modsync_state != MODSYNC_WAIT_FOLLOW_UP) || (msg->seq != modsync_seq)) {
+			break;
+		}
+
+		modsync_t1 = msg->time;
+
+		memset(&req, 0, sizeof(req));
+		req.kind = MODSYNC_DELAY_REQ;
+		req.seq = modsync_seq;
+
+		modsync_state = MODSYNC_WAIT_DELAY_RESP;
+		modsync_t3 = stick_get_us();
+		modsync_send(&req);
+		break;
+
+	case MODSYNC_DELAY_RESP:
+		if ((modsync_state != MODSYNC_WAIT_DELAY_RESP) || (msg->seq != modsync_seq)) {
+			break;
+		}
+
+		modsync_state = MODSYNC_IDLE;
+		modsync_update(msg->time);
+		break;
+
+	default:
+		/* requests and status of the other boards */
+		break;
+	}
+}
@@ -0,0 +1,107 @@
+#include <string.h>
+
+#include "lwip/netif.h"
+#include "lwip/stats.h"
+
+#include "modcan.h"
+#include "modgen.h"
+#include "modnet.h"
+#include "modtelem.h"
+#include "stick.h"
+
+/* linker script symbols */
+extern uint32_t end;		// end of bss, bottom of the stack area
+extern uint32_t _stack;		// top of ram, initial stack pointer
+
+#define MODTELEM_PAINT		0xC5C5C5C5
+#define MODTELEM_GUARD		64	// words below the stack pointer left untouched
+
+static uint32_t *modtelem_mark;		// lowest stack word seen used
+static uint32_t modtelem_loops;
+static uint32_t modtelem_loops_last;
+static struct modtelem_record modtelem_rec;
+static struct stick_task modtelem_task;
+
+uint16_t modtelem_interval;	// ms, 0 off
+
+/* paint the unused stack, must be called early from main */
+void modtelem_init(void)
+{
+	uint32_t *sp;
+	__asm__ volatile ("mov %0, sp" : "=r" (sp));
+
+	for (uint32_t *p = &end; p < sp - MODTELEM_GUARD; p++) {
+		*p = MODTELEM_PAINT;
+	}
+
+	modtelem_mark = sp - MODTELEM_GUARD;
+}
+
+/* called once per main loop iteration */
+void modtelem_loop(void)
+{
+	modtelem_loops++;
+}
+
+/* the watermark only moves down, scan just the words below the last one */
+static uint32_t modtelem_stack_max(void)
+{
+	while ((modtelem_mark > &end) && (modtelem_mark[-1] != MODTELEM_PAINT)) {
+		modtelem_mark--;
+	}
+
+	return (uint32_t)(&_stack - modtelem_mark) * sizeof(uint32_t);
+}
+
+void modtelem_send(void)
+{
+	struct modtelem_record *rec = &modtelem_rec;
+
+	rec->uptime = stick_now() * 1000 / STICK_HZ;
+	rec->loops = modtelem_loops - modtelem_loops_last;
+	modtelem_loops_last = modtelem_loops;
+
+	rec->pbuf_failures = modnet_pbuf_failures;
+	rec->heap_used = lwip_stats.mem.used;
+	rec->heap_max = lwip_stats.mem.max;
+	rec->heap_size = lwip_stats.mem.avail;
+	rec->stack_max = modtelem_stack_max();
+	rec->stack_size = (uint32_t)(&_stack - &end) * sizeof(uint32_t);
+
+	for (uint8_t i = 0; i < MODCAN_LANES; i++) {
+		rec->ring_used[i] = modcan_pending(i);
+		rec->ring_max[i] = modcan_ring_max(i);
+		rec->ring_size[i] = modcan_ring_size(i);
+	}
+
+	/* counters are updated from isr, torn values are tolerable here */
+	memcpy(rec->port, modcan_stats, sizeof(rec->port));
+	memcpy(rec->timing, modcan_timing, sizeof(rec->timing));
+	memcpy(rec->latency, modnet_latency, sizeof(rec->latency));
+
+	modgen_measure();
+	memcpy(rec->gen, modgen_stats, sizeof(rec->gen));
+
+	modnet_send(MODNET_TYPE_TELEMETRY, 0, rec, 1, sizeof(*rec));
+}
+
+static void modtelem_run(void *arg)
+{
+	(void)arg;
+	if (modnet_online()) {
+		modtelem_send();
+	}
+}
+
+/* period of the record, 0 stops it */
+void modtelem_start(uint16_t ms)
+{
+	modtelem_interval = ms;
+
+	if (ms == 0) {
+		stick_task_cancel(&modtelem_task);
+		return;
+	}
+
+	stick_task_add(&modtelem_task, ms * STICK_HZ / 1000, ms * STICK_HZ / 1000, modtelem_run, NULL);
+}
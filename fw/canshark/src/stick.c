@@ -12,10 +12,15 @@
 
 static uint64_t ticks;
 
+/* timer wheel, one slot per tick, tasks due in later rounds stay in slot */
+static struct stick_task *wheel[STICK_WHEEL_SIZE];
+static uint64_t wheel_now;
+
 
 void stick_init(int32_t hz)
 {
 	ticks = 0;
+	wheel_now = 0;
 
 	systick_set_frequency(hz, rcc_ppre2_frequency*2);
 	systick_interrupt_enable();
@@ -81,3 +86,136 @@ void stick_update(void)
 {
 	ticks++;
 }
+
+static void stick_link(struct stick_task *task)
+{
+	struct stick_task **slot = &wheel[task->when & (STICK_WHEEL_SIZE - 1)];
+
+	task->prev = slot;
+	task->next = *slot;
+	if (*slot != NULL) {
+		(*slot)->prev = &task->next;
+	}
+	*slot = task;
+}
+
+static void stick_unlink(struct stick_task *task)
+{
+	*task->prev = task->next;
+	if (task->next != NULL) {
+		task->next->prev = task->prev;
+	}
+	task->prev = NULL;
+	task->next = NULL;
+}
+
+/*
+ * run fn after delay ticks, then every period ticks if nonzero
+ * the task must be zeroed before the first use
+ */
+void stick_task_add(struct stick_task *task, uint32_t delay, uint32_t period,
+		    void (*fn)(void *arg), void *arg)
+{
+	if (task->prev != NULL) {
+		stick_unlink(task);
+	}
+
+	task->when = wheel_now + ((delay > 0) ? delay : 1);
+	task->period = period;
+	task->fn = fn;
+	task->arg = arg;
+	stick_link(task);
+}
+
+void stick_task_cancel(struct stick_task *task)
+{
+	if (task->prev != NULL) {
+		stick_unlink(task);
+	}
+}
+
+static void stick_expire(uint32_t idx)
+{
+	struct stick_task *task = wheel[idx];
+
+	while (task != NULL) {
+		if (task->when > wheel_now) {
+			task = task->next;
+			continue;
+		}
+
+		stick_unlink(task);
+
+		if (task->period > 0) {
+			task->when += task->period;
+			if (task->when <= wheel_now) {
+				/* overloaded, skip the missed runs */
+				task->when = wheel_now + task->period;
+			}
+			stick_link(task);
+		}
+
+		task->fn(task->arg);
+
+		/* the callback may have changed the slot, start over */
+		task = wheel[idx];
+	}
+}
+
+/* expire due tasks, single atomic tick snapshot per call */
+uint64_t stick_run(void)
+{
+	uint64_t now = stick_get();
+	uint64_t from = wheel_now + 1;
+
+	if (now < from) {
+		return now;
+	}
+
+	if (now - from >= STICK_WHEEL_SIZE) {
+		from = now - STICK_WHEEL_SIZE + 1;
+	}
+
+	wheel_now = now;
+	for (uint64_t t = from; t <= now; t++) {
+		stick_expire(t & (STICK_WHEEL_SIZE - 1));
+	}
+
+	return now;
+}
+
+/* tick snapshot of the last stick_run */
+uint64_t stick_now(void)
+{
+	return wheel_now;
+}
+
+/* earliest due tick of all tasks, UINT64_MAX if there is none */
+uint64_t stick_next(void)
+{
+	uint64_t next = UINT64_MAX;
+
+	for (uint32_t i = 1; i <= STICK_WHEEL_SIZE; i++) {
+		struct stick_task *task = wheel[(wheel_now + i) & (STICK_WHEEL_SIZE - 1)];
+
+		for (; task != NULL; task = task->next) {
+			if (task->when < next) {
+				next = task->when;
+			}
+		}
+
+		if (next <= wheel_now + i) {
+			break;
+		}
+	}
+
+	return next;
+}
+
+/* sleep until interrupt, systick wakes us at least every tick */
+void stick_sleep(uint64_t until)
+{
+	if (stick_get() < until) {
+		__asm__ volatile ("wfi");
+	}
+}
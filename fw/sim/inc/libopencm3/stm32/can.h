@@ -0,0 +1,13 @@
+/*
+ * Identifier layout of the libopencm3 can driver, all the simulated
+ * firmware modules need of it. Same as the mobid of struct can_message.
+ */
+#ifndef SIM_CAN_H_INCLUDED
+#define SIM_CAN_H_INCLUDED
+
+#define CAN_ID_IDE		0x80000000
+#define CAN_ID_RTR		0x40000000
+#define CAN_ID_STDID(x)		((uint32_t)(x) << 18)
+#define CAN_ID_EXTID(x)		(((uint32_t)(x) & 0x1FFFFFFF) | CAN_ID_IDE)
+
+#endif // SIM_CAN_H_INCLUDED
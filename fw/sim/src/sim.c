@@ -0,0 +1,456 @@
+/*
+ * Simulated board on linux, the firmware modules talk over localhost UDP.
+ *
+ * Board clock runs from CLOCK_MONOTONIC with the given drift and offset, so
+ * the real error of the clock sync is known. The master is the host side
+ * of the sync, it takes the place of the PC software.
+ *
+ * With the CAN ports simulated the board runs the capture benchmark,
+ * the master starts it and counts the frames streamed to it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <libopencm3/stm32/can.h>
+
+#include "modbench.h"
+#include "modcan.h"
+#include "modctl.h"
+#include "modgen.h"
+#include "modnet.h"
+#include "modsync.h"
+#include "simcan.h"
+#include "stick.h"
+
+#define SIM_BOARDS_MAX	8
+
+static int sim_sock;
+static bool sim_master;
+static uint16_t sim_port = MODNET_PORT;
+static uint16_t sim_master_port = MODNET_PORT;
+static uint16_t sim_boards[SIM_BOARDS_MAX];
+static int sim_nboards;
+static double sim_drift;		// ppm
+static int64_t sim_offset;		// us
+static uint32_t sim_jitter;		// us, max extra receive delay
+static uint32_t sim_interval = 1000;	// ms, sync period
+static uint32_t sim_seq;
+static uint32_t sim_bitrate;		// board: CAN ports simulated
+static uint32_t sim_latency;		// us, board: max extra rx isr latency
+static int64_t sim_step;		// us, master: clock stepped once, as NTP does
+
+#define SIM_STEP_AFTER	5000000		// us, from the start
+
+/* master: benchmark started on the boards */
+static struct modbench_config sim_bench;
+static uint32_t sim_bench_frames[SIM_BOARDS_MAX];	// received in the step
+static bool sim_bench_done[SIM_BOARDS_MAX];
+
+/* status of the sync as the host would apply it */
+static struct modsync_msg sim_status;
+
+static uint64_t sim_mono_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t sim_start;
+
+/* master clock, stepped after a while when asked to */
+static uint64_t sim_master_us(void)
+{
+	uint64_t mono = sim_mono_us();
+	return (mono - sim_start > SIM_STEP_AFTER) ? mono + sim_step : mono;
+}
+
+static uint64_t sim_board_us(uint64_t mono)
+{
+	double t = (double)(mono - sim_start);
+	return (uint64_t)(t * (1.0 + sim_drift / 1e6) + sim_offset);
+}
+
+uint64_t stick_get_us(void)
+{
+	return sim_board_us(sim_mono_us());
+}
+
+static bool sim_sendto(uint16_t port, const void *data, uint16_t len)
+{
+	struct sockaddr_in sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(port);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	return sendto(sim_sock, data, len, 0, (struct sockaddr *)&sa, sizeof(sa)) == len;
+}
+
+static bool sim_send(uint16_t port, uint8_t type, uint8_t flags, const void *data, uint8_t count, uint16_t size)
+{
+	uint8_t buf[1500];
+	struct modnet_header *hdr = (struct modnet_header *)buf;
+
+	if (sizeof(*hdr) + size > sizeof(buf)) {
+		return false;
+	}
+
+	hdr->magic = MODNET_MAGIC;
+	hdr->type = type;
+	hdr->flags = flags;
+	hdr->count = count;
+	hdr->seq = sim_seq++;
+	memcpy(hdr + 1, data, size);
+
+	return sim_sendto(port, buf, sizeof(*hdr) + size);
+}
+
+/* maps board ticks to the master timeline, what the host does per frame */
+static int64_t sim_map(uint64_t ticks)
+{
+	int64_t dt = (int64_t)(ticks - sim_status.time);
+	return (int64_t)ticks - sim_status.offset - (int64_t)sim_status.drift * dt / 1000000000;
+}
+
+/* the board checks its own status against the real clock */
+static void sim_board_check(void)
+{
+	uint64_t mono = sim_mono_us();
+	int64_t err = sim_map(sim_board_us(mono)) - (int64_t)mono;
+
+	printf("board %u: offset %lld us drift %d ppb delay %u us, error %lld us\n",
+	       sim_port, (long long)sim_status.offset, sim_status.drift, sim_status.delay, (long long)err);
+}
+
+/* firmware sends everything to the host, here the master instance */
+bool modnet_send(uint8_t type, uint8_t flags, const void *data, uint8_t count, uint16_t size)
+{
+	const struct modsync_msg *msg = data;
+
+	if ((type == MODNET_TYPE_SYNC) && (msg->kind == MODSYNC_STATUS)) {
+		memcpy(&sim_status, msg, sizeof(sim_status));
+		sim_board_check();
+	}
+
+	return sim_send(sim_master_port, type, flags, data, count, size);
+}
+
+#define SIM_FRAMES	(MODNET_PAYLOAD / sizeof(struct can_message))
+
+uint32_t modnet_batch_age = 2000;	// us
+
+/* bulk lane of modnet, the only one simcan fills */
+static void sim_stream(void)
+{
+	static struct can_message frames[SIM_FRAMES];
+
+	uint16_t pending = modcan_pending(MODCAN_LANE_BULK);
+	if ((pending == 0) ||
+	    ((pending < SIM_FRAMES) && (stick_get_us() < modcan_oldest(MODCAN_LANE_BULK) + modnet_batch_age))) {
+		return;
+	}
+
+	uint16_t n = 0;
+	while ((n < SIM_FRAMES) && modcan_get(MODCAN_LANE_BULK, &frames[n])) {
+		n++;
+	}
+
+	bool sent = modnet_send(MODNET_TYPE_FRAMES, 0, frames, n, n * sizeof(struct can_message));
+
+	for (uint16_t i = 0; i < n; i++) {
+		modbench_frame(&frames[i], sent);
+	}
+}
+
+static void sim_board_recv(const uint8_t *buf, ssize_t len, uint64_t rx)
+{
+	const struct modnet_header *hdr = (const struct modnet_header *)buf;
+	struct modsync_msg msg;
+	struct modgen_config gen;
+	struct modbench_config bench;
+
+	if ((hdr->type == MODNET_TYPE_SYNC) && (len >= (ssize_t)(sizeof(*hdr) + sizeof(msg)))) {
+		memcpy(&msg, hdr + 1, sizeof(msg));
+		modsync_recv(&msg, rx);
+	} else if ((hdr->type == MODNET_TYPE_GEN) && (len >= (ssize_t)(sizeof(*hdr) + sizeof(gen)))) {
+		memcpy(&gen, hdr + 1, sizeof(gen));
+		modgen_request(&gen);
+	} else if ((hdr->type == MODNET_TYPE_BENCH) && (len >= (ssize_t)(sizeof(*hdr) + sizeof(bench)))) {
+		memcpy(&bench, hdr + 1, sizeof(bench));
+		modbench_request(&bench);
+	}
+}
+
+static void sim_master_sync(void)
+{
+	static uint16_t seq;
+	struct modsync_msg msg;
+
+	seq++;
+	for (int i = 0; i < sim_nboards; i++) {
+		memset(&msg, 0, sizeof(msg));
+		msg.kind = MODSYNC_SYNC;
+		msg.seq = seq;
+
+		uint64_t t1 = sim_master_us();
+		sim_send(sim_boards[i], MODNET_TYPE_SYNC, 0, &msg, 1, sizeof(msg));
+
+		msg.kind = MODSYNC_FOLLOW_UP;
+		msg.time = t1;
+		sim_send(sim_boards[i], MODNET_TYPE_SYNC, 0, &msg, 1, sizeof(msg));
+	}
+}
+
+static void sim_master_bench(void)
+{
+	for (int i = 0; i < sim_nboards; i++) {
+		sim_send(sim_boards[i], MODNET_TYPE_BENCH, 0, &sim_bench, 1, sizeof(sim_bench));
+	}
+}
+
+static int sim_master_board(uint16_t from)
+{
+	for (int i = 0; i < sim_nboards; i++) {
+		if (sim_boards[i] == from) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/* frames of the benchmark the boards managed to stream */
+static void sim_master_frames(const uint8_t *buf, ssize_t len, int board)
+{
+	const struct modnet_header *hdr = (const struct modnet_header *)buf;
+	struct can_message msg;
+
+	for (uint8_t i = 0; i < hdr->count; i++) {
+		ssize_t offset = sizeof(*hdr) + i * sizeof(msg);
+		if (offset + (ssize_t)sizeof(msg) > len) {
+			break;
+		}
+
+		memcpy(&msg, buf + offset, sizeof(msg));
+		if (((msg.source & 0x0F) == sim_bench.rx + 1) &&
+		    ((msg.mobid & MODCAN_ID_MASK) == CAN_ID_STDID(sim_bench.id))) {
+			sim_bench_frames[board]++;
+		}
+	}
+}
+
+static void sim_master_report(const struct modbench_report *rep, int board, bool last)
+{
+	uint16_t from = sim_boards[board];
+	int32_t network = rep->streamed - sim_bench_frames[board];
+	sim_bench_frames[board] = 0;
+
+	printf("board %u: load %u.%u%% achieved %u.%u%% %u frames/s, sent %u overrun %u ring %u pbuf %u network %d, %u out of order\n",
+	       from, rep->load / 10, rep->load % 10, rep->achieved / 10, rep->achieved % 10, rep->rate,
+	       rep->sent, rep->overrun, rep->ring, rep->pbuf, network, rep->order);
+
+	printf("board %u: isr latency", from);
+	for (int i = 0; i < MODBENCH_LATENCY_BUCKETS; i++) {
+		if (rep->latency[i] != 0) {
+			printf(" <%uus %u", 1U << i, rep->latency[i]);
+		}
+	}
+	printf("\n");
+
+	if (!last) {
+		return;
+	}
+
+	printf("board %u: max loss-free load %u.%u%%\n", from, rep->max_ok / 10, rep->max_ok % 10);
+
+	sim_bench_done[board] = true;
+	for (int i = 0; i < sim_nboards; i++) {
+		if (!sim_bench_done[i]) {
+			return;
+		}
+	}
+
+	exit(0);
+}
+
+static void sim_master_recv(const uint8_t *buf, ssize_t len, uint64_t rx, uint16_t from)
+{
+	const struct modnet_header *hdr = (const struct modnet_header *)buf;
+	struct modsync_msg msg;
+	struct modbench_report rep;
+	int board = sim_master_board(from);
+
+	if (board < 0) {
+		return;
+	}
+
+	if ((hdr->type == MODNET_TYPE_FRAMES) && (sim_bench.first > 0)) {
+		sim_master_frames(buf, len, board);
+		return;
+	}
+
+	if ((hdr->type == MODNET_TYPE_BENCH) && (len >= (ssize_t)(sizeof(*hdr) + sizeof(sim_bench)))) {
+		const struct modbench_config *cfg = (const struct modbench_config *)(hdr + 1);
+		if (cfg->status != MODCTL_STATUS_OK) {
+			printf("board %u: benchmark refused, status %u\n", from, cfg->status);
+			sim_bench_done[board] = true;
+		}
+		return;
+	}
+
+	if ((hdr->type == MODNET_TYPE_BENCH_STEP) && (len >= (ssize_t)(sizeof(*hdr) + sizeof(rep)))) {
+		memcpy(&rep, hdr + 1, sizeof(rep));
+		sim_master_report(&rep, board, (hdr->flags & MODNET_FLAG_LAST) != 0);
+		return;
+	}
+
+	if ((hdr->type != MODNET_TYPE_SYNC) || (len < (ssize_t)(sizeof(*hdr) + sizeof(msg)))) {
+		return;
+	}
+
+	memcpy(&msg, hdr + 1, sizeof(msg));
+
+	if (msg.kind == MODSYNC_DELAY_REQ) {
+		msg.kind = MODSYNC_DELAY_RESP;
+		msg.time = rx;
+		sim_send(from, MODNET_TYPE_SYNC, 0, &msg, 1, sizeof(msg));
+	} else if (msg.kind == MODSYNC_STATUS) {
+		printf("master: board %u offset %lld us drift %d ppb delay %u us, %u exchanges\n",
+		       from, (long long)msg.offset, msg.drift, msg.delay, msg.exchanges);
+	}
+}
+
+static void sim_usage(void)
+{
+	printf("USAGE: canshark-sim [options]\n\n");
+	printf("  -p PORT   local UDP port (%u)\n", MODNET_PORT);
+	printf("  -m        act as the host, sync master\n");
+	printf("  -b PORT   master: board to sync, repeatable\n");
+	printf("  -M PORT   board: port of the master (%u)\n", MODNET_PORT);
+	printf("  -d PPM    board: clock drift\n");
+	printf("  -o US     board: clock offset\n");
+	printf("  -j US     board: random extra receive delay\n");
+	printf("  -i MS     master: sync interval (%u)\n", sim_interval);
+	printf("  -s US     master: clock stepped by US after 5 s\n");
+	printf("  -c BPS    board: simulate both CAN ports wired to each other\n");
+	printf("  -l US     board: random extra rx isr latency\n");
+	printf("  -B FIRST:LAST:INC[:MS]\n");
+	printf("            master: capture benchmark, CAN1 to CAN2, load permille\n");
+	exit(0);
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+	while ((opt = getopt(argc, argv, "p:mb:M:d:o:j:i:s:c:l:B:h")) != -1) {
+		switch (opt) {
+		case 'p': sim_port = atoi(optarg); break;
+		case 'm': sim_master = true; break;
+		case 'b':
+			if (sim_nboards < SIM_BOARDS_MAX) {
+				sim_boards[sim_nboards++] = atoi(optarg);
+			}
+			break;
+		case 'M': sim_master_port = atoi(optarg); break;
+		case 'd': sim_drift = atof(optarg); break;
+		case 'o': sim_offset = atoll(optarg); break;
+		case 'j': sim_jitter = atoi(optarg); break;
+		case 'i': sim_interval = atoi(optarg); break;
+		case 's': sim_step = atoll(optarg); break;
+		case 'c': sim_bitrate = atoi(optarg); break;
+		case 'l': sim_latency = atoi(optarg); break;
+		case 'B': {
+			unsigned first = 0, last = 0, inc = 0, ms = 0;
+			sscanf(optarg, "%u:%u:%u:%u", &first, &last, &inc, &ms);
+			sim_bench.tx = 0;
+			sim_bench.rx = 1;
+			sim_bench.dlc = 8;
+			sim_bench.first = first;
+			sim_bench.last = (last > first) ? last : first;
+			sim_bench.increment = inc;
+			sim_bench.step = ms;
+			sim_bench.id = 0x123;
+			break;
+		}
+		default: sim_usage(); break;
+		}
+	}
+
+	sim_start = sim_mono_us();
+	srand(sim_port);
+
+	sim_sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+	struct sockaddr_in sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(sim_port);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if ((sim_sock < 0) || (bind(sim_sock, (struct sockaddr *)&sa, sizeof(sa)) < 0)) {
+		perror("canshark-sim");
+		return 1;
+	}
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	if (sim_bitrate > 0) {
+		simcan_init(sim_bitrate, sim_latency);
+	}
+
+	if (sim_master && (sim_bench.first > 0)) {
+		sim_master_bench();
+	}
+
+	uint64_t next = sim_mono_us();
+	struct pollfd pfd = { .fd = sim_sock, .events = POLLIN };
+
+	while (1) {
+		if (sim_master && (sim_mono_us() >= next)) {
+			next += sim_interval * 1000;
+			sim_master_sync();
+		}
+
+		/* bus is simulated in real time, the loop never sleeps */
+		if (sim_bitrate > 0) {
+			simcan_step();
+			sim_stream();
+			modgen_step();
+			modbench_step();
+		}
+
+		if (poll(&pfd, 1, (sim_bitrate > 0) ? 0 : 1) <= 0) {
+			continue;
+		}
+
+		uint8_t buf[1500];
+		struct sockaddr_in from;
+		socklen_t fromlen = sizeof(from);
+
+		ssize_t len = recvfrom(sim_sock, buf, sizeof(buf), 0, (struct sockaddr *)&from, &fromlen);
+		if ((len < (ssize_t)sizeof(struct modnet_header)) || (buf[0] != MODNET_MAGIC)) {
+			continue;
+		}
+
+		if (sim_master) {
+			sim_master_recv(buf, len, sim_master_us(), ntohs(from.sin_port));
+			continue;
+		}
+
+		/* path asymmetry, the frame sits in the MAC for a while */
+		if (sim_jitter > 0) {
+			usleep(rand() % sim_jitter);
+		}
+
+		sim_board_recv(buf, len, stick_get_us());
+	}
+
+	return 0;
+}
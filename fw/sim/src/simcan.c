@@ -0,0 +1,289 @@
+/*
+ * Both CAN ports of the board wired to each other, in place of modcan.
+ *
+ * The bus runs in real time at the bitrate, with the bxCAN limits the capture
+ * runs into: three tx mailboxes sent in queue order, three frames deep rx FIFO
+ * and the isr served only when the main loop gets to it, optionally later by
+ * a random latency of the rx isr. Every frame goes to FIFO1 and the bulk
+ * lane, stuff bits are not simulated.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include <libopencm3/stm32/can.h>
+
+#include "modcan.h"
+#include "simcan.h"
+#include "stick.h"
+
+#define SIMCAN_MAILBOXES	3
+#define SIMCAN_FIFO		3
+
+/* frame length without stuff bits, including the interframe space */
+#define SIMCAN_BITS_STD		47
+#define SIMCAN_BITS_EXT		67
+
+struct simcan_frame {
+	uint32_t mobid;
+	uint8_t data[8];
+	uint8_t len;
+	uint8_t mailbox;
+	uint64_t time;		// bit times, start of frame
+	uint64_t queued;	// ns
+};
+
+struct simcan_port {
+	struct simcan_frame mb[SIMCAN_MAILBOXES];	// pending, oldest first
+	uint8_t mbn;
+	struct simcan_frame done[SIMCAN_MAILBOXES];	// sent, waiting for the tx isr
+	uint8_t donen;
+	struct simcan_frame fifo[SIMCAN_FIFO];		// received, waiting for the rx isr
+	uint8_t fifon;
+	uint64_t isr;					// ns, rx isr entered
+};
+
+static struct simcan_port simcan_ports[MODCAN_PORTS];
+
+static struct {
+	bool busy;
+	uint8_t port;		// sending
+	uint64_t sof;		// ns
+	uint64_t eof;		// ns
+	uint64_t idle;		// ns, free since
+} simcan_bus;
+
+static uint32_t simcan_bit;	// ns
+static uint32_t simcan_latency;	// ns, max of the rx isr
+
+struct modcan_ring {
+	struct can_message *msgs;
+	uint16_t mask;
+	uint16_t w;
+	uint16_t r;
+};
+
+static struct can_message msgs_prio[MODCAN_PRIO_SIZE];
+static struct can_message msgs_bulk[MODCAN_RING_SIZE];
+
+static struct modcan_ring rings[MODCAN_LANES] = {
+	[MODCAN_LANE_PRIO] = { msgs_prio, MODCAN_PRIO_SIZE - 1, 0, 0 },
+	[MODCAN_LANE_BULK] = { msgs_bulk, MODCAN_RING_SIZE - 1, 0, 0 },
+};
+
+struct modcan_stats modcan_stats[MODCAN_PORTS];
+struct modcan_timing modcan_timing[MODCAN_PORTS];
+
+void simcan_init(uint32_t bitrate, uint32_t latency)
+{
+	for (uint8_t port = 0; port < MODCAN_PORTS; port++) {
+		modcan_timing[port].bitrate = bitrate;
+		modcan_timing[port].sample = MODCAN_SAMPLE_DEFAULT;
+	}
+
+	simcan_bit = 1000000000 / bitrate;
+	simcan_latency = latency * 1000;
+}
+
+bool modcan_tx_enabled(uint8_t port)
+{
+	return (port < MODCAN_PORTS) && (simcan_bit != 0) && !modcan_timing[port].silent;
+}
+
+bool modcan_transmit(uint8_t port, uint32_t mobid, uint8_t *data, uint8_t len)
+{
+	if (!modcan_tx_enabled(port)) {
+		return false;
+	}
+
+	struct simcan_port *p = &simcan_ports[port];
+	if (p->mbn == SIMCAN_MAILBOXES) {
+		return false;
+	}
+
+	/* first free mailbox, the bus takes them in queue order anyway */
+	uint8_t used = 0;
+	for (uint8_t i = 0; i < p->mbn; i++) {
+		used |= 1 << p->mb[i].mailbox;
+	}
+
+	struct simcan_frame *f = &p->mb[p->mbn++];
+	f->mobid = mobid;
+	f->len = len;
+	f->mailbox = __builtin_ctz(~used);
+	f->queued = stick_get_us() * 1000;
+	memcpy(f->data, data, len);
+	return true;
+}
+
+/* same as the rx and tx isr of modcan, every frame to the bulk lane */
+static void simcan_capture(uint8_t source, const struct simcan_frame *f)
+{
+	uint8_t port = (source & 0x07) - 1;
+	struct modcan_ring *ring = &rings[MODCAN_LANE_BULK];
+
+	if (ring->msgs[ring->w].isthere ||
+	    (((ring->w - ring->r) & ring->mask) >= ring->mask + 1 - MODCAN_RING_RESERVE)) {
+		modcan_stats[port].lost++;
+		return;
+	}
+
+	if (source & 0x08) {
+		modcan_stats[port].tx++;
+	} else {
+		modcan_stats[port].rx++;
+	}
+
+	struct can_message *msg = &ring->msgs[ring->w];
+	ring->w = (ring->w + 1) & ring->mask;
+
+	msg->mobid = f->mobid;
+	/* the bus knows the whole count, the board unwraps the 16 bit one */
+	msg->time = f->time;
+	msg->time_mid = f->time >> 16;
+	msg->time_hi = f->time >> 48;
+	msg->source = source;
+	msg->zero = 0;
+	memcpy(msg->data, f->data, sizeof(msg->data));
+	msg->length = f->len;
+	msg->ticks = stick_get_us();
+	msg->isthere = true;
+}
+
+static void simcan_isr(uint64_t now)
+{
+	for (uint8_t port = 0; port < MODCAN_PORTS; port++) {
+		struct simcan_port *p = &simcan_ports[port];
+
+		for (uint8_t i = 0; i < p->donen; i++) {
+			simcan_capture((p->done[i].mailbox << 4) | (port + 1) | 0x08, &p->done[i]);
+		}
+		p->donen = 0;
+
+		if ((p->fifon == 0) || (now < p->isr)) {
+			continue;
+		}
+
+		for (uint8_t i = 0; i < p->fifon; i++) {
+			simcan_capture(0x10 | (port + 1), &p->fifo[i]);
+		}
+
+		p->fifon = 0;
+	}
+}
+
+static bool simcan_arbitrate(uint64_t now)
+{
+	int8_t winner = -1;
+
+	for (uint8_t port = 0; port < MODCAN_PORTS; port++) {
+		struct simcan_port *p = &simcan_ports[port];
+
+		if ((p->mbn == 0) || (p->mb[0].queued > now)) {
+			continue;
+		}
+
+		/* lower identifier wins, the standard ones compared by the base id */
+		if ((winner < 0) ||
+		    ((p->mb[0].mobid & MODCAN_ID_MASK) < (simcan_ports[winner].mb[0].mobid & MODCAN_ID_MASK))) {
+			winner = port;
+		}
+	}
+
+	if (winner < 0) {
+		return false;
+	}
+
+	struct simcan_frame *f = &simcan_ports[winner].mb[0];
+	uint32_t bits = ((f->mobid & CAN_ID_IDE) ? SIMCAN_BITS_EXT : SIMCAN_BITS_STD) + f->len * 8;
+
+	simcan_bus.busy = true;
+	simcan_bus.port = winner;
+	simcan_bus.sof = (f->queued > simcan_bus.idle) ? f->queued : simcan_bus.idle;
+	simcan_bus.eof = simcan_bus.sof + (uint64_t)bits * simcan_bit;
+	f->time = simcan_bus.sof / simcan_bit;
+	return true;
+}
+
+static void simcan_complete(void)
+{
+	struct simcan_port *p = &simcan_ports[simcan_bus.port];
+	struct simcan_frame f = p->mb[0];
+
+	p->mbn--;
+	memmove(&p->mb[0], &p->mb[1], p->mbn * sizeof(p->mb[0]));
+	p->done[p->donen++] = f;
+
+	for (uint8_t port = 0; port < MODCAN_PORTS; port++) {
+		struct simcan_port *rx = &simcan_ports[port];
+
+		if (port == simcan_bus.port) {
+			continue;
+		}
+
+		if (rx->fifon == SIMCAN_FIFO) {
+			modcan_stats[port].overrun[1]++;
+			continue;
+		}
+
+		if (rx->fifon == 0) {
+			rx->isr = simcan_bus.eof + ((simcan_latency > 0) ? (uint32_t)rand() % simcan_latency : 0);
+		}
+		rx->fifo[rx->fifon++] = f;
+	}
+
+	simcan_bus.busy = false;
+	simcan_bus.idle = simcan_bus.eof;
+}
+
+/* bus runs up to now, then the isr takes what the FIFOs got */
+void simcan_step(void)
+{
+	if (simcan_bit == 0) {
+		return;
+	}
+
+	uint64_t now = stick_get_us() * 1000;
+
+	while ((simcan_bus.busy || simcan_arbitrate(now)) && (simcan_bus.eof <= now)) {
+		simcan_complete();
+	}
+
+	simcan_isr(now);
+}
+
+bool modcan_get(uint8_t lane, struct can_message *msg)
+{
+	struct modcan_ring *ring = &rings[lane];
+
+	if (!ring->msgs[ring->r].isthere) {
+		return false;
+	}
+
+	memcpy(msg, &ring->msgs[ring->r], sizeof(struct can_message));
+	ring->msgs[ring->r].isthere = false;
+
+	ring->r = (ring->r + 1) & ring->mask;
+	return true;
+}
+
+uint16_t modcan_pending(uint8_t lane)
+{
+	struct modcan_ring *ring = &rings[lane];
+
+	if (!ring->msgs[ring->r].isthere) {
+		return 0;
+	}
+
+	return ((ring->w - ring->r - 1) & ring->mask) + 1;
+}
+
+uint64_t modcan_oldest(uint8_t lane)
+{
+	struct modcan_ring *ring = &rings[lane];
+
+	if (!ring->msgs[ring->r].isthere) {
+		return 0;
+	}
+
+	return ring->msgs[ring->r].ticks;
+}
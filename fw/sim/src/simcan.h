@@ -0,0 +1,7 @@
+#ifndef SIMCAN_H_INCLUDED
+#define SIMCAN_H_INCLUDED
+
+void simcan_init(uint32_t bitrate, uint32_t latency);
+void simcan_step(void);
+
+#endif // SIMCAN_H_INCLUDED
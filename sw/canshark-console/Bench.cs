@@ -0,0 +1,157 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text;
+
+namespace canshark
+{
+    /* capture loss benchmark, the ports wired to each other, struct modbench_config */
+    class BenchConfig
+    {
+        public byte Tx = 0;
+        public byte Rx = 1;
+        public byte Dlc = 8;
+        public byte Status;                 // reply only, BoardControl.STATUS_*
+        public UInt16 First;                // permille, 0 stops the run
+        public UInt16 Last;                 // permille
+        public UInt16 Increment;            // permille
+        public UInt16 Step;                 // ms, 0 for default
+        public UInt16 Id = 0x123;
+
+        public void SerializeTo(BinaryWriter bw)
+        {
+            bw.Write(Tx);
+            bw.Write(Rx);
+            bw.Write(Dlc);
+            bw.Write(Status);
+            bw.Write(First);
+            bw.Write(Last);
+            bw.Write(Increment);
+            bw.Write(Step);
+            bw.Write(Id);
+            bw.Write((UInt16)0); /* reserved */
+        }
+
+        public static BenchConfig DeserializeFrom(BinaryReader br)
+        {
+            BenchConfig c = new BenchConfig();
+
+            c.Tx = br.ReadByte();
+            c.Rx = br.ReadByte();
+            c.Dlc = br.ReadByte();
+            c.Status = br.ReadByte();
+            c.First = br.ReadUInt16();
+            c.Last = br.ReadUInt16();
+            c.Increment = br.ReadUInt16();
+            c.Step = br.ReadUInt16();
+            c.Id = br.ReadUInt16();
+            br.ReadUInt16(); /* reserved */
+
+            return c;
+        }
+
+        private static UInt16 Permille(string s)
+        {
+            return (UInt16)(double.Parse(s.TrimEnd('%'), System.Globalization.CultureInfo.InvariantCulture) * 10);
+        }
+
+        /* FIRST%:LAST%:STEP%[:MS] */
+        public static BenchConfig Parse(string spec)
+        {
+            string[] p = spec.Split(':');
+            BenchConfig c = new BenchConfig();
+
+            c.First = Permille(p[0]);
+            c.Last = (p.Length > 1) ? Permille(p[1]) : c.First;
+            if (p.Length > 2)
+                c.Increment = Permille(p[2]);
+            if (p.Length > 3)
+                c.Step = UInt16.Parse(p[3]);
+
+            return c;
+        }
+
+        /* frame of the benchmark captured by the rx port */
+        public bool IsBench(CanMessage m)
+        {
+            return ((m.Source & 0x0F) == Rx + 1) && ((m.COB & 0x9FFFFFFF) == ((UInt32)Id << 18));
+        }
+
+        public override string ToString()
+        {
+            return string.Format("benchmark CAN{0} to CAN{1} {2}.{3}% to {4}.{5}% {6}", Tx + 1, Rx + 1,
+                First / 10, First % 10, Last / 10, Last % 10,
+                (Status == BoardControl.STATUS_OK) ? "started" : "refused " + Status);
+        }
+    }
+
+    /* one load step of the benchmark, struct modbench_report */
+    class BenchReport
+    {
+        public const int LATENCY_BUCKETS = 16;
+
+        public UInt16 Load;                 // permille
+        public UInt16 Achieved;             // permille
+        public UInt16 MaxOk;                // permille, highest without loss on the board
+        public UInt16 Rate;                 // frames/s
+        public UInt32 Sent;
+        public UInt32 Overrun;              // hw FIFO full
+        public UInt32 Ring;                 // capture ring full
+        public UInt32 Seen;                 // read from the ring
+        public UInt32 Pbuf;                 // datagram not allocated
+        public UInt32 Streamed;             // put into datagrams
+        public UInt32 Order;                // out of sequence
+        public UInt32[] Latency = new UInt32[LATENCY_BUCKETS];  // log2 us buckets
+        public bool Last;                   // datagram flag, end of the run
+
+        public UInt32 Received;             // host, frames of the step got
+
+        public static BenchReport DeserializeFrom(BinaryReader br)
+        {
+            BenchReport r = new BenchReport();
+
+            r.Load = br.ReadUInt16();
+            r.Achieved = br.ReadUInt16();
+            r.MaxOk = br.ReadUInt16();
+            r.Rate = br.ReadUInt16();
+            r.Sent = br.ReadUInt32();
+            r.Overrun = br.ReadUInt32();
+            r.Ring = br.ReadUInt32();
+            r.Seen = br.ReadUInt32();
+            r.Pbuf = br.ReadUInt32();
+            r.Streamed = br.ReadUInt32();
+            r.Order = br.ReadUInt32();
+            for (int i = 0; i < LATENCY_BUCKETS; i++)
+                r.Latency[i] = br.ReadUInt32();
+
+            return r;
+        }
+
+        /* streamed by the board but not got */
+        public long Network
+        {
+            get { return (long)Streamed - Received; }
+        }
+
+        /* lost on the bus or not drained in time, the rest of the sent ones */
+        public long Other
+        {
+            get { return (long)Sent - Seen - Overrun - Ring; }
+        }
+
+        public string LatencyString()
+        {
+            return string.Join(" ", Enumerable.Range(0, LATENCY_BUCKETS)
+                .Where(i => Latency[i] != 0)
+                .Select(i => string.Format("<{0}us {1}", 1u << i, Latency[i])));
+        }
+
+        public override string ToString()
+        {
+            return string.Format("load {0,3}.{1}% achieved {2,3}.{3}% {4,5} frame/s: sent {5}, lost overrun {6} ring {7} pbuf {8} network {9} other {10}, {11} out of order",
+                Load / 10, Load % 10, Achieved / 10, Achieved % 10, Rate,
+                Sent, Overrun, Ring, Pbuf, Network, Other, Order);
+        }
+    }
+}
@@ -0,0 +1,119 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text;
+
+namespace canshark
+{
+    /* request to the board and its reply, struct modctl_msg */
+    class BoardControl
+    {
+        public const byte CMD_TIMING_GET = 1;
+        public const byte CMD_TIMING_SET = 2;
+        public const byte CMD_AUTOBAUD = 3;
+        public const byte CMD_SILENT_SET = 4;
+        public const byte CMD_NMT_FILTER = 5;
+        public const byte CMD_PARAM_GET = 6;
+        public const byte CMD_PARAM_SET = 7;
+        public const byte CMD_FILTER_GET = 8;       /* port is the entry */
+        public const byte CMD_FILTER_SET = 9;
+        public const byte CMD_LANE_GET = 10;        /* port is the entry */
+        public const byte CMD_LANE_SET = 11;
+        public const byte CMD_SAVE = 12;
+        public const byte CMD_DEFAULTS = 13;
+
+        public const UInt32 PARAM_BATCH_AGE = 1;    /* us */
+        public const UInt32 PARAM_TELEMETRY = 2;    /* ms, 0 off */
+        public const UInt32 PARAM_DEST_ADDR = 3;    /* a << 24 | b << 16 | c << 8 | d */
+        public const UInt32 PARAM_DEST_PORT = 4;
+
+        public const byte STATUS_OK = 0;
+        public const byte STATUS_PENDING = 1;
+        public const byte STATUS_INVALID = 2;
+        public const byte STATUS_FAILED = 3;
+
+        public UInt16 Id;
+        public byte Cmd;
+        public byte Port;
+        public byte Status;
+        public UInt32[] Arg = new UInt32[2];
+
+        public void SerializeTo(BinaryWriter bw)
+        {
+            bw.Write(Id);
+            bw.Write(Cmd);
+            bw.Write(Port);
+            bw.Write(Status);
+            bw.Write(new byte[3]); /* reserved */
+            bw.Write(Arg[0]);
+            bw.Write(Arg[1]);
+        }
+
+        public static BoardControl DeserializeFrom(BinaryReader br)
+        {
+            BoardControl c = new BoardControl();
+
+            c.Id = br.ReadUInt16();
+            c.Cmd = br.ReadByte();
+            c.Port = br.ReadByte();
+            c.Status = br.ReadByte();
+            br.ReadBytes(3); /* reserved */
+            c.Arg[0] = br.ReadUInt32();
+            c.Arg[1] = br.ReadUInt32();
+
+            return c;
+        }
+
+        /* NAME=VALUE of the command line, the destination address dotted */
+        public static KeyValuePair<UInt32, UInt32> ParseParam(string spec)
+        {
+            string[] p = spec.Split('=');
+            if (p.Length != 2)
+                throw new FormatException("param is NAME=VALUE");
+
+            switch (p[0].ToLowerInvariant())
+            {
+                case "batch":
+                    return new KeyValuePair<UInt32, UInt32>(PARAM_BATCH_AGE, UInt32.Parse(p[1]));
+                case "telemetry":
+                    return new KeyValuePair<UInt32, UInt32>(PARAM_TELEMETRY, UInt32.Parse(p[1]));
+                case "dest":
+                    byte[] a = System.Net.IPAddress.Parse(p[1]).GetAddressBytes();
+                    return new KeyValuePair<UInt32, UInt32>(PARAM_DEST_ADDR, (UInt32)(a[0] << 24 | a[1] << 16 | a[2] << 8 | a[3]));
+                case "destport":
+                    return new KeyValuePair<UInt32, UInt32>(PARAM_DEST_PORT, UInt16.Parse(p[1]));
+                default:
+                    throw new FormatException("param is batch, telemetry, dest or destport");
+            }
+        }
+
+        public override string ToString()
+        {
+            string status = (Status == STATUS_OK) ? "ok" : (Status == STATUS_PENDING) ? "pending" : (Status == STATUS_INVALID) ? "invalid" : "failed";
+
+            switch (Cmd)
+            {
+                case CMD_TIMING_GET:
+                case CMD_TIMING_SET:
+                case CMD_AUTOBAUD:
+                    return string.Format("CAN{0}: {1} kbps, sample {2:F1} %, {3}", Port + 1, Arg[0] / 1000, Arg[1] / 10.0, status);
+                case CMD_PARAM_GET:
+                case CMD_PARAM_SET:
+                    return string.Format("param {0} = {1}, {2}", Arg[0], Arg[1], status);
+                case CMD_FILTER_GET:
+                case CMD_FILTER_SET:
+                    return string.Format("filter {0}: {1:X8}/{2:X8}, {3}", Port, Arg[0], Arg[1], status);
+                case CMD_LANE_GET:
+                case CMD_LANE_SET:
+                    return string.Format("lane {0}: {1:X8}-{2:X8}, {3}", Port, Arg[0], Arg[1], status);
+                case CMD_SAVE:
+                    return "settings saved, " + status;
+                case CMD_DEFAULTS:
+                    return "defaults restored, " + status;
+                default:
+                    return string.Format("CAN{0}: command {1}, {2}", Port + 1, Cmd, status);
+            }
+        }
+    }
+}
@@ -7,14 +7,17 @@ using Wireshark;
 
 namespace canshark
 {
-    class CanMessage : ISerializer
+    class CanMessage : ISerializer, IRecord
     {
         public UInt32 Sec;
         public UInt32 Usec;
         public UInt32 COB;
         public byte[] Data = new byte[8];
         public UInt16 Time;
+        public UInt64 BitTime;      /* Time unwrapped by the board */
         public byte Source;
+        public bool Backlog;
+        public bool Passive;
 
         public int SerializeLen()
         {
@@ -31,7 +34,7 @@ namespace canshark
 
             // length
             bw.Write((byte)Data.Length);
-            bw.Write(Source);   // Source
+            bw.Write((byte)(Source | (Passive ? 0x40 : 0) | (Backlog ? 0x80 : 0)));   // Source
 
             // time
             bw.Write(Time);
@@ -40,7 +43,69 @@ namespace canshark
             bw.Write(Data);
         }
 
-        public static CanMessage DeserializeFrom(BinaryReader br)
+        public int SerializeLen(DataLinkType link)
+        {
+            return (link == DataLinkType.DLT_CAN_SOCKETCAN) ? 16 : SerializeLen();
+        }
+
+        public void SerializeTo(DataLinkType link, byte[] buffer, int offset)
+        {
+            if (link == DataLinkType.DLT_CAN_SOCKETCAN)
+                SerializeSocketCan(buffer, offset);
+            else
+                SerializeCanShark(buffer, offset);
+        }
+
+        /*
+         * struct can_frame, the id in network byte order. EFF, RTR and ERR flags
+         * are the same bits as in the COB, the 29 bit id is the std and ext part
+         * together. Port and direction go with the interface and the packet flags.
+         */
+        private void SerializeSocketCan(byte[] buffer, int offset)
+        {
+            UInt32 id = ((COB & 0x80000000) != 0) ? COB : (COB & 0xE0000000) | ((COB >> 18) & 0x7FF);
+
+            buffer[offset++] = (byte)(id >> 24);
+            buffer[offset++] = (byte)(id >> 16);
+            buffer[offset++] = (byte)(id >> 8);
+            buffer[offset++] = (byte)(id >> 0);
+
+            // length, flags, reserved, len8_dlc
+            buffer[offset++] = (byte)Data.Length;
+            buffer[offset++] = 0;
+            buffer[offset++] = 0;
+            buffer[offset++] = 0;
+
+            // DATA, padded to 8
+            Buffer.BlockCopy(Data, 0, buffer, offset, Data.Length);
+            for (int i = Data.Length; i < 8; i++)
+                buffer[offset + i] = 0;
+        }
+
+        private void SerializeCanShark(byte[] buffer, int offset)
+        {
+            // mob-id
+            buffer[offset++] = (byte)(COB >> 24);
+            buffer[offset++] = (byte)(COB >> 16);
+            buffer[offset++] = (byte)(COB >> 8);
+            buffer[offset++] = (byte)(COB >> 0);
+
+            // length
+            buffer[offset++] = (byte)Data.Length;
+            buffer[offset++] = (byte)(Source | (Passive ? 0x40 : 0) | (Backlog ? 0x80 : 0));   // Source
+
+            // time
+            buffer[offset++] = (byte)Time;
+            buffer[offset++] = (byte)(Time >> 8);
+
+            // DATA
+            Buffer.BlockCopy(Data, 0, buffer, offset, Data.Length);
+        }
+
+        /* host time */
+        public UInt64 Nanoseconds { get { return ((UInt64)Sec * 1000000 + Usec) * 1000; } }
+
+        public static CanMessage DeserializeFrom(BinaryReader br, TimeSync sync)
         {
             CanMessage msg = new CanMessage();
 
@@ -52,8 +117,11 @@ namespace canshark
             msg.Data = new byte[br.ReadByte()];
             Array.Copy(by, msg.Data, msg.Data.Length);
 
-            br.ReadBytes(7); /* PAD */
-            UInt64 ticks = br.ReadUInt64();
+            br.ReadByte(); /* isthere */
+            UInt64 hi = br.ReadUInt16();
+            UInt64 mid = br.ReadUInt32();
+            msg.BitTime = hi << 48 | mid << 16 | msg.Time;
+            UInt64 ticks = sync.Map(br.ReadUInt64());
 
             msg.Sec = (UInt32)(long)(ticks / (1000 * 1000));
             msg.Usec = (UInt32)((long)(ticks % (1000 * 1000)));
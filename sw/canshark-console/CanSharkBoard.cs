@@ -11,8 +11,49 @@ namespace canshark
 {
     class CanSharkBoard : IDisposable
     {
+        const int HEADER_LEN = 8;
+        const byte MAGIC = 0xCA;
+        const byte TYPE_FRAMES = 1;
+        const byte TYPE_TELEMETRY = 2;
+        const byte TYPE_CONTROL = 3;
+        const byte TYPE_SYNC = 4;
+        const byte TYPE_NMT = 6;
+        const byte TYPE_NODES = 7;
+        const byte TYPE_GEN = 8;
+        const byte TYPE_BENCH = 9;
+        const byte TYPE_BENCH_STEP = 10;
+        const byte FLAG_BACKLOG = 0x01;
+        const byte FLAG_LAST = 0x08;
+        const byte FLAG_SILENT = 0x10;      // shifted by port
+
+        /* request is sent again with the same id, the board answers a repeated change from its history */
+        const int REQUEST_TIMEOUT = 250;    // ms
+        const int REQUEST_RETRIES = 3;
+
+        class Pending
+        {
+            public BoardControl Req;
+            public DateTime Next;
+            public int Left;
+        }
+
         private bool exit;
+        private UdpClient ucl;
+        private IPEndPoint board;
+        private UInt16 requestId = (UInt16)Environment.TickCount;   /* ids of the previous run may be in the history */
+        private Dictionary<UInt16, Pending> pending = new Dictionary<UInt16, Pending>();
+        private Dictionary<IPEndPoint, TimeSync> syncs = new Dictionary<IPEndPoint, TimeSync>();
+
         public event  EventHandler<CanMessage> MessageReceived;
+        public event  EventHandler<Telemetry> TelemetryReceived;
+        public event  EventHandler<BoardControl> ControlReceived;
+        public event  EventHandler<BoardControl> ControlLost;
+        public event  EventHandler<NodeEvent> NodeEventReceived;
+        public event  EventHandler<NodeTable> NodeTableReceived;
+        public event  EventHandler<GeneratorConfig> GeneratorReceived;
+        public event  EventHandler<BenchConfig> BenchReceived;
+        public event  EventHandler<BenchReport> BenchReported;
+        public event  EventHandler<IPEndPoint> BoardFound;
 
         public CanSharkBoard()
         {
@@ -21,35 +62,269 @@ namespace canshark
 
         private void thread()
         {
-            UdpClient ucl = new UdpClient(6000);
+            ucl = new UdpClient(6000);
+            ucl.EnableBroadcast = true;
+
             IAsyncResult iar = ucl.BeginReceive(null, null);
+            UInt16 syncSeq = 0;
+            DateTime syncNext = DateTime.UtcNow;
 
             while (!exit)
             {
-                if (!iar.AsyncWaitHandle.WaitOne(1000))
+                if (DateTime.UtcNow >= syncNext)
+                {
+                    syncNext = syncNext.AddMilliseconds(TimeSync.INTERVAL);
+                    SendSync(++syncSeq);
+                }
+
+                Retry();
+
+                if (!iar.AsyncWaitHandle.WaitOne(100))
                     continue;
 
                 IPEndPoint ep = new IPEndPoint(0, 0);
                 byte[] data = ucl.EndReceive(iar, ref ep);
+                UInt64 rx = TimeSync.Now;
                 iar = ucl.BeginReceive(null, 0);
 
+                if ((data.Length < HEADER_LEN) || (data[0] != MAGIC))
+                    continue;
+
+                /* own sync broadcast is looped back */
+                if ((data[1] == TYPE_SYNC) && (data.Length > HEADER_LEN) &&
+                    ((data[HEADER_LEN] == TimeSync.SYNC) || (data[HEADER_LEN] == TimeSync.FOLLOW_UP) || (data[HEADER_LEN] == TimeSync.DELAY_RESP)))
+                    continue;
+
+                TimeSync sync;
+                if (!syncs.TryGetValue(ep, out sync))
+                    syncs[ep] = sync = new TimeSync();
+
+                if (board == null)
+                {
+                    board = ep;
+                    if (BoardFound != null)
+                        BoardFound(this, ep);
+                }
+
                 using (MemoryStream ms = new MemoryStream(data))
                 {
                     BinaryReader br = new BinaryReader(ms);
-                    
-                    while (ms.Position < ms.Length)
+
+                    /* datagram header */
+                    br.ReadByte(); /* magic */
+                    byte type = br.ReadByte();
+                    byte flags = br.ReadByte();
+                    byte count = br.ReadByte();
+                    br.ReadUInt32(); /* seq */
+
+                    if (type == TYPE_TELEMETRY)
+                    {
+                        if (TelemetryReceived != null)
+                            TelemetryReceived(this, Telemetry.DeserializeFrom(br));
+                        continue;
+                    }
+
+                    if (type == TYPE_SYNC)
+                    {
+                        TimeSync.Message msg = TimeSync.Message.DeserializeFrom(br);
+
+                        if (msg.Kind == TimeSync.DELAY_REQ)
+                        {
+                            msg.Kind = TimeSync.DELAY_RESP;
+                            msg.Time = rx;
+                            Send(ep, TYPE_SYNC, msg.Seq, msg.SerializeTo);
+                        }
+                        else if (msg.Kind == TimeSync.STATUS)
+                        {
+                            sync.Update(msg);
+                        }
+                        continue;
+                    }
+
+                    if (type == TYPE_CONTROL)
+                    {
+                        for (int i = 0; i < count; i++)
+                        {
+                            BoardControl rep = BoardControl.DeserializeFrom(br);
+
+                            /* pending reply is followed by the final one */
+                            if (rep.Status != BoardControl.STATUS_PENDING)
+                                lock (pending)
+                                    pending.Remove(rep.Id);
+
+                            if (ControlReceived != null)
+                                ControlReceived(this, rep);
+                        }
+                        continue;
+                    }
+
+                    if (type == TYPE_NMT)
                     {
-                        CanMessage m = CanMessage.DeserializeFrom(br);
+                        for (int i = 0; i < count; i++)
+                            if (NodeEventReceived != null)
+                                NodeEventReceived(this, NodeEvent.DeserializeFrom(br));
+                        continue;
+                    }
+
+                    if (type == TYPE_NODES)
+                    {
+                        for (int i = 0; i < count; i++)
+                            if (NodeTableReceived != null)
+                                NodeTableReceived(this, NodeTable.DeserializeFrom(br));
+                        continue;
+                    }
+
+                    if (type == TYPE_GEN)
+                    {
+                        if (GeneratorReceived != null)
+                            GeneratorReceived(this, GeneratorConfig.DeserializeFrom(br));
+                        continue;
+                    }
+
+                    if (type == TYPE_BENCH)
+                    {
+                        if (BenchReceived != null)
+                            BenchReceived(this, BenchConfig.DeserializeFrom(br));
+                        continue;
+                    }
+
+                    if (type == TYPE_BENCH_STEP)
+                    {
+                        BenchReport rep = BenchReport.DeserializeFrom(br);
+                        rep.Last = (flags & FLAG_LAST) != 0;
+
+                        if (BenchReported != null)
+                            BenchReported(this, rep);
+                        continue;
+                    }
+
+                    if (type != TYPE_FRAMES)
+                        continue;
+
+                    for (int i = 0; i < count; i++)
+                    {
+                        CanMessage m = CanMessage.DeserializeFrom(br, sync);
+                        m.Backlog = (flags & FLAG_BACKLOG) != 0;
+                        m.Passive = (flags & (FLAG_SILENT << ((m.Source & 7) - 1))) != 0;
 
                         if (MessageReceived != null)
                             MessageReceived(this, m);
-                    }                    
+                    }
                 }
             }
 
             ucl.Close();
         }
 
+        /*
+         * sends the request to the board, reply comes by ControlReceived with the same id,
+         * ControlLost when none came after the retries
+         */
+        public UInt16 Request(byte cmd, byte port, UInt32 arg0, UInt32 arg1, int timeout = REQUEST_TIMEOUT, int retries = REQUEST_RETRIES)
+        {
+            BoardControl req = new BoardControl() { Id = ++requestId, Cmd = cmd, Port = port };
+            req.Arg[0] = arg0;
+            req.Arg[1] = arg1;
+
+            lock (pending)
+                pending[req.Id] = new Pending() { Req = req, Next = DateTime.UtcNow.AddMilliseconds(timeout), Left = retries };
+
+            Send(board, TYPE_CONTROL, req.Id, req.SerializeTo);
+            return req.Id;
+        }
+
+        /* resends the requests not answered in time, receive thread */
+        private void Retry()
+        {
+            DateTime now = DateTime.UtcNow;
+            List<BoardControl> lost = new List<BoardControl>();
+
+            lock (pending)
+            {
+                foreach (Pending p in pending.Values.Where(x => now >= x.Next).ToList())
+                {
+                    if (p.Left-- == 0)
+                    {
+                        pending.Remove(p.Req.Id);
+                        lost.Add(p.Req);
+                        continue;
+                    }
+
+                    p.Next = now.AddMilliseconds(REQUEST_TIMEOUT);
+                    Send(board, TYPE_CONTROL, p.Req.Id, p.Req.SerializeTo);
+                }
+            }
+
+            foreach (BoardControl req in lost)
+                if (ControlLost != null)
+                    ControlLost(this, req);
+        }
+
+        #region Typed control
+        public UInt16 GetTiming(byte port) { return Request(BoardControl.CMD_TIMING_GET, port, 0, 0); }
+        public UInt16 SetTiming(byte port, UInt32 bitrate, UInt16 sample) { return Request(BoardControl.CMD_TIMING_SET, port, bitrate, sample); }
+        /* replied pending, the final reply comes once locked */
+        public UInt16 Autobaud(byte port, int timeout) { return Request(BoardControl.CMD_AUTOBAUD, port, 0, 0, timeout, 0); }
+        public UInt16 SetSilent(byte port, bool silent) { return Request(BoardControl.CMD_SILENT_SET, port, silent ? 1u : 0u, 0); }
+        public UInt16 SetNmtFilter(byte port, bool filter) { return Request(BoardControl.CMD_NMT_FILTER, port, filter ? 1u : 0u, 0); }
+        public UInt16 GetFilter(byte idx) { return Request(BoardControl.CMD_FILTER_GET, idx, 0, 0); }
+        /* mask 0 leaves the entry unused */
+        public UInt16 SetFilter(byte idx, UInt32 mobid, UInt32 mask) { return Request(BoardControl.CMD_FILTER_SET, idx, mobid, mask); }
+        public UInt16 GetLane(byte idx) { return Request(BoardControl.CMD_LANE_GET, idx, 0, 0); }
+        /* first above last leaves the range unused */
+        public UInt16 SetLane(byte idx, UInt32 first, UInt32 last) { return Request(BoardControl.CMD_LANE_SET, idx, first, last); }
+        public UInt16 GetParam(UInt32 param) { return Request(BoardControl.CMD_PARAM_GET, 0, param, 0); }
+        public UInt16 SetParam(UInt32 param, UInt32 value) { return Request(BoardControl.CMD_PARAM_SET, 0, param, value); }
+        /* capture stalls while the flash is written */
+        public UInt16 SaveSettings() { return Request(BoardControl.CMD_SAVE, 0, 0, 0); }
+        public UInt16 RestoreDefaults() { return Request(BoardControl.CMD_DEFAULTS, 0, 0, 0); }
+        #endregion
+
+        /* starts or stops the generator, reply comes by GeneratorReceived */
+        public void Generate(GeneratorConfig cfg)
+        {
+            Send(board, TYPE_GEN, ++requestId, cfg.SerializeTo);
+        }
+
+        /* starts or stops the benchmark, steps come by BenchReported */
+        public void Bench(BenchConfig cfg)
+        {
+            Send(board, TYPE_BENCH, ++requestId, cfg.SerializeTo);
+        }
+
+        /* single record datagram */
+        private void Send(IPEndPoint ep, byte type, UInt32 seq, Action<BinaryWriter> record)
+        {
+            using (MemoryStream ms = new MemoryStream())
+            {
+                BinaryWriter bw = new BinaryWriter(ms);
+
+                bw.Write(MAGIC);
+                bw.Write(type);
+                bw.Write((byte)0); /* flags */
+                bw.Write((byte)1); /* count */
+                bw.Write(seq);
+                record(bw);
+
+                byte[] data = ms.ToArray();
+                ucl.Send(data, data.Length, ep);
+            }
+        }
+
+        /* clock sync master, follow up carries the time the sync really left */
+        private void SendSync(UInt16 seq)
+        {
+            IPEndPoint ep = new IPEndPoint(IPAddress.Broadcast, 6000);
+            TimeSync.Message msg = new TimeSync.Message() { Kind = TimeSync.SYNC, Seq = seq };
+
+            UInt64 t1 = TimeSync.Now;
+            Send(ep, TYPE_SYNC, seq, msg.SerializeTo);
+
+            msg.Kind = TimeSync.FOLLOW_UP;
+            msg.Time = t1;
+            Send(ep, TYPE_SYNC, seq, msg.SerializeTo);
+        }
+
         public void Dispose()
         {
             exit = true;
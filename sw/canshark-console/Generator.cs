@@ -0,0 +1,155 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text;
+
+namespace canshark
+{
+    /* traffic generator of the port, struct modgen_config */
+    class GeneratorConfig
+    {
+        public const byte IDS_FIXED = 0;
+        public const byte IDS_RANDOM = 1;
+        public const byte IDS_SKEWED = 2;
+        public const byte IDS_EXT = 0x80;
+
+        public byte Port;
+        public byte Ids = IDS_FIXED;
+        public byte DlcMin = 0;
+        public byte DlcMax = 8;
+        public UInt16 Load;                 // permille, 0 stops
+        public UInt16 Burst;                // frames back to back
+        public UInt32 IdFirst = 0x100;
+        public UInt32 IdCount = 0x80;
+        public UInt32 Seed = 1;
+        public byte Status;                 // reply only, BoardControl.STATUS_*
+
+        public void SerializeTo(BinaryWriter bw)
+        {
+            bw.Write(Port);
+            bw.Write(Ids);
+            bw.Write(DlcMin);
+            bw.Write(DlcMax);
+            bw.Write(Load);
+            bw.Write(Burst);
+            bw.Write(IdFirst);
+            bw.Write(IdCount);
+            bw.Write(Seed);
+            bw.Write(Status);
+            bw.Write(new byte[3]); /* reserved */
+        }
+
+        public static GeneratorConfig DeserializeFrom(BinaryReader br)
+        {
+            GeneratorConfig c = new GeneratorConfig();
+
+            c.Port = br.ReadByte();
+            c.Ids = br.ReadByte();
+            c.DlcMin = br.ReadByte();
+            c.DlcMax = br.ReadByte();
+            c.Load = br.ReadUInt16();
+            c.Burst = br.ReadUInt16();
+            c.IdFirst = br.ReadUInt32();
+            c.IdCount = br.ReadUInt32();
+            c.Seed = br.ReadUInt32();
+            c.Status = br.ReadByte();
+            br.ReadBytes(3); /* reserved */
+
+            return c;
+        }
+
+        /* PORT,LOAD%[,fixed|random|skewed[,BURST[,SEED]]] */
+        public static GeneratorConfig Parse(string spec)
+        {
+            string[] p = spec.Split(',');
+            GeneratorConfig c = new GeneratorConfig();
+
+            c.Port = (byte)(byte.Parse(p[0]) - 1);
+            c.Load = (UInt16)(double.Parse(p[1], System.Globalization.CultureInfo.InvariantCulture) * 10);
+
+            if (p.Length > 2)
+                c.Ids = (p[2] == "random") ? IDS_RANDOM : (p[2] == "skewed") ? IDS_SKEWED : IDS_FIXED;
+            if (p.Length > 3)
+                c.Burst = UInt16.Parse(p[3]);
+            if (p.Length > 4)
+                c.Seed = UInt32.Parse(p[4]);
+
+            return c;
+        }
+
+        public override string ToString()
+        {
+            return string.Format("generator CAN{0} {1}.{2}% {3}", Port + 1, Load / 10, Load % 10,
+                (Status == BoardControl.STATUS_OK) ? "started" : "refused " + Status);
+        }
+    }
+
+    /* checks the sequence tag of the generated frames seen in the capture */
+    class GeneratorCheck
+    {
+        private GeneratorConfig cfg;
+        private UInt32 expected;
+
+        public UInt32 Received;
+        public UInt32 Lost;
+        public UInt32 Reordered;
+
+        public GeneratorCheck(GeneratorConfig cfg)
+        {
+            this.cfg = cfg;
+        }
+
+        private bool IsGenerated(CanMessage m)
+        {
+            if (((m.Source & 0x07) != cfg.Port + 1) || ((m.Source & 0x08) == 0))
+                return false;
+
+            bool ext = (m.COB & 0x80000000) != 0;
+            if (ext != ((cfg.Ids & GeneratorConfig.IDS_EXT) != 0))
+                return false;
+
+            UInt32 id = ext ? (m.COB & 0x1FFFFFFF) : ((m.COB >> 18) & 0x7FF);
+            return (id >= cfg.IdFirst) && (id - cfg.IdFirst < cfg.IdCount);
+        }
+
+        /* short frames carry only low bytes of the sequence, compared modulo */
+        public void Check(CanMessage m)
+        {
+            if (!IsGenerated(m))
+                return;
+
+            int n = Math.Min(m.Data.Length, 4);
+            UInt32 mask = (n == 4) ? UInt32.MaxValue : (1u << (n * 8)) - 1;
+            UInt32 seq = 0;
+            for (int i = 0; i < n; i++)
+                seq |= (UInt32)m.Data[i] << (i * 8);
+
+            UInt32 gap = (seq - expected) & mask;
+            Received++;
+
+            if (n == 0)
+            {
+                expected++;
+                return;
+            }
+
+            if (gap > (mask >> 1))
+            {
+                /* older than expected, already counted as lost */
+                Reordered++;
+                if (Lost > 0)
+                    Lost--;
+                return;
+            }
+
+            Lost += gap;
+            expected = expected + gap + 1;
+        }
+
+        public override string ToString()
+        {
+            return string.Format("gen {0} rx, {1} lost, {2} reordered", Received, Lost, Reordered);
+        }
+    }
+}
@@ -0,0 +1,102 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text;
+
+namespace canshark
+{
+    /* change of the node seen by the board, struct modnmt_event */
+    class NodeEvent
+    {
+        public const byte ALIVE = 1;
+        public const byte STATE = 2;
+        public const byte TIMEOUT = 3;
+
+        public const byte STATE_UNKNOWN = 0xFF;
+
+        public byte Port;
+        public byte Node;
+        public byte Kind;
+        public byte State;              // CANopen NMT state
+        public byte Prev;
+        public UInt64 Ticks;            // us, last heartbeat
+        public UInt32 Period;           // us, 0 unknown
+        public UInt32 Silence;          // us since last heartbeat
+
+        public static NodeEvent DeserializeFrom(BinaryReader br)
+        {
+            NodeEvent e = new NodeEvent();
+
+            e.Port = br.ReadByte();
+            e.Node = br.ReadByte();
+            e.Kind = br.ReadByte();
+            e.State = br.ReadByte();
+            e.Prev = br.ReadByte();
+            br.ReadBytes(3); /* reserved */
+            e.Ticks = br.ReadUInt64();
+            e.Period = br.ReadUInt32();
+            e.Silence = br.ReadUInt32();
+
+            return e;
+        }
+
+        public static string StateName(byte state)
+        {
+            switch (state)
+            {
+                case 0: return "boot";
+                case 4: return "stopped";
+                case 5: return "operational";
+                case 127: return "pre-operational";
+                case STATE_UNKNOWN: return "unknown";
+                default: return state.ToString();
+            }
+        }
+
+        public override string ToString()
+        {
+            if (Kind == TIMEOUT)
+                return string.Format("CAN{0} node {1}: heartbeat lost after {2} ms", Port + 1, Node, Silence / 1000);
+
+            return string.Format("CAN{0} node {1}: {2} -> {3}, period {4} ms", Port + 1, Node, StateName(Prev), StateName(State), Period / 1000);
+        }
+    }
+
+    /* node table digest of the port, struct modnmt_digest */
+    class NodeTable
+    {
+        public const byte STATE_LOST = 0x80;
+
+        public byte Port;
+        public byte Alive;
+        public byte Lost;
+        public bool[] Seen = new bool[128];
+        public byte[] State = new byte[128];    // STATE_LOST or-ed when timed out
+
+        public static NodeTable DeserializeFrom(BinaryReader br)
+        {
+            NodeTable t = new NodeTable();
+
+            t.Port = br.ReadByte();
+            t.Alive = br.ReadByte();
+            t.Lost = br.ReadByte();
+            br.ReadByte(); /* reserved */
+
+            for (int w = 0; w < 4; w++)
+            {
+                UInt32 mask = br.ReadUInt32();
+                for (int b = 0; b < 32; b++)
+                    t.Seen[w * 32 + b] = (mask & (1u << b)) != 0;
+            }
+
+            t.State = br.ReadBytes(128);
+            return t;
+        }
+
+        public override string ToString()
+        {
+            return string.Format("CAN{0} {1} nodes alive, {2} lost", Port + 1, Alive, Lost);
+        }
+    }
+}
@@ -0,0 +1,330 @@
+﻿using System;
+using System.Collections.Concurrent;
+using System.Collections.Generic;
+using System.IO;
+using System.Text;
+using System.Threading;
+
+namespace Wireshark
+{
+    /*
+     * pcapng writer, https://www.ietf.org/archive/id/draft-ietf-opsawg-pcapng-01.html
+     * Blocks are serialized into large buffers on the calling thread, full buffers
+     * are written whole by the writer thread. A partial buffer is written after
+     * FLUSH ms, the live pipe gets the frames in time. The caller waits only when
+     * all the buffers are queued for the write.
+     */
+    class PcapNgWriter : IDisposable
+    {
+        public const int BUFFER = 1 << 20;      /* bytes, one write */
+        public const int BUFFERS = 8;
+        public const int FLUSH = 100;           /* ms */
+        public const byte TSRESOL = 9;          /* ns */
+
+        const UInt32 BT_SHB = 0x0A0D0D0A;
+        const UInt32 BT_IDB = 0x00000001;
+        const UInt32 BT_ISB = 0x00000005;
+        const UInt32 BT_EPB = 0x00000006;
+        const UInt32 BYTE_ORDER = 0x1A2B3C4D;
+
+        const UInt16 OPT_END = 0;
+        const UInt16 SHB_USERAPPL = 4;
+        const UInt16 IF_NAME = 2;
+        const UInt16 IF_DESCRIPTION = 3;
+        const UInt16 IF_TSRESOL = 9;
+        const UInt16 EPB_FLAGS = 2;
+        const UInt16 ISB_IFRECV = 4;
+        const UInt16 ISB_IFDROP = 5;
+        const UInt16 ISB_OSDROP = 7;
+        const UInt16 ISB_USRDELIV = 8;
+
+        const UInt32 EPB_INBOUND = 1;
+        const UInt32 EPB_OUTBOUND = 2;
+
+        struct Chunk
+        {
+            public byte[] Data;
+            public int Length;
+        }
+
+        private Stream stm;
+        private object lck = new object();
+        private byte[] cur;
+        private int pos;
+        private BlockingCollection<Chunk> full = new BlockingCollection<Chunk>();
+        private BlockingCollection<byte[]> free = new BlockingCollection<byte[]>();
+        private List<UInt64> delivered = new List<UInt64>();
+        private List<DataLinkType> links = new List<DataLinkType>();
+        private Thread thr;
+        private volatile bool failed;
+        private bool closed;
+
+        public long Frames;             /* written by the caller */
+        public long Bytes;              /* written to the stream */
+        public long Writes;
+        public long Waits;              /* caller waited for a free buffer */
+
+        public bool Connected { get { return !failed; } }
+
+        public PcapNgWriter(Stream stm, string application)
+        {
+            this.stm = stm;
+
+            for (int i = 0; i < BUFFERS; i++)
+                free.Add(new byte[BUFFER]);
+            cur = free.Take();
+
+            /* section header */
+            lock (lck)
+            {
+                int len = 28 + Opt(application) + 4;
+                int p = Begin(BT_SHB, len);
+                Put32(cur, ref p, BYTE_ORDER);
+                Put16(cur, ref p, 1);
+                Put16(cur, ref p, 0);
+                Put64(cur, ref p, UInt64.MaxValue);     /* section length unknown */
+                PutOpt(cur, ref p, SHB_USERAPPL, application);
+                Put32(cur, ref p, OPT_END);
+                End(p, len);
+            }
+
+            thr = new Thread(thread) { IsBackground = true, Name = "pcapng" };
+            thr.Start();
+        }
+
+        #region Serialization
+        static void Put16(byte[] b, ref int p, UInt16 v)
+        {
+            b[p++] = (byte)v;
+            b[p++] = (byte)(v >> 8);
+        }
+
+        static void Put32(byte[] b, ref int p, UInt32 v)
+        {
+            b[p++] = (byte)v;
+            b[p++] = (byte)(v >> 8);
+            b[p++] = (byte)(v >> 16);
+            b[p++] = (byte)(v >> 24);
+        }
+
+        static void Put64(byte[] b, ref int p, UInt64 v)
+        {
+            Put32(b, ref p, (UInt32)v);
+            Put32(b, ref p, (UInt32)(v >> 32));
+        }
+
+        static int Pad(int len)
+        {
+            return (len + 3) & ~3;
+        }
+
+        /* option with the string value, bytes taken */
+        static int Opt(string value)
+        {
+            return 4 + Pad(Encoding.UTF8.GetByteCount(value));
+        }
+
+        static void PutOpt(byte[] b, ref int p, UInt16 code, string value)
+        {
+            int n = Encoding.UTF8.GetBytes(value, 0, value.Length, b, p + 4);
+            Put16(b, ref p, code);
+            Put16(b, ref p, (UInt16)n);
+            p += n;
+            while ((p & 3) != 0)
+                b[p++] = 0;
+        }
+
+        static void PutOpt(byte[] b, ref int p, UInt16 code, UInt64 value)
+        {
+            Put16(b, ref p, code);
+            Put16(b, ref p, 8);
+            Put64(b, ref p, value);
+        }
+
+        static void PutTime(byte[] b, ref int p, UInt64 ns)
+        {
+            Put32(b, ref p, (UInt32)(ns >> 32));
+            Put32(b, ref p, (UInt32)ns);
+        }
+
+        /* room for the block in the buffer, lock held */
+        private int Begin(UInt32 type, int len)
+        {
+            if (pos + len > BUFFER)
+                Swap(true);
+
+            int p = pos;
+            Put32(cur, ref p, type);
+            Put32(cur, ref p, (UInt32)len);
+            return p;
+        }
+
+        private void End(int p, int len)
+        {
+            Put32(cur, ref p, (UInt32)len);
+            pos = p;
+        }
+
+        /* buffer queued for the write, lock held */
+        private void Swap(bool wait)
+        {
+            byte[] next;
+            if (!free.TryTake(out next))
+            {
+                if (!wait)
+                    return;
+
+                Interlocked.Increment(ref Waits);
+                next = free.Take();
+            }
+
+            full.Add(new Chunk() { Data = cur, Length = pos });
+            cur = next;
+            pos = 0;
+        }
+        #endregion
+
+        /* interface description, the id returned */
+        public int AddInterface(DataLinkType link, UInt32 snaplen, string name, string description)
+        {
+            lock (lck)
+            {
+                int len = 20 + Opt(name) + Opt(description) + 8 + 4;
+                int p = Begin(BT_IDB, len);
+                Put16(cur, ref p, (UInt16)link);
+                Put16(cur, ref p, 0);
+                Put32(cur, ref p, snaplen);
+                PutOpt(cur, ref p, IF_NAME, name);
+                PutOpt(cur, ref p, IF_DESCRIPTION, description);
+                Put16(cur, ref p, IF_TSRESOL);
+                Put16(cur, ref p, 1);
+                Put32(cur, ref p, TSRESOL);             /* value byte, padding */
+                Put32(cur, ref p, OPT_END);
+                End(p, len);
+
+                delivered.Add(0);
+                links.Add(link);
+                return delivered.Count - 1;
+            }
+        }
+
+        /* enhanced packet, direction in the flags */
+        public void WriteFrame(int iface, UInt64 ns, bool outbound, IRecord data)
+        {
+            if (failed)
+                return;
+
+            lock (lck)
+            {
+                if (closed)
+                    return;
+
+                DataLinkType link = links[iface];
+                int dlen = data.SerializeLen(link);
+                int len = 28 + Pad(dlen) + 12 + 4;
+
+                int p = Begin(BT_EPB, len);
+                Put32(cur, ref p, (UInt32)iface);
+                PutTime(cur, ref p, ns);
+                Put32(cur, ref p, (UInt32)dlen);
+                Put32(cur, ref p, (UInt32)dlen);
+                data.SerializeTo(link, cur, p);
+                p += dlen;
+                while ((p & 3) != 0)
+                    cur[p++] = 0;
+                Put16(cur, ref p, EPB_FLAGS);
+                Put16(cur, ref p, 4);
+                Put32(cur, ref p, outbound ? EPB_OUTBOUND : EPB_INBOUND);
+                Put32(cur, ref p, OPT_END);
+                End(p, len);
+
+                delivered[iface]++;
+                Frames++;
+            }
+        }
+
+        /* interface statistics, counters of the board; dropped by the hw, by the board */
+        public void WriteStatistics(int iface, UInt64 ns, UInt64 received, UInt64 dropped, UInt64 osdropped)
+        {
+            if (failed)
+                return;
+
+            int len = 20 + 4 * 12 + 4 + 4;
+
+            lock (lck)
+            {
+                if (closed)
+                    return;
+
+                int p = Begin(BT_ISB, len);
+                Put32(cur, ref p, (UInt32)iface);
+                PutTime(cur, ref p, ns);
+                PutOpt(cur, ref p, ISB_IFRECV, received);
+                PutOpt(cur, ref p, ISB_IFDROP, dropped);
+                PutOpt(cur, ref p, ISB_OSDROP, osdropped);
+                PutOpt(cur, ref p, ISB_USRDELIV, delivered[iface]);
+                Put32(cur, ref p, OPT_END);
+                End(p, len);
+            }
+        }
+
+        private void thread()
+        {
+            while (!full.IsCompleted)
+            {
+                Chunk c;
+
+                if (!full.TryTake(out c, FLUSH))
+                {
+                    /* idle, the partial buffer goes out; never waits, the buffers are all free here */
+                    lock (lck)
+                        if (pos > 0)
+                            Swap(false);
+
+                    if (!full.TryTake(out c))
+                        continue;
+                }
+
+                try
+                {
+                    if (!failed)
+                    {
+                        stm.Write(c.Data, 0, c.Length);
+                        if (full.Count == 0)
+                            stm.Flush();
+
+                        Bytes += c.Length;
+                        Writes++;
+                    }
+                }
+                catch (IOException)
+                {
+                    failed = true;
+                }
+                catch (ObjectDisposedException)
+                {
+                    failed = true;
+                }
+
+                free.Add(c.Data);
+            }
+        }
+
+        /* the rest is written, the stream stays open */
+        public void Dispose()
+        {
+            lock (lck)
+            {
+                if (closed)
+                    return;
+                closed = true;
+
+                if (pos > 0)
+                    Swap(true);
+                full.CompleteAdding();
+            }
+
+            thr.Join();
+        }
+    }
+}
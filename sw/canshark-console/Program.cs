@@ -19,6 +19,21 @@ namespace canshark
         static string OptWiresharkExecutable = @"C:\program files\wireshark\wireshark.exe";
         static string OptWiresharkPipeName = "Wireshark";
         static string OptCanDumpFile = "";
+        static UInt32 OptBitrate = 0;
+        static UInt16 OptSample = 875;
+        static bool OptAutobaud = false;
+        static bool OptSilent = false;
+        static bool OptNmt = false;
+        static List<GeneratorConfig> OptGenerators = new List<GeneratorConfig>();
+        static BenchConfig OptBench = null;
+        static List<KeyValuePair<UInt32, UInt32>> OptParams = new List<KeyValuePair<UInt32, UInt32>>();
+        static bool OptSave = false;
+        static bool OptDefaults = false;
+        static int OptThroughput = 0;
+        static DataLinkType OptFormat = DataLinkType.DLT_USER0;
+
+        const int PORTS = 2;
+        const string APPLICATION = "canshark 0.0.0";
 
 
         static void DisplayVersion()
@@ -41,7 +56,18 @@ namespace canshark
             Console.WriteLine();
             Console.WriteLine("  -w PATH   --wireshark PATH    Set wireshark executable PATH");
             Console.WriteLine("  -p NAME   --pipe NAME         Set wireshark communication pipe NAME");
-            Console.WriteLine("  -d DUMP   --dump DUMP         Set CAN dump file (*.pcap) for later analysis");
+            Console.WriteLine("  -d DUMP   --dump DUMP         Set CAN dump file (*.pcapng) for later analysis");
+            Console.WriteLine("  -b RATE   --bitrate RATE      Set bit RATE [kbps] of both ports, RATE@SP with sample point [permille]");
+            Console.WriteLine("  -a        --autobaud          Detect bit rate of both ports");
+            Console.WriteLine("  -s        --silent            Listen only, never drive the bus");
+            Console.WriteLine("  -n        --nmt               Heartbeats not captured, board reports node changes only");
+            Console.WriteLine("  -g SPEC   --generate SPEC     Generate traffic, SPEC is PORT,LOAD%[,fixed|random|skewed[,BURST[,SEED]]]");
+            Console.WriteLine("  -B SPEC   --bench SPEC        Capture loss benchmark, CAN1 wired to CAN2, SPEC is FIRST%:LAST%:STEP%[:MS]");
+            Console.WriteLine("  -P SPEC   --param SPEC        Set board parameter, SPEC is batch=US, telemetry=MS, dest=IP or destport=PORT");
+            Console.WriteLine("  -S        --save              Save the settings to the board flash, used from its next power up");
+            Console.WriteLine("  -D        --defaults          Drop the settings saved in the board flash");
+            Console.WriteLine("  -f FORMAT --format FORMAT     Capture records, FORMAT is canshark (dissector/*.lua) or socketcan (Wireshark's CAN dissector)");
+            Console.WriteLine("  -T COUNT  --throughput COUNT  Measure the dump writer, COUNT generated frames to DUMP, no board");
             Console.WriteLine("  -v        --version           Display version information");
             Console.WriteLine("  -h        --help              Display this message");
             Console.WriteLine();
@@ -50,13 +76,78 @@ namespace canshark
             Console.WriteLine("  -w " + OptWiresharkExecutable);
             Console.WriteLine("  -p " + OptWiresharkPipeName);
             Console.WriteLine("  -d " + OptCanDumpFile);
+            Console.WriteLine("  -f canshark");
             Console.WriteLine();
             Environment.Exit(0);
         }
 
+        /* record format of the option */
+        static DataLinkType ParseFormat(string format)
+        {
+            switch (format)
+            {
+                case "canshark":
+                    return DataLinkType.DLT_USER0;
+
+                case "socketcan":
+                    return DataLinkType.DLT_CAN_SOCKETCAN;
+
+                default:
+                    throw new ArgumentException("unknown capture format " + format);
+            }
+        }
+
+        /* interface of each port, the same ids in every stream */
+        static PcapNgWriter OpenCapture(Stream stm)
+        {
+            PcapNgWriter w = new PcapNgWriter(stm, APPLICATION);
+
+            for (int port = 0; port < PORTS; port++)
+                w.AddInterface(OptFormat, 16, "CAN" + (port + 1), "canshark port CAN" + (port + 1));
+
+            return w;
+        }
+
+        static void WriteCapture(PcapNgWriter w, CanMessage m)
+        {
+            int port = (m.Source & 0x07) - 1;
+            if ((port >= 0) && (port < PORTS))
+                w.WriteFrame(port, m.Nanoseconds, (m.Source & 0x08) != 0, m);
+        }
+
+        /* frames of the typical PDO traffic through the writer, as fast as it takes them */
+        static void MeasureCapture(string path, int count)
+        {
+            CanMessage m = new CanMessage() { COB = 0x181u << 18, Source = 1, Data = new byte[8] };
+            UInt64 t = TimeSync.Now;
+
+            using (FileStream file = new FileStream(path, FileMode.Create, FileAccess.Write, FileShare.None, 4096))
+            {
+                PcapNgWriter w = OpenCapture(file);
+                Stopwatch sw = Stopwatch.StartNew();
+
+                for (int i = 0; i < count; i++)
+                {
+                    m.Sec = (UInt32)((t + (UInt64)i * 100) / 1000000);
+                    m.Usec = (UInt32)((t + (UInt64)i * 100) % 1000000);
+                    m.Time = (UInt16)i;
+                    m.Data[0] = (byte)i;
+                    m.Source = (byte)(1 + (i & 1));
+                    WriteCapture(w, m);
+                }
+
+                double queued = sw.Elapsed.TotalSeconds;
+                w.Dispose();
+                double written = sw.Elapsed.TotalSeconds;
+
+                Console.WriteLine(string.Format("{0} frames, queued at {1:F0} frame/s, written at {2:F0} frame/s, {3:F1} MB/s, {4} writes, caller waited {5}x",
+                    count, count / queued, count / written, w.Bytes / written / 1e6, w.Writes, w.Waits));
+            }
+        }
+
         static void Main(string[] args)
         {
-            List<WiresharkPcapProtocol> streams = new List<WiresharkPcapProtocol>();
+            List<PcapNgWriter> streams = new List<PcapNgWriter>();
             NamedPipeServerStream wireshark = null;
             FileStream file = null;
 
@@ -85,9 +176,63 @@ namespace canshark
                     case "-d":
                     case "--dump":
                         OptCanDumpFile = args[++i]; continue;
+
+                    case "-b":
+                    case "--bitrate":
+                        string[] br = args[++i].Split('@');
+                        OptBitrate = UInt32.Parse(br[0]) * 1000;
+                        if (br.Length > 1)
+                            OptSample = UInt16.Parse(br[1]);
+                        continue;
+
+                    case "-a":
+                    case "--autobaud":
+                        OptAutobaud = true; continue;
+
+                    case "-s":
+                    case "--silent":
+                        OptSilent = true; continue;
+
+                    case "-n":
+                    case "--nmt":
+                        OptNmt = true; continue;
+
+                    case "-g":
+                    case "--generate":
+                        OptGenerators.Add(GeneratorConfig.Parse(args[++i])); continue;
+
+                    case "-B":
+                    case "--bench":
+                        OptBench = BenchConfig.Parse(args[++i]); continue;
+
+                    case "-P":
+                    case "--param":
+                        OptParams.Add(BoardControl.ParseParam(args[++i])); continue;
+
+                    case "-S":
+                    case "--save":
+                        OptSave = true; continue;
+
+                    case "-D":
+                    case "--defaults":
+                        OptDefaults = true; continue;
+
+                    case "-T":
+                    case "--throughput":
+                        OptThroughput = int.Parse(args[++i]); continue;
+
+                    case "-f":
+                    case "--format":
+                        OptFormat = ParseFormat(args[++i]); continue;
                 }
             }
 
+            if (OptThroughput > 0)
+            {
+                MeasureCapture(string.IsNullOrEmpty(OptCanDumpFile) ? "throughput.pcapng" : OptCanDumpFile, OptThroughput);
+                return;
+            }
+
             /* Do the job */
             try
             {
@@ -97,7 +242,7 @@ namespace canshark
 
                     file = new FileStream(OptCanDumpFile, FileMode.Create);
 
-                    streams.Add(new WiresharkPcapProtocol(file));
+                    streams.Add(OpenCapture(file));
                 }
 
                 if (!string.IsNullOrEmpty(OptWiresharkPipeName) && (OptWiresharkPipeName != "0"))
@@ -111,13 +256,9 @@ namespace canshark
 
                     Console.WriteLine("PIPE: Client connected.");
 
-                    streams.Add(new WiresharkPcapProtocol(wireshark));
+                    streams.Add(OpenCapture(wireshark));
                 }
 
-                /* Write headers */
-                foreach (var stm in streams)
-                    stm.WriteHeader(DataLinkType.DLT_USER0, 16);
-
                 Console.WriteLine("Starting the logger.");
 
 
@@ -125,6 +266,12 @@ namespace canshark
                 using (CanSharkBoard board = new CanSharkBoard())
                 {
                     int can1 = 0, can2 = 0, can1o = 0, can2o = 0;
+                    string health = "Board:\tno telemetry";
+                    string[] nodes = { "", "" };
+                    string nodeEvent = "";
+                    List<GeneratorCheck> checks = OptGenerators.Select(g => new GeneratorCheck(g)).ToList();
+                    UInt32 benchFrames = 0;
+                    bool benchDone = false;
 
                     board.MessageReceived += (e, m) =>
                     {
@@ -133,18 +280,130 @@ namespace canshark
                         else
                             can2++;
 
+                        foreach (var chk in checks)
+                            chk.Check(m);
+
+                        if ((OptBench != null) && OptBench.IsBench(m))
+                            benchFrames++;
+
+                        foreach (var stm in streams)
+                            WriteCapture(stm, m);
+                    };
+
+                    board.GeneratorReceived += (e, g) =>
+                    {
+                        health = "Board:\t" + g.ToString();
+                    };
+
+                    board.BenchReceived += (e, b) =>
+                    {
+                        Console.WriteLine("Board:\t" + b.ToString());
+                        if (b.Status != BoardControl.STATUS_OK)
+                            benchDone = true;
+                    };
+
+                    board.BenchReported += (e, r) =>
+                    {
+                        r.Received = benchFrames;
+                        benchFrames = 0;
+
+                        Console.WriteLine(r.ToString());
+                        Console.WriteLine("\tisr latency " + r.LatencyString());
+                        if (r.Last)
+                        {
+                            Console.WriteLine(string.Format("Max loss-free load {0}.{1}%", r.MaxOk / 10, r.MaxOk % 10));
+                            benchDone = true;
+                        }
+                    };
+
+                    board.TelemetryReceived += (e, t) =>
+                    {
+                        health = t.ToString();
+
+                        /* loss counters of the board into the captures, fifo overrun and the ring full */
                         foreach (var stm in streams)
-                            if (stm.Connected)
-                                stm.WriteFrame(m.Sec, m.Usec, m);
+                            for (int port = 0; port < PORTS; port++)
+                                stm.WriteStatistics(port, TimeSync.Now * 1000, t.Rx[port], (UInt64)t.Overrun[port, 0] + t.Overrun[port, 1], t.Lost[port]);
+                    };
+
+                    board.NodeEventReceived += (e, n) =>
+                    {
+                        nodeEvent = n.ToString();
+                    };
+
+                    board.NodeTableReceived += (e, t) =>
+                    {
+                        if (t.Port < nodes.Length)
+                            nodes[t.Port] = t.ToString();
+                    };
+
+                    board.ControlReceived += (e, c) =>
+                    {
+                        health = "Board:\t" + c.ToString();
+                    };
+
+                    board.ControlLost += (e, c) =>
+                    {
+                        health = "Board:\tcommand " + c.Cmd + " not answered";
                     };
 
+                    board.BoardFound += (e, ep) =>
+                    {
+                        if (OptDefaults)
+                            board.RestoreDefaults();
+
+                        for (byte port = 0; port < 2; port++)
+                        {
+                            if (OptSilent)
+                                board.SetSilent(port, true);
+
+                            if (OptNmt)
+                                board.SetNmtFilter(port, true);
+
+                            if (OptAutobaud)
+                                board.Autobaud(port, 10000);
+                            else if (OptBitrate != 0)
+                                board.SetTiming(port, OptBitrate, OptSample);
+                        }
+
+                        foreach (var p in OptParams)
+                            board.SetParam(p.Key, p.Value);
+
+                        /* autobaud result is saved only once locked, run again then */
+                        if (OptSave)
+                            board.SaveSettings();
+
+                        foreach (var g in OptGenerators)
+                            board.Generate(g);
+
+                        if (OptBench != null)
+                            board.Bench(OptBench);
+                    };
+
+                    /* the reports are printed as they come, no live counters */
+
+                    if (OptBench != null)
+                    {
+                        Console.WriteLine("Benchmark running. Press any key to stop.");
+
+                        while (!benchDone && !Console.KeyAvailable)
+                            Thread.Sleep(100);
+
+                        if (!benchDone)
+                            board.Bench(new BenchConfig());
+                        return;
+                    }
+
                     /* run forever */
 
                     Console.WriteLine("Logging data. Press any key to stop.");
                     Console.WriteLine();
                     Console.WriteLine("\t\tCAN1\t\tCAN2");
                     Console.WriteLine();
-                    
+                    Console.WriteLine();
+                    if (OptNmt)
+                        Console.WriteLine();
+
                     while (streams.All(p => p.Connected))
                     {
                         Thread.Sleep(1000);
@@ -154,9 +413,12 @@ namespace canshark
 
                         can1o = can1 - can1o;
                         can2o = can2 - can2o;
-                        Console.SetCursorPosition(0, Console.CursorTop-1);
+                        Console.SetCursorPosition(0, Console.CursorTop - (OptNmt ? 3 : 2));
                         Console.WriteLine(string.Format("Total:\t{0,7} frames\t{1,7} frames", can1, can2));
-                        Console.Write(string.Format("Rate:\t{0,7} frame/s\t{1,7} frame/s", can1o, can2o));
+                        Console.WriteLine(string.Format("Rate:\t{0,7} frame/s\t{1,7} frame/s", can1o, can2o));
+                        if (OptNmt)
+                            Console.WriteLine(string.Format("Nodes:\t{0}, {1}  {2}", nodes[0], nodes[1], nodeEvent).PadRight(Console.WindowWidth - 1));
+                        Console.Write((health + string.Concat(checks.Select(c => ", " + c.ToString()))).PadRight(Console.WindowWidth - 1));
                         can1o = can1;
                         can2o = can2;
                     }
@@ -164,6 +426,10 @@ namespace canshark
             }
             finally
             {
+                /* buffered frames written before the streams close */
+                foreach (var stm in streams)
+                    stm.Dispose();
+
                 if (wireshark != null)
                     wireshark.Dispose();
 
@@ -0,0 +1,121 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text;
+
+namespace canshark
+{
+    /* health record of the board, struct modtelem_record */
+    class Telemetry
+    {
+        public const int LANES = 2;
+        public const int PORTS = 2;
+        public const int LATENCY_BUCKETS = 16;
+
+        public UInt32 Uptime;           // ms
+        public UInt32 Loops;            // main loop iterations per second
+        public UInt32 PbufFailures;
+        public UInt32 HeapUsed;
+        public UInt32 HeapMax;
+        public UInt32 HeapSize;
+        public UInt32 StackMax;
+        public UInt32 StackSize;
+
+        public UInt16[] RingUsed = new UInt16[LANES];
+        public UInt16[] RingMax = new UInt16[LANES];
+        public UInt16[] RingSize = new UInt16[LANES];
+
+        public UInt32[] Rx = new UInt32[PORTS];
+        public UInt32[] Tx = new UInt32[PORTS];
+        public UInt32[] Lost = new UInt32[PORTS];
+        public UInt32[,] Overrun = new UInt32[PORTS, 2];    // hw FIFO0 (critical), FIFO1 (bulk)
+        public UInt32[] Errors = new UInt32[PORTS];
+
+        public UInt32[] Bitrate = new UInt32[PORTS];        // bit/s
+        public UInt16[] Sample = new UInt16[PORTS];         // permille
+        public byte[] Autobaud = new byte[PORTS];           // 0 off, 1 running, 2 locked
+        public bool[] Silent = new bool[PORTS];             // listen only
+
+        public UInt32[] GenSent = new UInt32[PORTS];       // generator frames
+        public UInt32[] GenStarved = new UInt32[PORTS];    // waited for the free mailbox
+        public UInt16[] GenLoad = new UInt16[PORTS];       // achieved, permille
+        public UInt16[] GenTarget = new UInt16[PORTS];     // permille, 0 stopped
+
+        public UInt32[,] Latency = new UInt32[LANES, LATENCY_BUCKETS];
+
+        public static Telemetry DeserializeFrom(BinaryReader br)
+        {
+            Telemetry t = new Telemetry();
+
+            t.Uptime = br.ReadUInt32();
+            t.Loops = br.ReadUInt32();
+            t.PbufFailures = br.ReadUInt32();
+            t.HeapUsed = br.ReadUInt32();
+            t.HeapMax = br.ReadUInt32();
+            t.HeapSize = br.ReadUInt32();
+            t.StackMax = br.ReadUInt32();
+            t.StackSize = br.ReadUInt32();
+
+            for (int i = 0; i < LANES; i++)
+                t.RingUsed[i] = br.ReadUInt16();
+            for (int i = 0; i < LANES; i++)
+                t.RingMax[i] = br.ReadUInt16();
+            for (int i = 0; i < LANES; i++)
+                t.RingSize[i] = br.ReadUInt16();
+
+            for (int i = 0; i < PORTS; i++)
+            {
+                t.Rx[i] = br.ReadUInt32();
+                t.Tx[i] = br.ReadUInt32();
+                t.Lost[i] = br.ReadUInt32();
+                t.Overrun[i, 0] = br.ReadUInt32();
+                t.Overrun[i, 1] = br.ReadUInt32();
+                t.Errors[i] = br.ReadUInt32();
+            }
+
+            for (int i = 0; i < PORTS; i++)
+            {
+                t.Bitrate[i] = br.ReadUInt32();
+                t.Sample[i] = br.ReadUInt16();
+                t.Autobaud[i] = br.ReadByte();
+                t.Silent[i] = br.ReadByte() != 0;
+            }
+
+            for (int l = 0; l < LANES; l++)
+                for (int b = 0; b < LATENCY_BUCKETS; b++)
+                    t.Latency[l, b] = br.ReadUInt32();
+
+            for (int i = 0; i < PORTS; i++)
+            {
+                t.GenSent[i] = br.ReadUInt32();
+                t.GenStarved[i] = br.ReadUInt32();
+                t.GenLoad[i] = br.ReadUInt16();
+                t.GenTarget[i] = br.ReadUInt16();
+            }
+
+            return t;
+        }
+
+        public override string ToString()
+        {
+            return string.Format("Board:\t{17}/{18} kbps{19}, up {0}s, {1} loop/s, heap {2}/{3}B, stack {4}/{5}B, ring {6}/{7} {8}/{9}, lost {10} {11}, fovr {13}/{14} {15}/{16}, nobuf {12}",
+                Uptime / 1000, Loops, HeapMax, HeapSize, StackMax, StackSize,
+                RingMax[0], RingSize[0], RingMax[1], RingSize[1], Lost[0], Lost[1], PbufFailures,
+                Overrun[0, 0], Overrun[0, 1], Overrun[1, 0], Overrun[1, 1],
+                Bitrate[0] / 1000, Bitrate[1] / 1000, (Autobaud[0] == 1 || Autobaud[1] == 1) ? " (autobaud)" : (Silent[0] || Silent[1]) ? " (silent)" : "")
+                + GeneratorString();
+        }
+
+        private string GeneratorString()
+        {
+            string s = "";
+
+            for (int i = 0; i < PORTS; i++)
+                if (GenTarget[i] != 0)
+                    s += string.Format(", gen{0} {1:0.0}/{2:0.0}% starved {3}", i + 1, GenLoad[i] / 10.0, GenTarget[i] / 10.0, GenStarved[i]);
+
+            return s;
+        }
+    }
+}
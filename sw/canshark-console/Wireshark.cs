@@ -14,9 +14,17 @@ namespace Wireshark
         void SerializeTo(BinaryWriter bw);
     }
 
+    /* record serialized straight into the buffer of the writer, in the link type of the interface */
+    public interface IRecord
+    {
+        int SerializeLen(DataLinkType link);
+        void SerializeTo(DataLinkType link, byte[] buffer, int offset);
+    }
+
     public enum DataLinkType : uint
     {
-        DLT_USER0 = 147,
+        DLT_USER0 = 147,                /* canshark record, dissector/canshark.lua */
+        DLT_CAN_SOCKETCAN = 227,        /* struct can_frame, Wireshark's own CAN dissector */
     }
 
     class WiresharkPcapProtocol : IDisposable
@@ -4,14 +4,15 @@ using System.Collections.Generic;
 using System.Linq;
 using System.Text;
 using System.Threading.Tasks;
+using Core;
 
 namespace Analysis
 {
-    public sealed class AnalyseMessageLog : IAnalyzer
+    public sealed class AnalyseMessageLog : IShardedAnalyzer, IDisposable
     {
         public sealed class Result
         {
-            public List<CanMessage> Messages = new List<CanMessage>();
+            public MessageLog Messages = new MessageLog();
         }
 
         public ConcurrentDictionary<CanSourceId, Result> Results = new ConcurrentDictionary<CanSourceId, Result>();
@@ -20,14 +21,23 @@ namespace Analysis
 
         public void Analyze(CanMessage[] msgs)
         {
-            foreach (CanMessage cm in msgs)
+            // runs of one source appended at once, the whole shard usually
+            int start = 0;
+            for (int i = 1; i <= msgs.Length; i++)
             {
-                Result r = Results.GetOrAdd(cm.Source, x => new Result());
+                if ((i < msgs.Length) && (msgs[i].Source == msgs[start].Source))
+                    continue;
 
-                r.Messages.Add(cm);
+                Result r = Results.GetOrAdd(msgs[start].Source, x => new Result());
+                r.Messages.Append(msgs, start, i - start);
+                start = i;
             }
         }
 
-        
+        public void Dispose()
+        {
+            foreach (Result r in Results.Values)
+                r.Messages.Dispose();
+        }
     }
 }
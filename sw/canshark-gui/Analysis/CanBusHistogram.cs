@@ -1,119 +1,301 @@
 ﻿using System;
 using System.Collections.Concurrent;
 using System.Collections.Generic;
+using System.Diagnostics;
 using System.Linq;
 using System.Text;
 using System.Threading.Tasks;
-using System.Timers;
 
 namespace Analysis
 {
-    public class CanBusHistogram : IAnalyzer
+    public class CanBusHistogram : IShardedAnalyzer
     {
-        public class OneCounter
+        /// <summary>
+        /// Frames of one source by the identifier. Standard identifiers have their
+        /// slot in dense arrays, extended ones get a slot behind them when first
+        /// seen. The sliding window is a ring of time buckets, each keeping only
+        /// the slots it counted, the window sum is updated when a bucket expires.
+        /// </summary>
+        public class Result
         {
-            public int Value = 1;
-            public ConcurrentQueue<int> History = new ConcurrentQueue<int>();
+            public const int STD_IDS = 2048;
 
-            public OneCounter Count()
+            private sealed class Bucket
             {
-                Value++;
-                return this;
+                public int[] Slots;
+                public int[] Counts;
             }
 
-            public int sum()
+            #region Variables
+            private object _Lock = new object();
+
+            private Dictionary<CanObjectId, int> _ExtSlots = new Dictionary<CanObjectId, int>();
+            private List<CanObjectId> _ExtIds = new List<CanObjectId>();
+            private int _Slots = STD_IDS;
+
+            private int[] _Total = new int[STD_IDS];
+            private int[] _Window = new int[STD_IDS];
+            private int[] _Current = new int[STD_IDS];          // frames of the current bucket
+            private List<int> _Touched = new List<int>();       // slots of the current bucket
+
+            private Bucket[] _Ring;
+            private int _Head;
+            private long _Bucket;
+            private long _Resolution;
+
+            // changed since the last GetChanges
+            private bool[] _Dirty = new bool[STD_IDS];
+            private List<int> _DirtyList = new List<int>();
+
+            private bool _AutoDelete;
+            #endregion
+
+            public Result(bool autodelete, uint resolution, uint buckets)
             {
-                return Value + History.Sum();
+                Configure(autodelete, resolution, buckets);
             }
 
-            public void Pack(uint maxcount)
+            public bool AutoDeleteEnable { get { return _AutoDelete; } }
+
+            private static long Now()
             {
-                History.Enqueue(Value);
-                Value = 0;
-                int res = 0;
-                if (History.Count > maxcount)
-                    History.TryDequeue(out res);
+                return Stopwatch.GetTimestamp() / (Stopwatch.Frequency / 1000);
             }
-        }
 
-        public class Result
-        {
-            public bool AutoDeleteEnable = false;
+            #region Slots
+            private int Slot(CanObjectId cob, bool add)
+            {
+                if (!cob.IdIsExt)
+                    return (int)cob.IdStd;
+
+                int slot;
+                if (_ExtSlots.TryGetValue(cob, out slot))
+                    return slot;
+
+                if (!add)
+                    return -1;
+
+                slot = _Slots++;
+                if (slot == _Total.Length)
+                {
+                    Array.Resize(ref _Total, slot * 2);
+                    Array.Resize(ref _Window, slot * 2);
+                    Array.Resize(ref _Current, slot * 2);
+                    Array.Resize(ref _Dirty, slot * 2);
+                }
 
-            public ConcurrentDictionary<CanObjectId, OneCounter> StatsAutoDelete = new ConcurrentDictionary<CanObjectId, OneCounter>();
-            public ConcurrentDictionary<CanObjectId, int> StatsTotal = new ConcurrentDictionary<CanObjectId, int>();
+                _ExtSlots.Add(cob, slot);
+                _ExtIds.Add(cob);
+                return slot;
+            }
+
+            private CanObjectId Id(int slot)
+            {
+                return (slot < STD_IDS) ? CanObjectId.Std((uint)slot) : _ExtIds[slot - STD_IDS];
+            }
+
+            private void MarkDirty(int slot)
+            {
+                if (_Dirty[slot])
+                    return;
+
+                _Dirty[slot] = true;
+                _DirtyList.Add(slot);
+            }
+
+            private int Reported(int slot)
+            {
+                return _AutoDelete ? _Window[slot] : _Total[slot];
+            }
+            #endregion
+
+            #region Window
+            /// <summary>
+            /// Current bucket compacted to the touched slots, null when empty
+            /// </summary>
+            private Bucket Close()
+            {
+                if (_Touched.Count == 0)
+                    return null;
+
+                Bucket b = new Bucket() { Slots = _Touched.ToArray(), Counts = new int[_Touched.Count] };
+                for (int i = 0; i < b.Slots.Length; i++)
+                {
+                    b.Counts[i] = _Current[b.Slots[i]];
+                    _Current[b.Slots[i]] = 0;
+                }
+
+                _Touched.Clear();
+                return b;
+            }
+
+            private void Expire(Bucket b)
+            {
+                if (b == null)
+                    return;
+
+                for (int i = 0; i < b.Slots.Length; i++)
+                {
+                    _Window[b.Slots[i]] -= b.Counts[i];
+                    MarkDirty(b.Slots[i]);
+                }
+            }
+
+            /// <summary>
+            /// Moves the ring to the bucket of the time, at most once around
+            /// </summary>
+            private void Rotate(long now)
+            {
+                long bucket = now / _Resolution;
+                long steps = Math.Min(bucket - _Bucket, _Ring.Length);
+                if (steps <= 0)
+                    return;
 
+                _Bucket = bucket;
+
+                for (long s = 0; s < steps; s++)
+                {
+                    _Ring[_Head] = Close();
+                    _Head = (_Head + 1) % _Ring.Length;
+                    Expire(_Ring[_Head]);
+                    _Ring[_Head] = null;
+                }
+            }
+            #endregion
+
+            internal void Count(CanObjectId[] cobs, int count)
+            {
+                lock (_Lock)
+                {
+                    Rotate(Now());
+
+                    for (int i = 0; i < count; i++)
+                    {
+                        int slot = Slot(cobs[i], true);
+
+                        _Total[slot]++;
+                        _Window[slot]++;
+                        if (_Current[slot]++ == 0)
+                            _Touched.Add(slot);
+                        MarkDirty(slot);
+                    }
+                }
+            }
+
+            /// <summary>
+            /// Identifiers changed since the last call with their new count, zero
+            /// when gone from the window. For a single reader.
+            /// </summary>
             public Dictionary<CanObjectId, int> GetChanges()
             {
-                if (!AutoDeleteEnable)
-                    return new Dictionary<CanObjectId, int>(StatsTotal);
-                else
-                    return StatsAutoDelete.ToArray().ToDictionary(x => x.Key, x => x.Value.sum());                
+                lock (_Lock)
+                {
+                    Rotate(Now());
+
+                    Dictionary<CanObjectId, int> changes = new Dictionary<CanObjectId, int>(_DirtyList.Count);
+                    foreach (int slot in _DirtyList)
+                    {
+                        changes[Id(slot)] = Reported(slot);
+                        _Dirty[slot] = false;
+                    }
+
+                    _DirtyList.Clear();
+                    return changes;
+                }
+            }
+
+            /// <summary>
+            /// Count of the identifier, the window or the total by the mode
+            /// </summary>
+            public int GetCount(CanObjectId cob)
+            {
+                lock (_Lock)
+                {
+                    Rotate(Now());
+
+                    int slot = Slot(cob, false);
+                    return (slot < 0) ? 0 : Reported(slot);
+                }
             }
 
             public void ResetCounters()
             {
-                StatsTotal.Clear();
-                StatsAutoDelete.Clear();
+                lock (_Lock)
+                {
+                    for (int slot = 0; slot < _Slots; slot++)
+                    {
+                        if ((_Total[slot] == 0) && (_Window[slot] == 0))
+                            continue;
+
+                        _Total[slot] = 0;
+                        _Window[slot] = 0;
+                        _Current[slot] = 0;
+                        MarkDirty(slot);
+                    }
+
+                    _Touched.Clear();
+                    Array.Clear(_Ring, 0, _Ring.Length);
+                }
+            }
+
+            internal void Configure(bool autodelete, uint resolution, uint buckets)
+            {
+                lock (_Lock)
+                {
+                    _AutoDelete = autodelete;
+                    _Resolution = Math.Max(resolution, 1u);
+                    _Ring = new Bucket[Math.Max(buckets, 1u)];
+                    _Head = 0;
+                    _Bucket = Now() / _Resolution;
+                }
+
+                ResetCounters();
             }
         }
 
         public ConcurrentDictionary<CanSourceId, Result> Results = new ConcurrentDictionary<CanSourceId, Result>();
 
         #region Private properties
-        
-
+        bool AutoDelete = false;
         uint TimeResolution = 100;
         uint AutoDeleteTime = 2000;
         
         uint Diference = 10;
-        Timer DeleteTimer = new Timer();
         #endregion
         
         #region Public methods
-        public CanBusHistogram()
-        {
-            DeleteTimer.Elapsed += (e, a) =>
-            {
-                foreach (var kvp2 in Results)
-                foreach (var kvp in kvp2.Value.StatsAutoDelete)
-                    kvp.Value.Pack(Diference);
-            };
-        }
-
-        
         public bool IsRunning { get { return false; } }
 
         public void Analyze(CanMessage[] msgs)
         {
-            foreach (CanMessage msg in msgs)
+            CanObjectId[] cobs = new CanObjectId[msgs.Length];
+
+            // runs of one source counted at once, the whole shard usually
+            int start = 0;
+            for (int i = 1; i <= msgs.Length; i++)
             {
-                Result result = Results.GetOrAdd(msg.Source, x => new Result());
+                if ((i < msgs.Length) && (msgs[i].Source == msgs[start].Source))
+                    continue;
+
+                for (int j = start; j < i; j++)
+                    cobs[j - start] = msgs[j].COB;
 
-                if (!result.AutoDeleteEnable)
-                    result.StatsTotal.AddOrUpdate(msg.COB, 1, (qid, val) => val + 1);
-                else
-                    result.StatsAutoDelete.AddOrUpdate(msg.COB, new OneCounter(), (qid, val) => val.Count()); 
+                Result result = Results.GetOrAdd(msgs[start].Source, x => new Result(AutoDelete, TimeResolution, Diference));
+                result.Count(cobs, i - start);
+                start = i;
             }
         }
 
-        
-
         public void ChangeAutoDeleteMode(bool new_state, uint Delete_time, uint StepTime) //times in ms
         {
-            foreach (var kvp in Results)
-                kvp.Value.AutoDeleteEnable = new_state;
-
+            AutoDelete = new_state;
             AutoDeleteTime = Delete_time;
             TimeResolution = StepTime;
             Diference = AutoDeleteTime / TimeResolution;
-            DeleteTimer.Interval = StepTime;
-            DeleteTimer.Enabled = new_state;
+
             foreach (var kvp in Results)
-                kvp.Value.ResetCounters();
+                kvp.Value.Configure(AutoDelete, TimeResolution, Diference);
         }
-
-        
         #endregion        
     }
 
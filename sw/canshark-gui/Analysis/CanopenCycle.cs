@@ -11,73 +11,115 @@ namespace Analysis
     public class CanopenMsg
     {
         public CanObjectId COB;
-        public string data;
+        public CanMessage last;         // data formatted by the view only
+        public string data { get { return BitConverter.ToString(last.Data); } }
         public UInt32 count;
-        public double delay;            // in secs
+        public double delay;            // in secs, last one
         public double length;           // in secs
         public bool IsTx;
+        public UInt32 Bitrate;
+
+        public LatencyHistogram Offsets = new LatencyHistogram();      // bit times after the SYNC
+
+        /// <summary>
+        /// Offset after the SYNC [s] not exceeded by the percent of the frames,
+        /// 0 for min, 100 for max
+        /// </summary>
+        public double Offset(double percent)
+        {
+            return Offsets.Percentile(percent) / (double)Bitrate;
+        }
     }
 
-    public class CanopenCycle : IAnalyzer
+    public class CanopenCycle : IShardedAnalyzer
     {
-        const double BitRate = 1000000; // Hz
-
         public class Result
         {
             public ConcurrentDictionary<CanObjectId, CanopenMsg> CycleLog = new ConcurrentDictionary<CanObjectId, CanopenMsg>();
 
-            public UInt16 synctime = 0;
-            public UInt16 oldsynctime = 0;
+            public UInt64 synctime = 0;
+            public UInt64 oldsynctime = 0;
+            public UInt64 cycleend = 0;     // end of the last frame after the SYNC
+            public UInt32 Bitrate = PortStatistics.BITRATE;
 
-            
+            // per cycle, bit times
+            public LatencyHistogram Period = new LatencyHistogram();      // SYNC to SYNC
+            public LatencyHistogram Span = new LatencyHistogram();        // SYNC to the end of its last frame
 
-            public double SyncPeriod { get { return TimeDiff(oldsynctime, synctime) / (2*BitRate); } }
+            public double SyncPeriod { get { return TimeDiff(oldsynctime, synctime) / (double)Bitrate; } }
+
+            public double Seconds(long bits)
+            {
+                return bits / (double)Bitrate;
+            }
         }
 
 
         public ConcurrentDictionary<CanSourceId, Result> Results = new ConcurrentDictionary<CanSourceId, Result>();
 
-        
-        
-
-        
-
         public bool IsRunning { get { return false; } }
 
         public void Analyze(CanMessage[] msgs)
         {
+            Result result = null;
+            CanSourceId src = default(CanSourceId);
+
             foreach (CanMessage m in msgs)
             {
-                Result result = Results.GetOrAdd(m.Source, x => new Result());
+                if ((result == null) || (m.Source != src))
+                {
+                    src = m.Source;
+                    result = Results.GetOrAdd(src, x => new Result());
+                    result.Bitrate = PortStatistics.ReportedBitrate(src, result.Bitrate);
+                }
 
-                if (m.COB.IdStd == 0x80)        // std ID 0x80 = SYNC
+                bool sync = !m.COB.IdIsExt && (m.COB.IdStd == 0x80);      // std ID 0x80 = SYNC
+
+                if (sync)
                 {
+                    if (result.synctime != 0)
+                    {
+                        result.Period.Record(TimeDiff(result.synctime, m.BitTime));
+                        if (result.cycleend > result.synctime)
+                            result.Span.Record(TimeDiff(result.synctime, result.cycleend));
+                    }
+
                     result.oldsynctime = result.synctime;
-                    result.synctime = m.Time;
+                    result.synctime = m.BitTime;
+                    result.cycleend = 0;
                 }
-                else
-                    if (result.CycleLog.Count == 0)       // make the cycle entire from the beginning
-                        return;
+                else if (result.synctime == 0)      // make the cycle entire from the first SYNC
+                    continue;
 
-                
+                int bits = m.FrameLengthStuffed;
+                long offset = TimeDiff(result.synctime, m.BitTime);
 
                 CanopenMsg msg = result.CycleLog.GetOrAdd(m.COB, x => new CanopenMsg() { COB = x, count = 0 });
-                
-                msg.data = BitConverter.ToString(m.Data);
+
+                msg.last = m;
                 msg.count++;
-                msg.delay = TimeDiff(result.synctime, m.Time) / (2*BitRate);
-                msg.length = m.FrameLengthStuffed / BitRate;
+                msg.Bitrate = result.Bitrate;
+                msg.delay = offset / (double)result.Bitrate;
+                msg.length = bits / (double)result.Bitrate;
                 msg.IsTx = m.Mailbox.IsTx;
+
+                if (!sync)
+                {
+                    msg.Offsets.Record(offset);
+                    result.cycleend = Math.Max(result.cycleend, result.synctime + (UInt64)(offset + bits));
+                }
             }
         }
 
 
-        public static int TimeDiff(UInt16 old, UInt16 time1)
+        // bit times unwrapped by the board, any gap is exact. Old firmware sends
+        // the 16 bit timer only, it wraps then.
+        public static long TimeDiff(UInt64 old, UInt64 time1)
         {
-            if (time1 >= old)
-                return time1 - old;
-            else
-                return time1 + 0x10000 - old;
+            if (((old | time1) >> 16) == 0)
+                return (UInt16)(time1 - old);
+
+            return (long)(time1 - old);
         }
     }
 }
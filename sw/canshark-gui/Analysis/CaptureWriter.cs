@@ -0,0 +1,95 @@
+﻿using Core;
+using System;
+using System.Collections.Generic;
+using System.IO;
+using Wireshark;
+
+namespace Analysis
+{
+    /// <summary>
+    /// Frames of all sources into a pcapng stream while started. Every source gets
+    /// its own interface when its first frame comes, the direction is in the packet
+    /// flags. DLT_CAN_SOCKETCAN lets Wireshark use its compiled CAN and CANopen
+    /// dissectors, DLT_USER0 keeps the time, mailbox and flags for canshark.lua.
+    /// </summary>
+    public sealed class CaptureWriter : IAnalyzer, IDisposable
+    {
+        public const string APPLICATION = "canshark-gui";
+        public const UInt32 SNAPLEN = 16;
+
+        #region Variables
+        private object _Lock = new object();
+        private Stream _Stream;
+        private PcapNgWriter _Writer;
+        private DataLinkType _Format;
+        private Dictionary<CanSourceId, int> _Interfaces = new Dictionary<CanSourceId, int>();
+        #endregion
+
+        public bool IsRunning { get { return false; } }
+
+        public bool IsCapturing { get { return _Writer != null; } }
+
+        public long Frames { get { PcapNgWriter w = _Writer; return (w == null) ? 0 : w.Frames; } }
+
+        /// <summary>
+        /// Capture into the stream from the next batch on, the stream is owned and closed by Stop
+        /// </summary>
+        public void Start(Stream stm, DataLinkType format)
+        {
+            lock (_Lock)
+            {
+                Stop();
+
+                _Stream = stm;
+                _Format = format;
+                _Writer = new PcapNgWriter(stm, APPLICATION);
+            }
+        }
+
+        /// <summary>
+        /// Buffered frames written, the stream closed
+        /// </summary>
+        public void Stop()
+        {
+            lock (_Lock)
+            {
+                if (_Writer == null)
+                    return;
+
+                _Writer.Dispose();
+                _Stream.Dispose();
+
+                _Writer = null;
+                _Stream = null;
+                _Interfaces.Clear();
+            }
+        }
+
+        public void Analyze(CanMessage[] msgs)
+        {
+            lock (_Lock)
+            {
+                if (_Writer == null)
+                    return;
+
+                for (int i = 0; i < msgs.Length; i++)
+                {
+                    int iface;
+                    if (!_Interfaces.TryGetValue(msgs[i].Source, out iface))
+                    {
+                        string name = msgs[i].Source.ToString();
+                        iface = _Writer.AddInterface(_Format, SNAPLEN, name, "canshark port " + name);
+                        _Interfaces[msgs[i].Source] = iface;
+                    }
+
+                    _Writer.WriteFrame(iface, MessageLog.HostTime(msgs[i]) * 1000, ref msgs[i]);
+                }
+            }
+        }
+
+        public void Dispose()
+        {
+            Stop();
+        }
+    }
+}
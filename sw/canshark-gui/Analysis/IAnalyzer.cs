@@ -13,4 +13,12 @@ namespace Analysis
 
         bool IsRunning { get; }
     }
+
+    /// <summary>
+    /// Analyzer keeping its results per CanSourceId only. The pipeline runs the
+    /// frames of each source in parallel, the calls for one source never overlap.
+    /// </summary>
+    public interface IShardedAnalyzer : IAnalyzer
+    {
+    }
 }
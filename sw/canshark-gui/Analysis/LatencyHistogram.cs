@@ -0,0 +1,123 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Linq;
+
+namespace Analysis
+{
+    /// <summary>
+    /// Distribution of non negative times, HDR like buckets. Values below
+    /// 2 * SUB are exact, above them every power of two is split into SUB
+    /// buckets, so a value is kept within 1 / SUB of itself. Min and max exact.
+    /// </summary>
+    public sealed class LatencyHistogram
+    {
+        public const int SUB_BITS = 5;
+        public const int SUB = 1 << SUB_BITS;
+        public const int BUCKETS = (64 - SUB_BITS) * SUB + SUB;
+
+        #region Variables
+        private object _Lock = new object();
+        private long[] _Counts = new long[BUCKETS];
+        private long _Count;
+        private long _Min = long.MaxValue;
+        private long _Max;
+        private double _Sum;
+        #endregion
+
+        private static int Log2(UInt64 v)
+        {
+            int e = 0;
+            if ((v >> 32) != 0) { v >>= 32; e += 32; }
+            if ((v >> 16) != 0) { v >>= 16; e += 16; }
+            if ((v >> 8) != 0) { v >>= 8; e += 8; }
+            if ((v >> 4) != 0) { v >>= 4; e += 4; }
+            if ((v >> 2) != 0) { v >>= 2; e += 2; }
+            if ((v >> 1) != 0) { e += 1; }
+            return e;
+        }
+
+        private static int Index(long value)
+        {
+            int shift = Math.Max(Log2((UInt64)value) - SUB_BITS, 0);
+            return shift * SUB + (int)(value >> shift);
+        }
+
+        /// <summary>
+        /// Highest value falling into the bucket
+        /// </summary>
+        private static long Highest(int index)
+        {
+            if (index < 2 * SUB)
+                return index;
+
+            int shift = index / SUB - 1;
+            return ((long)(index - shift * SUB + 1) << shift) - 1;
+        }
+
+        public void Record(long value)
+        {
+            if (value < 0)
+                value = 0;
+
+            lock (_Lock)
+            {
+                _Counts[Index(value)]++;
+                _Count++;
+                _Sum += value;
+
+                if (value < _Min)
+                    _Min = value;
+                if (value > _Max)
+                    _Max = value;
+            }
+        }
+
+        public long Count { get { lock (_Lock) return _Count; } }
+
+        public long Min { get { lock (_Lock) return (_Count == 0) ? 0 : _Min; } }
+
+        public long Max { get { lock (_Lock) return _Max; } }
+
+        public double Mean { get { lock (_Lock) return (_Count == 0) ? 0 : _Sum / _Count; } }
+
+        /// <summary>
+        /// Value not exceeded by the percent of the records, the bucket top
+        /// </summary>
+        public long Percentile(double percent)
+        {
+            lock (_Lock)
+            {
+                if (_Count == 0)
+                    return 0;
+                if (percent <= 0)
+                    return _Min;
+                if (percent >= 100)
+                    return _Max;
+
+                long rank = Math.Max((long)Math.Ceiling(_Count * percent / 100.0), 1);
+                long seen = 0;
+
+                for (int i = 0; i < BUCKETS; i++)
+                {
+                    seen += _Counts[i];
+                    if (seen >= rank)
+                        return Math.Max(Math.Min(Highest(i), _Max), _Min);
+                }
+
+                return _Max;
+            }
+        }
+
+        public void Reset()
+        {
+            lock (_Lock)
+            {
+                Array.Clear(_Counts, 0, BUCKETS);
+                _Count = 0;
+                _Min = long.MaxValue;
+                _Max = 0;
+                _Sum = 0;
+            }
+        }
+    }
+}
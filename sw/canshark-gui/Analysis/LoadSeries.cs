@@ -0,0 +1,130 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Linq;
+
+namespace Analysis
+{
+    /// <summary>
+    /// Bus load of one port at one resolution, a ring of the last intervals.
+    /// Bits are kept, the load is computed with the bitrate when read. An
+    /// interval counts for the peak once the time moved past it.
+    /// </summary>
+    public sealed class LoadSeries
+    {
+        public struct Point
+        {
+            public UInt64 Time;             // us, start of the interval
+            public float Load;              // of the bitrate
+        }
+
+        #region Variables
+        private long[] _Bits;
+        private long _Head = -1;            // interval of the newest slot
+        private long _First;                // interval of the first frame
+        private UInt64 _Resolution;
+        private float _Peak;
+        private UInt64 _PeakTime;
+        #endregion
+
+        public LoadSeries(UInt64 resolution, int length)
+        {
+            _Resolution = resolution;
+            _Bits = new long[length];
+        }
+
+        /// <summary>
+        /// Interval [us]
+        /// </summary>
+        public UInt64 Resolution { get { return _Resolution; } }
+
+        /// <summary>
+        /// Highest load of a complete interval, since the start
+        /// </summary>
+        public float Peak { get { return _Peak; } }
+
+        public UInt64 PeakTime { get { return _PeakTime; } }
+
+        private float Load(long bits, UInt32 bitrate)
+        {
+            return (float)(bits * 1000000.0 / ((double)bitrate * _Resolution));
+        }
+
+        internal void Add(UInt64 time, int bits, UInt32 bitrate)
+        {
+            long n = (long)(time / _Resolution);
+            Advance(n, bitrate);
+
+            // late frame older than the ring
+            if (n <= _Head - _Bits.Length)
+                return;
+
+            _Bits[n % _Bits.Length] += bits;
+        }
+
+        /// <summary>
+        /// Moves the ring to the interval, the passed ones are cleared
+        /// </summary>
+        internal void Advance(long n, UInt32 bitrate)
+        {
+            if (_Head < 0)
+            {
+                _Head = n;
+                _First = n;
+                return;
+            }
+
+            if (n <= _Head)
+                return;
+
+            float load = Load(_Bits[_Head % _Bits.Length], bitrate);
+            if (load > _Peak)
+            {
+                _Peak = load;
+                _PeakTime = (UInt64)_Head * _Resolution;
+            }
+
+            for (long i = Math.Max(_Head + 1, n - _Bits.Length + 1); i <= n; i++)
+                _Bits[i % _Bits.Length] = 0;
+
+            _Head = n;
+        }
+
+        /// <summary>
+        /// Complete intervals in the ring, the oldest first
+        /// </summary>
+        internal Point[] Points(UInt32 bitrate)
+        {
+            if (_Head < 0)
+                return new Point[0];
+
+            long first = Math.Max(_Head - _Bits.Length + 1, _First);
+            Point[] pts = new Point[_Head - first];
+
+            for (long i = first; i < _Head; i++)
+                pts[i - first] = new Point() { Time = (UInt64)i * _Resolution, Load = Load(_Bits[i % _Bits.Length], bitrate) };
+
+            return pts;
+        }
+
+        /// <summary>
+        /// Highest load of the last complete intervals
+        /// </summary>
+        internal float Max(int intervals, UInt32 bitrate)
+        {
+            long max = 0;
+
+            for (long i = Math.Max(Math.Max(_Head - intervals, _Head - _Bits.Length + 1), _First); i < _Head; i++)
+                max = Math.Max(max, _Bits[i % _Bits.Length]);
+
+            return Load(max, bitrate);
+        }
+
+        internal void Clear()
+        {
+            Array.Clear(_Bits, 0, _Bits.Length);
+            _Head = -1;
+            _Peak = 0;
+            _PeakTime = 0;
+        }
+    }
+}
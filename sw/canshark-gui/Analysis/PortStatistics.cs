@@ -1,4 +1,6 @@
-﻿using System;
+﻿using Boards;
+using Core;
+using System;
 using System.Collections.Concurrent;
 using System.Collections.Generic;
 using System.Linq;
@@ -7,42 +9,164 @@ using System.Threading.Tasks;
 
 namespace Analysis
 {
-    public class PortStatistics : IAnalyzer
+    public class PortStatistics : IShardedAnalyzer
     {
+        public const UInt32 BITRATE = 500000;       // bit/s, modcan_init default until the telemetry tells
+
+        // load series, resolution [us] and intervals kept
+        public static readonly UInt64[] RESOLUTIONS = { 10000, 100000, 1000000, 60000000 };
+        public static readonly int[] LENGTHS = { 1000, 600, 600, 1440 };
+
+        public const int LOAD_10MS = 0;
+        public const int LOAD_100MS = 1;
+        public const int LOAD_1S = 2;
+        public const int LOAD_1MIN = 3;
+
         public class Result
         {
             public int nRx = 0;
             public int nTx = 0;
             public int nErrs = 0;
-            public float load = 0;
+
+            public UInt32 Bitrate = BITRATE;
 
             // bus load computation
-            public int bits = 0;
-            public uint second = 0;
+            private object _Lock = new object();
+            private LoadSeries[] _Series = RESOLUTIONS.Select((r, i) => new LoadSeries(r, LENGTHS[i])).ToArray();
+            private UInt64 _Last;           // us, frame time of the last frame
+            private UInt64 _LastHost;       // us, host clock when it came
+
+            internal void Add(CanMessage[] msgs, int start, int count)
+            {
+                lock (_Lock)
+                {
+                    for (int i = start; i < start + count; i++)
+                    {
+                        UInt64 t = MessageLog.HostTime(msgs[i]);
+                        int bits = msgs[i].FrameLengthStuffed + 7 + 3; // EOF + IFS
+
+                        if (msgs[i].Mailbox.IsTx)
+                            nTx++;
+                        else
+                            nRx++;
+
+                        foreach (LoadSeries s in _Series)
+                            s.Add(t, bits, Bitrate);
+
+                        if (t > _Last)
+                            _Last = t;
+                    }
+
+                    _LastHost = TimeSync.Now;
+                }
+            }
+
+            /// <summary>
+            /// Series moved to now, the idle bus counts without frames. The frame
+            /// time may not be synced to the host, the host clock gives the age.
+            /// </summary>
+            private void Advance()
+            {
+                if (_Last == 0)
+                    return;
+
+                UInt64 now = _Last + (TimeSync.Now - _LastHost);
+                foreach (LoadSeries s in _Series)
+                    s.Advance((long)(now / s.Resolution), Bitrate);
+            }
+
+            /// <summary>
+            /// Complete intervals of the resolution, LOAD_*, the oldest first
+            /// </summary>
+            public LoadSeries.Point[] GetSeries(int level)
+            {
+                lock (_Lock)
+                {
+                    Advance();
+                    return _Series[level].Points(Bitrate);
+                }
+            }
+
+            /// <summary>
+            /// Load of the last complete interval of the resolution
+            /// </summary>
+            public float GetLoad(int level)
+            {
+                lock (_Lock)
+                {
+                    Advance();
+                    return _Series[level].Max(1, Bitrate);
+                }
+            }
+
+            /// <summary>
+            /// Highest load of the resolution over the last span [us]
+            /// </summary>
+            public float GetPeak(int level, UInt64 span)
+            {
+                lock (_Lock)
+                {
+                    Advance();
+                    return _Series[level].Max((int)(span / _Series[level].Resolution), Bitrate);
+                }
+            }
+
+            /// <summary>
+            /// Highest load of the resolution since the start, and when
+            /// </summary>
+            public float GetPeak(int level, out UInt64 time)
+            {
+                lock (_Lock)
+                {
+                    Advance();
+                    time = _Series[level].PeakTime;
+                    return _Series[level].Peak;
+                }
+            }
+
+            public void ResetCounters()
+            {
+                lock (_Lock)
+                {
+                    foreach (LoadSeries s in _Series)
+                        s.Clear();
+                    _Last = 0;
+                }
+            }
         }
 
         public ConcurrentDictionary<CanSourceId, Result> Results = new ConcurrentDictionary<CanSourceId, Result>();
 
         public void Analyze(CanMessage[] msgs)
         {
-            foreach (CanMessage msg in msgs)
+            // runs of one source counted at once, the whole shard usually
+            int start = 0;
+            for (int i = 1; i <= msgs.Length; i++)
             {
-                Result result = Results.GetOrAdd(msg.Source, x => new Result());
+                if ((i < msgs.Length) && (msgs[i].Source == msgs[start].Source))
+                    continue;
 
-                if (msg.Mailbox.IsTx)
-                    result.nTx++;
-                else
-                    result.nRx++;
+                CanSourceId src = msgs[start].Source;
+                Result result = Results.GetOrAdd(src, x => new Result());
 
-                if (result.second == msg.Sec)
-                    result.bits += msg.FrameLengthStuffed + 7 + 3; // EOF + IFS 
-                else
-                {
-                    result.load = result.bits / 1000000.0f;
-                    result.bits = msg.FrameLengthStuffed + 7 + 3; // EOF + IFS 
-                    result.second = msg.Sec;
-                }                
-            }            
+                result.Bitrate = ReportedBitrate(src, result.Bitrate);
+                result.Add(msgs, start, i - start);
+                start = i;
+            }
+        }
+
+        /// <summary>
+        /// Configured bitrate of the port as reported by the board, the fallback
+        /// until the telemetry comes
+        /// </summary>
+        public static UInt32 ReportedBitrate(CanSourceId src, UInt32 fallback)
+        {
+            BoardTelemetry telem;
+            if (CanSharkCore.Telemetry.TryGetValue(src.Board, out telem) &&
+                (src.Port < BoardTelemetry.PORTS) && (telem.Bitrate[src.Port] != 0))
+                return telem.Bitrate[src.Port];
+
+            return fallback;
         }
 
         public bool IsRunning { get { return false; } }
@@ -0,0 +1,72 @@
+﻿using System;
+using System.IO;
+
+namespace Boards
+{
+    /// <summary>
+    /// Request to the board and its reply, struct modctl_msg
+    /// </summary>
+    public sealed class BoardControl
+    {
+        public const byte CMD_TIMING_GET = 1;
+        public const byte CMD_TIMING_SET = 2;
+        public const byte CMD_AUTOBAUD = 3;
+        public const byte CMD_SILENT_SET = 4;
+        public const byte CMD_NMT_FILTER = 5;
+        public const byte CMD_PARAM_GET = 6;
+        public const byte CMD_PARAM_SET = 7;
+        public const byte CMD_FILTER_GET = 8;       // port is the entry
+        public const byte CMD_FILTER_SET = 9;
+        public const byte CMD_LANE_GET = 10;        // port is the entry
+        public const byte CMD_LANE_SET = 11;
+        public const byte CMD_SAVE = 12;
+        public const byte CMD_DEFAULTS = 13;
+
+        public const UInt32 PARAM_BATCH_AGE = 1;    // us
+        public const UInt32 PARAM_TELEMETRY = 2;    // ms, 0 off
+        public const UInt32 PARAM_DEST_ADDR = 3;    // a << 24 | b << 16 | c << 8 | d
+        public const UInt32 PARAM_DEST_PORT = 4;
+
+        public const int FILTERS = 4;
+        public const int LANE_RANGES = 4;
+
+        public const byte STATUS_OK = 0;
+        public const byte STATUS_PENDING = 1;
+        public const byte STATUS_INVALID = 2;
+        public const byte STATUS_FAILED = 3;
+
+        #region Variables
+        public UInt16 Id;               // echoed in the reply
+        public byte Cmd;
+        public byte Port;
+        public byte Status;             // reply only
+        public UInt32[] Arg = new UInt32[2];
+        #endregion
+
+        public void SerializeTo(BinaryWriter bw)
+        {
+            bw.Write(Id);
+            bw.Write(Cmd);
+            bw.Write(Port);
+            bw.Write(Status);
+            bw.Write(new byte[3]); /* reserved */
+            bw.Write(Arg[0]);
+            bw.Write(Arg[1]);
+        }
+
+        public static BoardControl DeserializeFrom(BinaryReader br)
+        {
+            BoardControl c = new BoardControl();
+
+            c.Id = br.ReadUInt16();
+            c.Cmd = br.ReadByte();
+            c.Port = br.ReadByte();
+            c.Status = br.ReadByte();
+            br.ReadBytes(3); /* reserved */
+            c.Arg[0] = br.ReadUInt32();
+            c.Arg[1] = br.ReadUInt32();
+
+            return c;
+        }
+    }
+}
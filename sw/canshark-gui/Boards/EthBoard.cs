@@ -8,98 +8,728 @@ using System.Net;
 using System.Net.Sockets;
 using System.Text;
 using System.Threading;
+using System.Threading.Tasks;
 
 namespace Boards
 {
     class EthBoard : IDisposable
     {
+        const int HEADER_LEN = 8;
+        const int FRAME_LEN = 32;           // struct can_message
+        const byte MAGIC = 0xCA;
+        const byte TYPE_FRAMES = 1;
+        const byte TYPE_TELEMETRY = 2;
+        const byte TYPE_CONTROL = 3;
+        const byte TYPE_SYNC = 4;
+        const byte TYPE_SDO = 5;
+        const byte TYPE_ANNOUNCE = 11;
+        const byte FLAG_BACKLOG = 0x01;
+        const byte FLAG_SILENT = 0x10;      // shifted by port
+
+        /// <summary>
+        /// Entries of the single datagram, the count of the header is byte
+        /// </summary>
+        const int SDO_JOB_ENTRIES = 255;
+
+        /// <summary>
+        /// Board not announced by then is keyed by its address, old firmware never does
+        /// </summary>
+        const int ANNOUNCE_WAIT = 3000;     // ms
+        const int ANNOUNCE_BACKLOG = 4096;  // datagrams held meanwhile
+
+        /// <summary>
+        /// Control request is sent again with the same id, the board answers the
+        /// repeated change from its history without applying it twice
+        /// </summary>
+        const int REQUEST_TIMEOUT = 250;    // ms
+        const int REQUEST_RETRIES = 3;
+
+        /// <summary>
+        /// Receives complete concurrently, datagrams past a gap wait in the window
+        /// for the missing one. The gap is lost once it leaves the window, by the
+        /// window full or by the wait over.
+        /// </summary>
+        const int REORDER_WINDOW = 32;      // datagrams, power of two
+        const int REORDER_WAIT = 20;        // ms
+
         public class BoardInfo
         {
+            private class ObjectJob
+            {
+                public List<ObjectRead> Results = new List<ObjectRead>();
+                public TaskCompletionSource<bool> Done = new TaskCompletionSource<bool>();
+            }
+
             private IPEndPoint _Endpoint;
             private byte _BoardID;
+            private bool _Identified;
+            private bool _Refused;          // no board ID left, its data dropped
+            private BoardAnnounce _Announce;
+            private DateTime _Found = DateTime.UtcNow;
+            private Queue<Tuple<byte[], UInt64>> _Waiting = new Queue<Tuple<byte[], UInt64>>();
+            private bool _SeqValid;
+            private UInt32 _SeqNext;
+            private UInt32? _Uptime;        // s, of the last announce
+            private long _Lost;
+            private UdpDatagram[] _Held = new UdpDatagram[REORDER_WINDOW];     // by seq, buffers of the receiver
+            private int _HeldCount;
+            private UInt64 _HeldSince;      // us, receive time of the oldest held
+            private UdpClient _Socket;
+            private TimeSync _Sync = new TimeSync();
+            private ConcurrentDictionary<UInt16, TaskCompletionSource<BoardControl>> _Requests = new ConcurrentDictionary<UInt16, TaskCompletionSource<BoardControl>>();
+            private ConcurrentDictionary<UInt16, ObjectJob> _Jobs = new ConcurrentDictionary<UInt16, ObjectJob>();
+
+            // ids of the previous run may be still in the history of the board
+            private static int _RequestId = Environment.TickCount & 0xFFFF;
 
-            public BoardInfo(IPEndPoint ep)
+            public BoardInfo(IPEndPoint ep, UdpClient socket)
             {
                 _Endpoint = ep;
-                _BoardID = CanSharkCore.GetNewBoardId();
+                _Socket = socket;
+
+                // board announces itself periodically, ask now not to wait
+                Send(_Socket, _Endpoint, TYPE_ANNOUNCE, 0, 0, bw => { });
+            }
+
+            /// <summary>
+            /// Identity of the board, null until announced
+            /// </summary>
+            public BoardAnnounce Announce { get { return _Announce; } }
+
+            /// <summary>
+            /// All board IDs were in use, the data of the board are dropped
+            /// </summary>
+            public bool Refused { get { return _Refused; } }
 
-                CanSharkCore.RegisterBoard(_BoardID, this, 2);
+            /// <summary>
+            /// ID is given by the registry, captured data wait for it
+            /// </summary>
+            private void Identify(string key, int ports)
+            {
+                _Identified = true;
+
+                try
+                {
+                    _BoardID = CanSharkCore.Registry.GetBoardId(key);
+                }
+                catch (InvalidOperationException)
+                {
+                    // would merge with the board holding the ID
+                    _Refused = true;
+                    _Waiting.Clear();
+                    return;
+                }
+
+                CanSharkCore.RegisterBoard(_BoardID, this, ports);
+
+                while (_Waiting.Count > 0)
+                {
+                    Tuple<byte[], UInt64> d = _Waiting.Dequeue();
+                    Parse(d.Item1, 0, d.Item1.Length, d.Item2);
+                }
             }
 
-            internal void ParseMessage(byte[] data)
+            /// <summary>
+            /// Sends the request to the board, task completes with the final reply,
+            /// null when none came after the retries
+            /// </summary>
+            public async Task<BoardControl> Request(byte cmd, byte port, UInt32 arg0, UInt32 arg1, int timeout = REQUEST_TIMEOUT, int retries = REQUEST_RETRIES)
             {
-                if (data.Length % 32 == 0)
+                BoardControl req = new BoardControl() { Id = (UInt16)Interlocked.Increment(ref _RequestId), Cmd = cmd, Port = port };
+                req.Arg[0] = arg0;
+                req.Arg[1] = arg1;
+
+                TaskCompletionSource<BoardControl> tcs = new TaskCompletionSource<BoardControl>();
+                _Requests[req.Id] = tcs;
+
+                for (int i = 0; i <= retries; i++)
                 {
-                    // message protocol here
-                    using (MemoryStream ms = new MemoryStream(data))
+                    Send(_Socket, _Endpoint, TYPE_CONTROL, req.Id, req.SerializeTo);
+
+                    if (await Task.WhenAny(tcs.Task, Task.Delay(timeout)) == tcs.Task)
+                        return tcs.Task.Result;
+                }
+
+                _Requests.TryRemove(req.Id, out tcs);
+                return null;
+            }
+
+            private async Task<bool> Change(byte cmd, byte port, UInt32 arg0, UInt32 arg1)
+            {
+                BoardControl rep = await Request(cmd, port, arg0, arg1);
+                return (rep != null) && (rep.Status == BoardControl.STATUS_OK);
+            }
+
+            private async Task<Tuple<UInt32, UInt32>> Query(byte cmd, byte port, UInt32 arg0)
+            {
+                BoardControl rep = await Request(cmd, port, arg0, 0);
+                if ((rep == null) || (rep.Status != BoardControl.STATUS_OK))
+                    return null;
+
+                return Tuple.Create(rep.Arg[0], rep.Arg[1]);
+            }
+
+            #region Typed control
+            /// <summary>
+            /// Bitrate and sample point in permille, null when not answered
+            /// </summary>
+            public Task<Tuple<UInt32, UInt32>> GetTiming(byte port)
+            {
+                return Query(BoardControl.CMD_TIMING_GET, port, 0);
+            }
+
+            public Task<bool> SetTiming(byte port, UInt32 bitrate, UInt32 sample)
+            {
+                return Change(BoardControl.CMD_TIMING_SET, port, bitrate, sample);
+            }
+
+            /// <summary>
+            /// Completes once the bitrate is locked, the timeout covers the search
+            /// </summary>
+            public async Task<bool> Autobaud(byte port, int timeout)
+            {
+                BoardControl rep = await Request(BoardControl.CMD_AUTOBAUD, port, 0, 0, timeout, 0);
+                return (rep != null) && (rep.Status == BoardControl.STATUS_OK);
+            }
+
+            public Task<bool> SetSilent(byte port, bool silent)
+            {
+                return Change(BoardControl.CMD_SILENT_SET, port, silent ? 1u : 0u, 0);
+            }
+
+            public Task<bool> SetNmtFilter(byte port, bool filter)
+            {
+                return Change(BoardControl.CMD_NMT_FILTER, port, filter ? 1u : 0u, 0);
+            }
+
+            /// <summary>
+            /// Hardware filter entry for critical frames, mobid and mask
+            /// </summary>
+            public Task<Tuple<UInt32, UInt32>> GetFilter(byte idx)
+            {
+                return Query(BoardControl.CMD_FILTER_GET, idx, 0);
+            }
+
+            /// <summary>
+            /// Mask 0 leaves the entry unused
+            /// </summary>
+            public Task<bool> SetFilter(byte idx, UInt32 mobid, UInt32 mask)
+            {
+                return Change(BoardControl.CMD_FILTER_SET, idx, mobid, mask);
+            }
+
+            /// <summary>
+            /// Priority lane range, first and last mobid
+            /// </summary>
+            public Task<Tuple<UInt32, UInt32>> GetLane(byte idx)
+            {
+                return Query(BoardControl.CMD_LANE_GET, idx, 0);
+            }
+
+            /// <summary>
+            /// First above last leaves the range unused
+            /// </summary>
+            public Task<bool> SetLane(byte idx, UInt32 first, UInt32 last)
+            {
+                return Change(BoardControl.CMD_LANE_SET, idx, first, last);
+            }
+
+            public async Task<UInt32?> GetParam(UInt32 param)
+            {
+                Tuple<UInt32, UInt32> r = await Query(BoardControl.CMD_PARAM_GET, 0, param);
+                return (r != null) ? r.Item2 : (UInt32?)null;
+            }
+
+            public Task<bool> SetParam(UInt32 param, UInt32 value)
+            {
+                return Change(BoardControl.CMD_PARAM_SET, 0, param, value);
+            }
+
+            /// <summary>
+            /// Current settings are used from the next power up, capture stalls while flash is written
+            /// </summary>
+            public Task<bool> SaveSettings()
+            {
+                return Change(BoardControl.CMD_SAVE, 0, 0, 0);
+            }
+
+            public Task<bool> RestoreDefaults()
+            {
+                return Change(BoardControl.CMD_DEFAULTS, 0, 0, 0);
+            }
+            #endregion
+
+            /// <summary>
+            /// Reads the object dictionary entries by the SDO client of the board.
+            /// Entries are interleaved over the nodes and sent in jobs one after another,
+            /// results missing when the job times out are reported as SDO timeout.
+            /// </summary>
+            public async Task<IList<ObjectRead>> ReadObjects(byte port, IEnumerable<ObjectEntry> entries, UInt16 timeout = 100, byte retries = 2, bool block = true)
+            {
+                List<ObjectRead> results = new List<ObjectRead>();
+                List<ObjectEntry> all = ObjectEntry.Interleave(entries).ToList();
+
+                for (int i = 0; i < all.Count; i += SDO_JOB_ENTRIES)
+                {
+                    List<ObjectEntry> part = all.GetRange(i, Math.Min(SDO_JOB_ENTRIES, all.Count - i));
+                    UInt16 id = (UInt16)Interlocked.Increment(ref _RequestId);
+                    ObjectJob job = new ObjectJob();
+                    _Jobs[id] = job;
+
+                    Send(_Socket, _Endpoint, TYPE_SDO, id, (byte)part.Count, bw =>
                     {
-                        BinaryReader br = new BinaryReader(ms);
+                        ObjectRead.SerializeJob(bw, id, port, block ? ObjectRead.FLAG_BLOCK : (byte)0, timeout, 0, retries);
+                        foreach (ObjectEntry e in part)
+                            e.SerializeTo(bw);
+                    });
+
+                    // worst case is every entry timing out one after another
+                    int limit = part.Count * timeout * (retries + 1) + 1000;
+                    await Task.WhenAny(job.Done.Task, Task.Delay(limit));
+                    _Jobs.TryRemove(id, out job);
+
+                    List<ObjectRead> got;
+                    lock (job.Results)
+                        got = job.Results.ToList();
 
-                        while (ms.Position < ms.Length)
-                            CanSharkCore.InputQueue.Enqueue(UnpackCanMessage(br));
+                    ObjectRead end = got.FirstOrDefault(r => r.Node == 0);
+                    foreach (ObjectEntry e in part)
+                    {
+                        ObjectRead r = got.FirstOrDefault(x => (x.Node == e.Node) && (x.Index == e.Index) && (x.SubIndex == e.SubIndex));
+                        if (r == null)
+                            r = new ObjectRead() { Id = id, Node = e.Node, Index = e.Index, SubIndex = e.SubIndex, Data = new byte[0],
+                                Abort = ((end != null) && (end.Abort != 0)) ? end.Abort : ObjectRead.ABORT_TIMEOUT };
+                        results.Add(r);
                     }
                 }
-                else
+
+                return results;
+            }
+
+            /// <summary>
+            /// Clock sync of the board, maps its ticks onto the host timeline
+            /// </summary>
+            public TimeSync Sync { get { return _Sync; } }
+
+            /// <summary>
+            /// Datagrams missing in the sequence of the board, lost by the network
+            /// or by the kernel buffer of this host before they reached the parser
+            /// </summary>
+            public long Lost { get { return Interlocked.Read(ref _Lost); } }
+
+            /// <summary>
+            /// Datagram in the sequence of the board, parsed when its predecessors
+            /// were, held in the window meanwhile. Buffer goes back to the receiver
+            /// once parsed or dropped. Parser thread only.
+            /// </summary>
+            internal void Receive(ref UdpDatagram d, UdpReceiver receiver)
+            {
+                if ((d.Count < HEADER_LEN) || (d.Buffer[d.Offset] != MAGIC))
                 {
-                    // TODO parse config protocol
+                    receiver.Release(ref d);
+                    return;
+                }
+
+                UInt32 seq = BitConverter.ToUInt32(d.Buffer, d.Offset + 4);
+                UInt32 ahead = seq - _SeqNext;
+                UInt32 behind = _SeqNext - seq;
+                bool reboot = false;
+
+                // sequence restarts with the board, a lower uptime tells it even when
+                // the restarted one is still within the window behind
+                if ((d.Buffer[d.Offset + 1] == TYPE_ANNOUNCE) && (d.Buffer[d.Offset + 3] != 0) &&
+                    (d.Count >= HEADER_LEN + BoardAnnounce.UPTIME_OFFSET + 4))
+                {
+                    UInt32 uptime = BitConverter.ToUInt32(d.Buffer, d.Offset + HEADER_LEN + BoardAnnounce.UPTIME_OFFSET);
+                    reboot = _Uptime.HasValue && (uptime < _Uptime.Value);
+                    _Uptime = uptime;
+                }
+
+                if (!_SeqValid || reboot || ((behind > REORDER_WINDOW) && (behind <= 0x80000000)) ||
+                    ((ahead >= 0x10000) && (ahead < 0x80000000)))
+                {
+                    // reboot of the board, or a far jump, not a loss
+                    Skip(receiver, false);
+                    _SeqNext = seq;
+                    _SeqValid = true;
+                    ahead = 0;
+                }
+                else if ((behind != 0) && (behind <= REORDER_WINDOW))
+                {
+                    // duplicate, or late after its gap left the window, counted lost then
+                    receiver.Release(ref d);
+                    return;
+                }
+
+                if ((ahead >= REORDER_WINDOW) && (_HeldCount == 0))
+                {
+                    Interlocked.Add(ref _Lost, ahead);
+                    _SeqNext = seq;
+                }
+
+                while (seq - _SeqNext >= REORDER_WINDOW)
+                    Advance(receiver);
+
+                int slot = (int)(seq & (REORDER_WINDOW - 1));
+                if (_Held[slot].Buffer != null)
+                {
+                    receiver.Release(ref d);
+                    return;
+                }
+
+                if (_HeldCount++ == 0)
+                    _HeldSince = d.Rx;
+                _Held[slot] = d;
+                d = new UdpDatagram();
+
+                Drain(receiver);
+            }
+
+            /// <summary>
+            /// Gaps waiting longer than REORDER_WAIT are given up, called by the idle parser too
+            /// </summary>
+            internal void Expire(UInt64 now, UdpReceiver receiver)
+            {
+                if ((_HeldCount > 0) && (now - _HeldSince > REORDER_WAIT * 1000UL))
+                    Skip(receiver, true);
+            }
+
+            // held ones parsed in the order, the gaps counted lost when asked to
+            private void Skip(UdpReceiver receiver, bool lost)
+            {
+                while (_HeldCount > 0)
+                {
+                    if (_Held[_SeqNext & (REORDER_WINDOW - 1)].Buffer == null)
+                    {
+                        if (lost)
+                            Interlocked.Increment(ref _Lost);
+                        _SeqNext++;
+                    }
+
+                    Drain(receiver);
                 }
             }
 
-            internal CanMessage UnpackCanMessage(BinaryReader br)
+            // window moves by one, the gap at its start is lost
+            private void Advance(UdpReceiver receiver)
             {
-                UInt32 cob = br.ReadUInt32();
-                UInt16 tim = br.ReadUInt16();
-                byte src = br.ReadByte();
-                byte rs1 = br.ReadByte(); /* zero */
-                byte[] d = br.ReadBytes(8);
-                byte dlen = br.ReadByte();
-                byte[] p = br.ReadBytes(7); /* PAD */
-                UInt64 t = br.ReadUInt64();
+                if (_Held[_SeqNext & (REORDER_WINDOW - 1)].Buffer == null)
+                {
+                    Interlocked.Increment(ref _Lost);
+                    _SeqNext++;
+                }
+
+                Drain(receiver);
+            }
+
+            // datagrams in the sequence from the start of the window
+            private void Drain(UdpReceiver receiver)
+            {
+                int slot = (int)(_SeqNext & (REORDER_WINDOW - 1));
+
+                while (_Held[slot].Buffer != null)
+                {
+                    UdpDatagram h = _Held[slot];
+                    _Held[slot] = new UdpDatagram();
+                    _HeldCount--;
+                    _SeqNext++;
+
+                    Parse(h.Buffer, h.Offset, h.Count, h.Rx);
+                    receiver.Release(ref h);
+
+                    slot = (int)(_SeqNext & (REORDER_WINDOW - 1));
+                }
+
+                // oldest one left starts the wait, rare, the gaps close within a batch
+                if (_HeldCount > 0)
+                {
+                    _HeldSince = UInt64.MaxValue;
+                    for (int i = 0; i < REORDER_WINDOW; i++)
+                        if ((_Held[i].Buffer != null) && (_Held[i].Rx < _HeldSince))
+                            _HeldSince = _Held[i].Rx;
+                }
+            }
+
+            private void Parse(byte[] data, int offset, int length, UInt64 rx)
+            {
+                if (_Refused)
+                    return;
+
+                byte type = data[offset + 1];
+                byte flags = data[offset + 2];
+                byte count = data[offset + 3];
+
+                if (!_Identified && ((type == TYPE_FRAMES) || (type == TYPE_TELEMETRY)))
+                {
+                    if ((_Waiting.Count < ANNOUNCE_BACKLOG) && ((DateTime.UtcNow - _Found).TotalMilliseconds < ANNOUNCE_WAIT))
+                    {
+                        // receive buffer goes back to the pool, rare enough to copy
+                        byte[] copy = new byte[length];
+                        Buffer.BlockCopy(data, offset, copy, 0, length);
+                        _Waiting.Enqueue(Tuple.Create(copy, rx));
+                        return;
+                    }
+
+                    Identify("ip:" + _Endpoint.Address, 2);
+                }
+
+                // the hot path, frames straight from the receive buffer
+                if (type == TYPE_FRAMES)
+                {
+                    int end = offset + Math.Min(length, HEADER_LEN + count * FRAME_LEN);
+                    for (int at = offset + HEADER_LEN; at + FRAME_LEN <= end; at += FRAME_LEN)
+                        CanSharkCore.Pipeline.Post(UnpackCanMessage(data, at, flags));
+                    return;
+                }
+
+                using (MemoryStream ms = new MemoryStream(data, offset + HEADER_LEN, length - HEADER_LEN))
+                {
+                    BinaryReader br = new BinaryReader(ms);
+
+                    if (type == TYPE_ANNOUNCE)
+                    {
+                        if (count == 0)
+                            return;
+
+                        _Announce = BoardAnnounce.DeserializeFrom(br);
+                        if (!_Identified)
+                            Identify(_Announce.Key, _Announce.Ports);
+
+                        CanSharkCore.Announces[_BoardID] = _Announce;
+                        return;
+                    }
+
+                    if (type == TYPE_TELEMETRY)
+                    {
+                        CanSharkCore.Telemetry[_BoardID] = BoardTelemetry.DeserializeFrom(br);
+                    }
+                    else if (type == TYPE_SYNC)
+                    {
+                        TimeSync.Message msg = TimeSync.Message.DeserializeFrom(br);
+
+                        if (msg.Kind == TimeSync.DELAY_REQ)
+                        {
+                            msg.Kind = TimeSync.DELAY_RESP;
+                            msg.Time = rx;
+                            Send(_Socket, _Endpoint, TYPE_SYNC, msg.Seq, msg.SerializeTo);
+                        }
+                        else if (msg.Kind == TimeSync.STATUS)
+                        {
+                            _Sync.Update(msg);
+                        }
+                    }
+                    else if (type == TYPE_SDO)
+                    {
+                        for (int i = 0; i < count; i++)
+                        {
+                            ObjectRead r = ObjectRead.DeserializeFrom(br);
+                            ObjectJob job;
+
+                            if (!_Jobs.TryGetValue(r.Id, out job))
+                                continue;
+
+                            lock (job.Results)
+                                job.Results.Add(r);
 
+                            // node 0 record ends the job
+                            if (r.Node == 0)
+                                job.Done.TrySetResult(true);
+                        }
+                    }
+                    else if (type == TYPE_CONTROL)
+                    {
+                        for (int i = 0; i < count; i++)
+                        {
+                            BoardControl rep = BoardControl.DeserializeFrom(br);
+                            TaskCompletionSource<BoardControl> tcs;
+
+                            // pending replies are followed by the final one
+                            if ((rep.Status != BoardControl.STATUS_PENDING) && _Requests.TryRemove(rep.Id, out tcs))
+                                tcs.SetResult(rep);
+                        }
+                    }
+                    else
+                    {
+                        // types of newer firmware are skipped
+                    }
+                }
+            }
 
-                Array.Resize(ref d, dlen);
+            /// <summary>
+            /// Frame record, struct can_message, read in place
+            /// </summary>
+            internal CanMessage UnpackCanMessage(byte[] data, int at, byte flags)
+            {
+                UInt32 cob = BitConverter.ToUInt32(data, at);
+                UInt16 tim = BitConverter.ToUInt16(data, at + 4);
+                byte src = data[at + 6];
+                byte dlen = Math.Min(data[at + 16], (byte)8);
+                UInt64 hi = BitConverter.ToUInt16(data, at + 18);
+                UInt64 mid = BitConverter.ToUInt32(data, at + 20);
+                UInt64 t = _Sync.Map(BitConverter.ToUInt64(data, at + 24));
+                byte port = (byte)((src & 7) - 1);
 
                 return new CanMessage(
-                    CanSourceId.Source(_BoardID, (byte)((src & 7) - 1)),
+                    CanSourceId.Source(_BoardID, port),
                     CanMailboxId.Mailbox((src & 0x08) != 0, (byte)(src >> 4)),
-                    cob, d)
+                    cob)
                 {
+                    // bytes past the length cleared, frames of equal data compare equal
+                    Payload = BitConverter.ToUInt64(data, at + 8) & (dlen == 8 ? UInt64.MaxValue : (1UL << (dlen * 8)) - 1),
+                    Length = dlen,
                     Time = tim,
-                    Sec = (UInt32)(long)(t / (1000 * 1000)),
-                    Usec = (UInt32)((long)(t % (1000 * 1000)))
+                    BitTime = hi << 48 | mid << 16 | tim,
+                    Backlog = (flags & FLAG_BACKLOG) != 0,
+                    Passive = (flags & (FLAG_SILENT << port)) != 0,
+                    Sec = (UInt32)(t / (1000 * 1000)),
+                    Usec = (UInt32)(t % (1000 * 1000))
                 };
             }
         }
 
+        /// <summary>
+        /// Sends single record datagram
+        /// </summary>
+        internal static void Send(UdpClient ucl, IPEndPoint ep, byte type, UInt32 seq, Action<BinaryWriter> record)
+        {
+            Send(ucl, ep, type, seq, 1, record);
+        }
+
+        /// <summary>
+        /// Sends datagram of count records
+        /// </summary>
+        internal static void Send(UdpClient ucl, IPEndPoint ep, byte type, UInt32 seq, byte count, Action<BinaryWriter> records)
+        {
+            using (MemoryStream ms = new MemoryStream())
+            {
+                BinaryWriter bw = new BinaryWriter(ms);
+
+                bw.Write(MAGIC);
+                bw.Write(type);
+                bw.Write((byte)0); /* flags */
+                bw.Write(count);
+                bw.Write(seq);
+                records(bw);
+
+                byte[] data = ms.ToArray();
+                ucl.Send(data, data.Length, ep);
+            }
+        }
+
+        /// <summary>
+        /// Own sync broadcast looped back, not from any board
+        /// </summary>
+        private static bool IsSyncMaster(byte[] data, int offset, int length)
+        {
+            if ((length <= HEADER_LEN) || (data[offset] != MAGIC) || (data[offset + 1] != TYPE_SYNC))
+                return false;
+
+            byte kind = data[offset + HEADER_LEN];
+            return (kind == TimeSync.SYNC) || (kind == TimeSync.FOLLOW_UP) || (kind == TimeSync.DELAY_RESP);
+        }
+
+        private static void SendSync(UdpClient ucl, UInt16 seq)
+        {
+            IPEndPoint ep = new IPEndPoint(IPAddress.Broadcast, 6000);
+            TimeSync.Message msg = new TimeSync.Message() { Kind = TimeSync.SYNC, Seq = seq };
+
+            // follow up carries the time the sync really left
+            UInt64 t1 = TimeSync.Now;
+            Send(ucl, ep, TYPE_SYNC, seq, msg.SerializeTo);
+
+            msg.Kind = TimeSync.FOLLOW_UP;
+            msg.Time = t1;
+            Send(ucl, ep, TYPE_SYNC, seq, msg.SerializeTo);
+        }
+
         private bool exit;
         private AutoResetEvent evt = new AutoResetEvent(false);
         private ConcurrentDictionary<IPEndPoint, BoardInfo> Boards = new ConcurrentDictionary<IPEndPoint, BoardInfo>();
+        private int _RcvBuf;
+        private int _Outstanding;
+        private UdpReceiver _Receiver;
 
-        public EthBoard()
+        /// <summary>
+        /// Kernel buffer and receives posted at once, sized for several boards streaming together
+        /// </summary>
+        public EthBoard(int rcvbuf = UdpReceiver.RCVBUF_DEFAULT, int outstanding = UdpReceiver.OUTSTANDING_DEFAULT)
         {
+            _RcvBuf = rcvbuf;
+            _Outstanding = outstanding;
             new Thread(thread) {  Priority = ThreadPriority.AboveNormal }.Start();
         }
 
+        /// <summary>
+        /// Receive counters, null until the socket is open
+        /// </summary>
+        public UdpReceiver.Counters Stats { get { return (_Receiver != null) ? _Receiver.Stats : null; } }
+
+        /// <summary>
+        /// Datagrams lost before the parser, all boards together
+        /// </summary>
+        public long Lost { get { return Boards.Values.Sum(b => b.Lost); } }
+
         private void thread()
         {
             using (UdpClient ucl = new UdpClient(6000))
             {
-                IAsyncResult iar = ucl.BeginReceive(null, null);
+                ucl.EnableBroadcast = true;
+
+                UdpReceiver receiver = new UdpReceiver(ucl.Client, _RcvBuf, _Outstanding);
+                WaitHandle[] waits = { evt, receiver.Ready };
+                UInt16 syncSeq = 0;
+                DateTime syncNext = DateTime.UtcNow;
+
+                _Receiver = receiver;
+                receiver.Start();
 
                 while (!exit)
                 {
-                    WaitHandle.WaitAny(new [] { evt, iar.AsyncWaitHandle });
+                    if (DateTime.UtcNow >= syncNext)
+                    {
+                        syncNext = syncNext.AddMilliseconds(TimeSync.INTERVAL);
+                        SendSync(ucl, ++syncSeq);
+                    }
+
+                    if (WaitHandle.WaitAny(waits, REORDER_WAIT) == WaitHandle.WaitTimeout)
+                    {
+                        foreach (KeyValuePair<IPEndPoint, BoardInfo> b in Boards)
+                            b.Value.Expire(TimeSync.Now, receiver);
+                        continue;
+                    }
 
                     if (exit)
                         break;
 
-                    IPEndPoint ep = new IPEndPoint(0, 0);
-                    byte[] data = ucl.EndReceive(iar, ref ep);
+                    // everything completed meanwhile, the buffers go back one by one
+                    UdpDatagram d;
+                    int batch = 0;
+
+                    while (receiver.TryTake(out d))
+                    {
+                        batch++;
+
+                        if (!IsSyncMaster(d.Buffer, d.Offset, d.Count))
+                        {
+                            // lookup first, the factory closure would allocate per datagram
+                            BoardInfo board;
+                            if (!Boards.TryGetValue(d.From, out board))
+                                board = Boards.GetOrAdd(d.From, e => new BoardInfo(e, ucl));
+
+                            board.Receive(ref d, receiver);
+                            continue;
+                        }
 
-                    iar = ucl.BeginReceive(null, 0);
+                        receiver.Release(ref d);
+                    }
+
+                    receiver.Batch(batch);
 
-                    Boards.GetOrAdd(ep, e => new BoardInfo(e)).ParseMessage(data);
+                    foreach (KeyValuePair<IPEndPoint, BoardInfo> b in Boards)
+                        b.Value.Expire(TimeSync.Now, receiver);
                 }
+
+                receiver.Dispose();
                 ucl.Close();
             }
         }
@@ -0,0 +1,94 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+
+namespace Boards
+{
+    /// <summary>
+    /// Object dictionary entry read by the board SDO client, struct modsdo_entry
+    /// </summary>
+    public sealed class ObjectEntry
+    {
+        #region Variables
+        public byte Node;
+        public UInt16 Index;
+        public byte SubIndex;
+        #endregion
+
+        public void SerializeTo(BinaryWriter bw)
+        {
+            bw.Write(Index);
+            bw.Write(SubIndex);
+            bw.Write(Node);
+        }
+
+        /// <summary>
+        /// Round robin over the nodes, the board reads different nodes at once
+        /// </summary>
+        public static IEnumerable<ObjectEntry> Interleave(IEnumerable<ObjectEntry> entries)
+        {
+            List<Queue<ObjectEntry>> nodes = entries.GroupBy(e => e.Node).Select(g => new Queue<ObjectEntry>(g)).ToList();
+
+            while (nodes.Count > 0)
+            {
+                foreach (Queue<ObjectEntry> q in nodes)
+                    yield return q.Dequeue();
+
+                nodes.RemoveAll(q => q.Count == 0);
+            }
+        }
+    }
+
+    /// <summary>
+    /// Result of the single entry, struct modsdo_result with the value
+    /// </summary>
+    public sealed class ObjectRead
+    {
+        public const byte FLAG_BLOCK = 0x01;
+
+        public const UInt32 ABORT_TIMEOUT = 0x05040000;
+        public const UInt32 ABORT_GENERAL = 0x08000000;
+
+        #region Variables
+        public UInt16 Id;               // job
+        public byte Node;               // 0 when the job was refused
+        public UInt16 Index;
+        public byte SubIndex;
+        public UInt32 Size;             // whole value, Data may be cut
+        public UInt32 Abort;            // SDO abort code, 0 when read
+        public byte[] Data;
+        #endregion
+
+        public bool Success { get { return Abort == 0; } }
+
+        public static ObjectRead DeserializeFrom(BinaryReader br)
+        {
+            ObjectRead r = new ObjectRead();
+
+            r.Id = br.ReadUInt16();
+            r.Index = br.ReadUInt16();
+            r.SubIndex = br.ReadByte();
+            r.Node = br.ReadByte();
+            UInt16 length = br.ReadUInt16();
+            r.Size = br.ReadUInt32();
+            r.Abort = br.ReadUInt32();
+            r.Data = br.ReadBytes(length);
+
+            return r;
+        }
+
+        /// <summary>
+        /// Header of the job, struct modsdo_job, entries follow
+        /// </summary>
+        public static void SerializeJob(BinaryWriter bw, UInt16 id, byte port, byte flags, UInt16 timeout, byte sessions, byte retries)
+        {
+            bw.Write(id);
+            bw.Write(port);
+            bw.Write(flags);
+            bw.Write(timeout);
+            bw.Write(sessions);
+            bw.Write(retries);
+        }
+    }
+}
@@ -0,0 +1,104 @@
+﻿using System;
+using System.Diagnostics;
+using System.IO;
+
+namespace Boards
+{
+    /// <summary>
+    /// Host side of the PTP like clock sync, struct modsync_msg.
+    /// Host is the master, boards report how their ticks map to the host time.
+    /// </summary>
+    public sealed class TimeSync
+    {
+        public const byte SYNC = 1;
+        public const byte FOLLOW_UP = 2;
+        public const byte DELAY_REQ = 3;
+        public const byte DELAY_RESP = 4;
+        public const byte STATUS = 5;
+
+        public const int INTERVAL = 1000;   // ms
+
+        #region Message
+        public sealed class Message
+        {
+            public byte Kind;
+            public UInt16 Seq;
+            public Int32 Drift;             // ppb
+            public UInt64 Time;             // us
+            public Int64 Offset;            // us
+            public UInt32 Delay;            // us
+            public UInt32 Exchanges;
+
+            public void SerializeTo(BinaryWriter bw)
+            {
+                bw.Write(Kind);
+                bw.Write((byte)0); /* reserved */
+                bw.Write(Seq);
+                bw.Write(Drift);
+                bw.Write(Time);
+                bw.Write(Offset);
+                bw.Write(Delay);
+                bw.Write(Exchanges);
+            }
+
+            public static Message DeserializeFrom(BinaryReader br)
+            {
+                Message m = new Message();
+
+                m.Kind = br.ReadByte();
+                br.ReadByte(); /* reserved */
+                m.Seq = br.ReadUInt16();
+                m.Drift = br.ReadInt32();
+                m.Time = br.ReadUInt64();
+                m.Offset = br.ReadInt64();
+                m.Delay = br.ReadUInt32();
+                m.Exchanges = br.ReadUInt32();
+
+                return m;
+            }
+        }
+        #endregion
+
+        #region Host clock
+        private static readonly Stopwatch _Clock = Stopwatch.StartNew();
+        private static readonly UInt64 _Epoch = (UInt64)((DateTime.UtcNow - new DateTime(1970, 1, 1, 0, 0, 0, DateTimeKind.Utc)).Ticks / 10);
+
+        /// <summary>
+        /// Host time [us] since 1970, monotonic
+        /// </summary>
+        public static UInt64 Now
+        {
+            get
+            {
+                long t = _Clock.ElapsedTicks;
+                return _Epoch + (UInt64)(t / Stopwatch.Frequency * 1000000 + t % Stopwatch.Frequency * 1000000 / Stopwatch.Frequency);
+            }
+        }
+        #endregion
+
+        private Message _Status = null;
+
+        /// <summary>
+        /// Last status reported by the board, null until the first exchange
+        /// </summary>
+        public Message Status { get { return _Status; } }
+
+        public void Update(Message status)
+        {
+            _Status = status;
+        }
+
+        /// <summary>
+        /// Maps board ticks onto the host timeline, unchanged until synced
+        /// </summary>
+        public UInt64 Map(UInt64 ticks)
+        {
+            Message s = _Status;
+            if (s == null)
+                return ticks;
+
+            long dt = (long)(ticks - s.Time);
+            return (UInt64)((long)ticks - s.Offset - (long)s.Drift * dt / 1000000000);
+        }
+    }
+}
@@ -0,0 +1,212 @@
+﻿using System;
+using System.Collections.Concurrent;
+using System.Net;
+using System.Net.Sockets;
+using System.Threading;
+
+namespace Boards
+{
+    /// <summary>
+    /// Received datagram, the buffer belongs to the receiver until released
+    /// </summary>
+    public struct UdpDatagram
+    {
+        public byte[] Buffer;
+        public int Offset;
+        public int Count;
+        public IPEndPoint From;
+        public UInt64 Rx;                   // TimeSync.Now when the receive completed
+
+        internal SocketAsyncEventArgs Args;
+    }
+
+    /// <summary>
+    /// Receive engine of the board datagrams. Several receives are posted at once
+    /// over buffers of one pool, the kernel buffer absorbs the bursts meanwhile.
+    /// Filled buffers wait for the single parser thread in the order of completion,
+    /// which is not the order sent, the boards put them back in their sequence.
+    /// </summary>
+    public sealed class UdpReceiver : IDisposable
+    {
+        public const int DATAGRAM_MAX = 1536;       // board datagrams fit the ethernet frame
+        public const int RCVBUF_DEFAULT = 8 << 20;  // bytes
+        public const int OUTSTANDING_DEFAULT = 8;
+        public const int BUFFERS_DEFAULT = 512;
+
+        /// <summary>
+        /// Counters since the start, read without locking
+        /// </summary>
+        public class Counters
+        {
+            public long Datagrams;
+            public long Bytes;
+            public long Errors;             // receives failed, ICMP unreachable included
+            public long Starved;            // no free buffer, parser behind, kernel buffer fills
+            public long Batches;            // parser wakeups with data
+            public int BatchMax;            // datagrams taken at once
+        }
+
+        private class Token
+        {
+            public UInt64 Rx;
+        }
+
+        #region Variables
+        private Socket _Socket;
+        private byte[] _Pool;
+        private ConcurrentQueue<SocketAsyncEventArgs> _Free = new ConcurrentQueue<SocketAsyncEventArgs>();
+        private ConcurrentQueue<SocketAsyncEventArgs> _Filled = new ConcurrentQueue<SocketAsyncEventArgs>();
+        private AutoResetEvent _Ready = new AutoResetEvent(false);
+        private Counters _Counters = new Counters();
+        private int _Outstanding;
+        private int _Posted;
+        private volatile bool _Closed;
+        #endregion
+
+        public UdpReceiver(Socket socket, int rcvbuf = RCVBUF_DEFAULT, int outstanding = OUTSTANDING_DEFAULT, int buffers = BUFFERS_DEFAULT)
+        {
+            _Socket = socket;
+            _Socket.ReceiveBufferSize = rcvbuf;
+            _Outstanding = Math.Min(outstanding, buffers);
+
+            // one block, the buffers do not fragment the heap when pinned by the receives
+            _Pool = new byte[buffers * DATAGRAM_MAX];
+            for (int i = 0; i < buffers; i++)
+            {
+                SocketAsyncEventArgs e = new SocketAsyncEventArgs();
+                e.SetBuffer(_Pool, i * DATAGRAM_MAX, DATAGRAM_MAX);
+                e.UserToken = new Token();
+                e.Completed += OnCompleted;
+                _Free.Enqueue(e);
+            }
+        }
+
+        /// <summary>
+        /// Signaled when datagrams are ready to take
+        /// </summary>
+        public WaitHandle Ready { get { return _Ready; } }
+
+        public Counters Stats { get { return _Counters; } }
+
+        /// <summary>
+        /// Kernel buffer really granted, the system may limit it
+        /// </summary>
+        public int ReceiveBufferSize { get { return _Socket.ReceiveBufferSize; } }
+
+        public void Start()
+        {
+            Post();
+        }
+
+        /// <summary>
+        /// Next datagram in the order of completion, parser thread only
+        /// </summary>
+        public bool TryTake(out UdpDatagram d)
+        {
+            SocketAsyncEventArgs e;
+            d = new UdpDatagram();
+
+            if (!_Filled.TryDequeue(out e))
+                return false;
+
+            d.Buffer = e.Buffer;
+            d.Offset = e.Offset;
+            d.Count = e.BytesTransferred;
+            d.From = (IPEndPoint)e.RemoteEndPoint;
+            d.Rx = ((Token)e.UserToken).Rx;
+            d.Args = e;
+            return true;
+        }
+
+        /// <summary>
+        /// Buffer of the datagram back to the pool, receives posted again
+        /// </summary>
+        public void Release(ref UdpDatagram d)
+        {
+            _Free.Enqueue(d.Args);
+            d.Args = null;
+            d.Buffer = null;
+            Post();
+        }
+
+        /// <summary>
+        /// Datagrams taken by one wakeup of the parser
+        /// </summary>
+        public void Batch(int count)
+        {
+            if (count == 0)
+                return;
+
+            _Counters.Batches++;
+            if (count > _Counters.BatchMax)
+                _Counters.BatchMax = count;
+        }
+
+        private void Post()
+        {
+            while (!_Closed)
+            {
+                if (Interlocked.Increment(ref _Posted) > _Outstanding)
+                {
+                    Interlocked.Decrement(ref _Posted);
+                    return;
+                }
+
+                SocketAsyncEventArgs e;
+                if (!_Free.TryDequeue(out e))
+                {
+                    Interlocked.Decrement(ref _Posted);
+                    Interlocked.Increment(ref _Counters.Starved);
+                    return;
+                }
+
+                e.RemoteEndPoint = new IPEndPoint(IPAddress.Any, 0);
+
+                try
+                {
+                    if (_Socket.ReceiveFromAsync(e))
+                        continue;
+                }
+                catch (ObjectDisposedException)
+                {
+                    return;
+                }
+
+                // completed synchronously, no callback comes
+                Completed(e);
+            }
+        }
+
+        private void OnCompleted(object sender, SocketAsyncEventArgs e)
+        {
+            Completed(e);
+            Post();
+        }
+
+        private void Completed(SocketAsyncEventArgs e)
+        {
+            ((Token)e.UserToken).Rx = TimeSync.Now;
+            Interlocked.Decrement(ref _Posted);
+
+            if ((e.SocketError == SocketError.Success) && (e.BytesTransferred > 0))
+            {
+                Interlocked.Increment(ref _Counters.Datagrams);
+                Interlocked.Add(ref _Counters.Bytes, e.BytesTransferred);
+                _Filled.Enqueue(e);
+                _Ready.Set();
+            }
+            else
+            {
+                if (e.SocketError != SocketError.OperationAborted)
+                    Interlocked.Increment(ref _Counters.Errors);
+                _Free.Enqueue(e);
+            }
+        }
+
+        public void Dispose()
+        {
+            _Closed = true;
+            _Ready.Set();
+        }
+    }
+}
@@ -55,6 +55,34 @@ namespace Components.Data
                     ReadOnly = true,
                     Width = 80,
                 },
+                new DataGridViewTextBoxColumn() {
+                    AutoSizeMode = DataGridViewAutoSizeColumnMode.None,
+                    DefaultCellStyle = new DataGridViewCellStyle() {Alignment = DataGridViewContentAlignment.MiddleRight},
+                    HeaderText = "Min",
+                    ReadOnly = true,
+                    Width = 70,
+                },
+                new DataGridViewTextBoxColumn() {
+                    AutoSizeMode = DataGridViewAutoSizeColumnMode.None,
+                    DefaultCellStyle = new DataGridViewCellStyle() {Alignment = DataGridViewContentAlignment.MiddleRight},
+                    HeaderText = "p50",
+                    ReadOnly = true,
+                    Width = 70,
+                },
+                new DataGridViewTextBoxColumn() {
+                    AutoSizeMode = DataGridViewAutoSizeColumnMode.None,
+                    DefaultCellStyle = new DataGridViewCellStyle() {Alignment = DataGridViewContentAlignment.MiddleRight},
+                    HeaderText = "p99",
+                    ReadOnly = true,
+                    Width = 70,
+                },
+                new DataGridViewTextBoxColumn() {
+                    AutoSizeMode = DataGridViewAutoSizeColumnMode.None,
+                    DefaultCellStyle = new DataGridViewCellStyle() {Alignment = DataGridViewContentAlignment.MiddleRight},
+                    HeaderText = "Max",
+                    ReadOnly = true,
+                    Width = 70,
+                },
                 new DataGridViewTextBoxColumn() {
                     AutoSizeMode = DataGridViewAutoSizeColumnMode.None,
                     DefaultCellStyle = new DataGridViewCellStyle() {Alignment = DataGridViewContentAlignment.MiddleRight},
@@ -106,7 +134,7 @@ namespace Components.Data
         {
             base.OnCellFormatting(e);
 
-            if ((e.RowIndex < 0) || (e.RowIndex > _Data.Length))
+            if ((e.RowIndex < 0) || (e.RowIndex >= _Data.Length))
                 return;
 
             CanopenMsg msg = _Data[e.RowIndex];
@@ -119,7 +147,7 @@ namespace Components.Data
         {
             base.OnCellValueNeeded(e);
 
-            if ((e.RowIndex < 0) || (e.RowIndex > _Data.Length))
+            if ((e.RowIndex < 0) || (e.RowIndex >= _Data.Length))
             {
                 e.Value = "ERROR";
                 return;
@@ -133,8 +161,12 @@ namespace Components.Data
                 case 1: e.Value = msg.COB.ToString(); break;
                 case 2: e.Value = msg.data; break;
                 case 3: e.Value = "+" + (msg.delay*1000).ToString("F3") + " ms"; break;
-                case 4: e.Value = "+" + (msg.length*1000).ToString("F3") + " ms"; break;
-                case 5: e.Value = msg.count.ToString("D"); break;
+                case 4: e.Value = (msg.Offset(0)*1000).ToString("F3"); break;
+                case 5: e.Value = (msg.Offset(50)*1000).ToString("F3"); break;
+                case 6: e.Value = (msg.Offset(99)*1000).ToString("F3"); break;
+                case 7: e.Value = (msg.Offset(100)*1000).ToString("F3"); break;
+                case 8: e.Value = "+" + (msg.length*1000).ToString("F3") + " ms"; break;
+                case 9: e.Value = msg.count.ToString("D"); break;
                 default: e.Value = "ERROR"; break;
             }
         }
@@ -1,4 +1,5 @@
 ﻿using Analysis;
+using Core;
 using System;
 using System.Collections.Generic;
 using System.ComponentModel;
@@ -74,8 +75,12 @@ namespace Components.Data
         #endregion
 
         #region Private
-        private List<CanMessage> _Data = new List<CanMessage>();
+        private MessageLog _Data = null;
         private UInt32 BaseTime = 0; 
+
+        // row being formatted, the log is read once for all its cells
+        private long _RowIndex = -1;
+        private CanMessage _Row;
         #endregion
 
         #region Constructor/Destructor
@@ -122,13 +127,19 @@ namespace Components.Data
         {
             base.OnCellValueNeeded(e);
 
-            if ((e.RowIndex < 0) || (e.RowIndex > _Data.Count))
+            if ((_Data == null) || (e.RowIndex < 0) || (e.RowIndex >= _Data.Count))
             {
                 e.Value = "ERROR";
                 return;
             }
 
-            CanMessage msg = _Data[e.RowIndex];            
+            if (e.RowIndex != _RowIndex)
+            {
+                _Row = _Data[e.RowIndex];
+                _RowIndex = e.RowIndex;
+            }
+
+            CanMessage msg = _Row;
 
             switch (e.ColumnIndex)
             {
@@ -142,11 +153,23 @@ namespace Components.Data
             }
         }
 
-        public void UpdateData(List<CanMessage> data)
+        /// <summary>
+        /// Rows read through the log on demand, only the count is taken here
+        /// </summary>
+        public void UpdateData(MessageLog data)
         {
-            _Data = data;
-            RowCount = _Data.Count;
-            BaseTime = _Data[0].Sec;
+            long count = data.Count;
+            if (count == 0)
+                return;
+
+            if (data != _Data)
+            {
+                _Data = data;
+                _RowIndex = -1;
+                BaseTime = _Data[0].Sec;
+            }
+
+            RowCount = (int)Math.Min(count, int.MaxValue);
 
 /*            if (FirstDisplayedCell != null)
             {
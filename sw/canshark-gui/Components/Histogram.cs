@@ -119,31 +119,27 @@ namespace canshark
                         _CellSize.Height - 1); 
         }
 
+        /// <summary>
+        /// Redraws the changed identifiers only, zero count clears the cell
+        /// </summary>
         public void UpdateChanges(Dictionary<CanObjectId, int> Changes)
         {
+            if (Changes.Count == 0)
+                return;
+
             using (Graphics g = Graphics.FromImage(bmp))
             {
-                // clear pixels, they are missing in the new changeset
-                using (Brush br = new SolidBrush(_rainbow[0].Item2))
-                foreach (var pt in LastHistogramData)
-                {
-                    if (Changes.ContainsKey(pt.Key))
-                        continue;
-
-                    int std = (int)pt.Key.IdStd;
-                    int x = (int)(std % _Columns) * _CellSize.Width;
-                    int y = (int)(std / _Columns) * _CellSize.Height;
-
-                    g.FillRectangle(br, x, y, _CellSize.Width - 1, _CellSize.Height - 1);
-                }
-
-                // colorize pixels they have been new or changed in the new changeset
                 foreach (var pt in Changes)
                 {
                     int val;
                     if (LastHistogramData.TryGetValue(pt.Key, out val) && (val == pt.Value))
                         continue;
 
+                    if (pt.Value == 0)
+                        LastHistogramData.Remove(pt.Key);
+                    else
+                        LastHistogramData[pt.Key] = pt.Value;
+
                     int std = (int)pt.Key.IdStd;
                     int x = (int)(std % _Columns) * _CellSize.Width;
                     int y = (int)(std / _Columns) * _CellSize.Height;
@@ -153,8 +149,6 @@ namespace canshark
                 }
             }
 
-            LastHistogramData = Changes;
-
             Invalidate();
         }
 
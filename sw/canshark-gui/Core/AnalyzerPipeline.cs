@@ -0,0 +1,191 @@
+﻿using Analysis;
+using System;
+using System.Collections.Concurrent;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Linq;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace Core
+{
+    /// <summary>
+    /// Analysis stage between the boards and the analyzers. Frames are taken in
+    /// bounded batches by its own thread, every analyzer gets the batch on a worker
+    /// thread, sharded analyzers get it split by the source. Batches go one after
+    /// another, so every analyzer sees the frames in the order received.
+    /// </summary>
+    public sealed class AnalyzerPipeline : IDisposable
+    {
+        public const int CAPACITY = 1 << 18;        // frames queued, ingest waits above
+        public const int BATCH_MAX = 8192;          // frames
+
+        /// <summary>
+        /// Counters since the start, read without locking
+        /// </summary>
+        public class Counters
+        {
+            public long Frames;             // analyzed
+            public long Batches;
+            public int BatchLast;           // frames
+            public long Stalls;             // ingest waited for the space
+            public double BatchTime;        // ms, last batch through all analyzers
+            public int DepthMax;            // frames queued at most
+        }
+
+        #region Variables
+        private ConcurrentQueue<CanMessage> _Queue = new ConcurrentQueue<CanMessage>();
+        private AutoResetEvent _Ready = new AutoResetEvent(false);
+        private ManualResetEventSlim _Space = new ManualResetEventSlim(true);
+        private Counters _Counters = new Counters();
+        private int _Capacity;
+        private int _Depth;
+        private volatile bool _Exit;
+        #endregion
+
+        public AnalyzerPipeline(int capacity = CAPACITY)
+        {
+            _Capacity = capacity;
+            new Thread(thread) { IsBackground = true, Name = "analysis" }.Start();
+        }
+
+        /// <summary>
+        /// Frames waiting for the analysis
+        /// </summary>
+        public int Depth { get { return Volatile.Read(ref _Depth); } }
+
+        public int Capacity { get { return _Capacity; } }
+
+        public Counters Stats { get { return _Counters; } }
+
+        /// <summary>
+        /// Queues the frame. When the stage is behind by the capacity the caller
+        /// waits, the receive buffers of the boards take the burst meanwhile.
+        /// </summary>
+        public void Post(CanMessage msg)
+        {
+            int depth = Interlocked.Increment(ref _Depth);
+
+            if (depth > _Capacity)
+            {
+                Interlocked.Increment(ref _Counters.Stalls);
+                _Space.Reset();
+                while ((Volatile.Read(ref _Depth) > _Capacity) && !_Exit)
+                    _Space.Wait(10);
+            }
+            else if (depth > _Counters.DepthMax)
+            {
+                _Counters.DepthMax = depth;
+            }
+
+            _Queue.Enqueue(msg);
+
+            // the stage sleeps only when empty
+            if (depth == 1)
+                _Ready.Set();
+        }
+
+        private CanMessage[] Take()
+        {
+            int n = Math.Min(Volatile.Read(ref _Depth), BATCH_MAX);
+            CanMessage[] batch = new CanMessage[n];
+            int i = 0;
+
+            // depth counts the frames being posted, the queue may be behind it
+            while ((i < n) && _Queue.TryDequeue(out batch[i]))
+                i++;
+
+            if (i < n)
+                Array.Resize(ref batch, i);
+
+            Interlocked.Add(ref _Depth, -i);
+            _Space.Set();
+            return batch;
+        }
+
+        /// <summary>
+        /// Sharded analyzers get the frames of each source separately, in order
+        /// </summary>
+        private static IEnumerable<CanMessage[]> Shards(CanMessage[] batch)
+        {
+            Dictionary<CanSourceId, List<CanMessage>> shards = new Dictionary<CanSourceId, List<CanMessage>>();
+
+            foreach (CanMessage m in batch)
+            {
+                List<CanMessage> l;
+                if (!shards.TryGetValue(m.Source, out l))
+                    shards[m.Source] = l = new List<CanMessage>();
+                l.Add(m);
+            }
+
+            return shards.Values.Select(l => l.ToArray()).ToList();
+        }
+
+        private void Run(CanMessage[] batch)
+        {
+            IAnalyzer[] analyzers = CanSharkCore.Analyzers.ToArray();
+            List<Action> work = new List<Action>();
+            IEnumerable<CanMessage[]> shards = null;
+
+            foreach (IAnalyzer a in analyzers)
+            {
+                IAnalyzer an = a;
+
+                if (!(an is IShardedAnalyzer))
+                {
+                    work.Add(() => an.Analyze(batch));
+                    continue;
+                }
+
+                if (shards == null)
+                    shards = Shards(batch);
+
+                foreach (CanMessage[] shard in shards)
+                {
+                    CanMessage[] s = shard;
+                    work.Add(() => an.Analyze(s));
+                }
+            }
+
+            Parallel.ForEach(work, w => w());
+        }
+
+        private void thread()
+        {
+            while (!_Exit)
+            {
+                if (Depth == 0)
+                {
+                    _Ready.WaitOne(100);
+                    continue;
+                }
+
+                // analyzer busy with its own work, frames wait
+                if (CanSharkCore.Analyzers.Any(a => a.IsRunning))
+                {
+                    Thread.Sleep(10);
+                    continue;
+                }
+
+                Stopwatch sw = Stopwatch.StartNew();
+                CanMessage[] batch = Take();
+                if (batch.Length == 0)
+                    continue;
+
+                Run(batch);
+
+                _Counters.Frames += batch.Length;
+                _Counters.Batches++;
+                _Counters.BatchLast = batch.Length;
+                _Counters.BatchTime = sw.Elapsed.TotalMilliseconds;
+            }
+        }
+
+        public void Dispose()
+        {
+            _Exit = true;
+            _Ready.Set();
+            _Space.Set();
+        }
+    }
+}
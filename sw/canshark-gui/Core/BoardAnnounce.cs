@@ -0,0 +1,88 @@
+﻿using System;
+using System.IO;
+using System.Linq;
+
+namespace Core
+{
+    /// <summary>
+    /// Identity the board broadcasts periodically, struct modnet_announce
+    /// </summary>
+    public sealed class BoardAnnounce
+    {
+        public const int PORTS = 2;
+
+        public const UInt32 CAP_SYNC = 0x0001;
+        public const UInt32 CAP_SDO = 0x0002;
+        public const UInt32 CAP_NMT = 0x0004;
+        public const UInt32 CAP_GEN = 0x0008;
+        public const UInt32 CAP_BENCH = 0x0010;
+        public const UInt32 CAP_AUTOBAUD = 0x0020;
+        public const UInt32 CAP_SILENT = 0x0040;
+
+        public const int UPTIME_OFFSET = 28;    // of Uptime in the record
+
+        #region Variables
+        public byte[] Mac;                  // stable serial of the board
+        public byte Ports;
+        public byte Protocol;
+        public UInt32[] Uid = new UInt32[3];                // mcu unique id
+        public UInt32 Firmware;             // major << 16 | minor << 8 | patch
+        public UInt32 Caps;                 // CAP_*
+        public UInt32 Uptime;               // s
+
+        public UInt32[] Bitrate = new UInt32[PORTS];        // bit/s
+        public UInt16[] Sample = new UInt16[PORTS];         // permille
+        public bool[] Silent = new bool[PORTS];             // listen only
+        public byte[] Autobaud = new byte[PORTS];           // 0 off, 1 running, 2 locked
+        #endregion
+
+        /// <summary>
+        /// Registry key, the same board has the same one on every run
+        /// </summary>
+        public string Key
+        {
+            get { return "mac:" + Serial; }
+        }
+
+        public string Serial
+        {
+            get { return string.Join("-", Mac.Select(b => b.ToString("X2"))); }
+        }
+
+        public string FirmwareVersion
+        {
+            get { return string.Format("{0}.{1}.{2}", Firmware >> 16, (Firmware >> 8) & 0xFF, Firmware & 0xFF); }
+        }
+
+        public static BoardAnnounce DeserializeFrom(BinaryReader br)
+        {
+            BoardAnnounce a = new BoardAnnounce();
+
+            a.Mac = br.ReadBytes(6);
+            a.Ports = br.ReadByte();
+            a.Protocol = br.ReadByte();
+            for (int i = 0; i < a.Uid.Length; i++)
+                a.Uid[i] = br.ReadUInt32();
+            a.Firmware = br.ReadUInt32();
+            a.Caps = br.ReadUInt32();
+            a.Uptime = br.ReadUInt32();
+
+            for (int i = 0; i < PORTS; i++)
+                a.Bitrate[i] = br.ReadUInt32();
+            for (int i = 0; i < PORTS; i++)
+                a.Sample[i] = br.ReadUInt16();
+            for (int i = 0; i < PORTS; i++)
+                a.Silent[i] = br.ReadByte() != 0;
+            for (int i = 0; i < PORTS; i++)
+                a.Autobaud[i] = br.ReadByte();
+
+            return a;
+        }
+
+        public override string ToString()
+        {
+            return string.Format("{0} fw {1}, {2} ports, {3}", Serial, FirmwareVersion, Ports,
+                string.Join(" ", Enumerable.Range(0, Math.Min((int)Ports, PORTS)).Select(i => (Bitrate[i] / 1000) + "k")));
+        }
+    }
+}
@@ -0,0 +1,118 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+
+namespace Core
+{
+    /// <summary>
+    /// Board IDs kept across runs, keyed by the board serial.
+    /// Stored as "ID SEEN KEY" lines, SEEN in UTC ticks, boards not announcing are
+    /// keyed by their address. All IDs taken, the board seen longest ago gives its ID up.
+    /// </summary>
+    public sealed class BoardRegistry
+    {
+        #region Private
+        private string _Path;
+        private Dictionary<string, byte> _Ids = new Dictionary<string, byte>();
+        private Dictionary<string, long> _Seen = new Dictionary<string, long>();
+        private HashSet<string> _Run = new HashSet<string>();       // given out by this run, never taken back
+        private object _Locker = new object();
+        #endregion
+
+        public static string DefaultPath
+        {
+            get { return Path.Combine(Environment.GetFolderPath(Environment.SpecialFolder.ApplicationData), "canshark", "boards.txt"); }
+        }
+
+        public BoardRegistry(string path)
+        {
+            _Path = path;
+
+            try
+            {
+                if (!File.Exists(path))
+                    return;
+
+                foreach (string line in File.ReadAllLines(path))
+                {
+                    string[] p = line.Split(new[] { ' ' }, 3, StringSplitOptions.RemoveEmptyEntries);
+                    byte id;
+                    long seen = 0;
+
+                    // "ID KEY" of the older files, never seen then
+                    if ((p.Length == 3) && !long.TryParse(p[1], out seen))
+                        p = new[] { p[0], p[1] + " " + p[2] };
+
+                    if ((p.Length >= 2) && byte.TryParse(p[0], out id) && !_Ids.ContainsValue(id))
+                    {
+                        string key = p[p.Length - 1].Trim();
+                        _Ids[key] = id;
+                        _Seen[key] = seen;
+                    }
+                }
+            }
+            catch (IOException)
+            {
+                // starts empty, ids are given again
+            }
+        }
+
+        /// <summary>
+        /// ID of the board, the lowest free one for the board seen first time. With
+        /// none free the ID of the board seen longest ago is taken over, the boards
+        /// of this run keep theirs. InvalidOperationException when all are in this run.
+        /// </summary>
+        public byte GetBoardId(string key)
+        {
+            lock (_Locker)
+            {
+                byte id;
+                if (!_Ids.TryGetValue(key, out id))
+                {
+                    HashSet<byte> used = new HashSet<byte>(_Ids.Values);
+                    int free = Enumerable.Range(0, 256).Where(i => !used.Contains((byte)i)).DefaultIfEmpty(-1).First();
+
+                    if (free < 0)
+                    {
+                        string old = _Ids.Keys.Where(k => !_Run.Contains(k)).OrderBy(k => _Seen[k]).FirstOrDefault();
+                        if (old == null)
+                            throw new InvalidOperationException("All 256 board IDs are used by the boards of this run");
+
+                        free = _Ids[old];
+                        _Ids.Remove(old);
+                        _Seen.Remove(old);
+                    }
+
+                    _Ids[key] = id = (byte)free;
+                }
+
+                _Seen[key] = DateTime.UtcNow.Ticks;
+                _Run.Add(key);
+                Save();
+                return id;
+            }
+        }
+
+        public IDictionary<string, byte> Ids
+        {
+            get { lock (_Locker) return new Dictionary<string, byte>(_Ids); }
+        }
+
+        private void Save()
+        {
+            try
+            {
+                Directory.CreateDirectory(Path.GetDirectoryName(_Path));
+                File.WriteAllLines(_Path, _Ids.OrderBy(kv => kv.Value).Select(kv => kv.Value + " " + _Seen[kv.Key] + " " + kv.Key));
+            }
+            catch (IOException)
+            {
+                // still valid for this run
+            }
+            catch (UnauthorizedAccessException)
+            {
+            }
+        }
+    }
+}
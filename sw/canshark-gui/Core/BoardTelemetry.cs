@@ -0,0 +1,101 @@
+﻿using System;
+using System.IO;
+
+namespace Core
+{
+    /// <summary>
+    /// Health record periodically sent by the board, struct modtelem_record
+    /// </summary>
+    public sealed class BoardTelemetry
+    {
+        public const int LANES = 2;
+        public const int PORTS = 2;
+        public const int LATENCY_BUCKETS = 16;
+
+        #region Variables
+        public UInt32 Uptime;           // ms
+        public UInt32 Loops;            // main loop iterations per second
+        public UInt32 PbufFailures;     // datagrams lost on the board
+        public UInt32 HeapUsed;
+        public UInt32 HeapMax;
+        public UInt32 HeapSize;
+        public UInt32 StackMax;
+        public UInt32 StackSize;
+
+        public UInt16[] RingUsed = new UInt16[LANES];
+        public UInt16[] RingMax = new UInt16[LANES];
+        public UInt16[] RingSize = new UInt16[LANES];
+
+        public UInt32[] Rx = new UInt32[PORTS];
+        public UInt32[] Tx = new UInt32[PORTS];
+        public UInt32[] Lost = new UInt32[PORTS];
+        public UInt32[,] Overrun = new UInt32[PORTS, 2];    // hw FIFO0 (critical), FIFO1 (bulk)
+        public UInt32[] Errors = new UInt32[PORTS];
+
+        public UInt32[] Bitrate = new UInt32[PORTS];        // bit/s
+        public UInt16[] Sample = new UInt16[PORTS];         // permille
+        public byte[] Autobaud = new byte[PORTS];           // 0 off, 1 running, 2 locked
+        public bool[] Silent = new bool[PORTS];             // listen only
+
+        public UInt32[] GenSent = new UInt32[PORTS];       // generator frames
+        public UInt32[] GenStarved = new UInt32[PORTS];    // waited for the free mailbox
+        public UInt16[] GenLoad = new UInt16[PORTS];       // achieved, permille
+        public UInt16[] GenTarget = new UInt16[PORTS];     // permille, 0 stopped
+
+        public UInt32[,] Latency = new UInt32[LANES, LATENCY_BUCKETS];  // log2 us buckets
+        #endregion
+
+        public static BoardTelemetry DeserializeFrom(BinaryReader br)
+        {
+            BoardTelemetry t = new BoardTelemetry();
+
+            t.Uptime = br.ReadUInt32();
+            t.Loops = br.ReadUInt32();
+            t.PbufFailures = br.ReadUInt32();
+            t.HeapUsed = br.ReadUInt32();
+            t.HeapMax = br.ReadUInt32();
+            t.HeapSize = br.ReadUInt32();
+            t.StackMax = br.ReadUInt32();
+            t.StackSize = br.ReadUInt32();
+
+            for (int i = 0; i < LANES; i++)
+                t.RingUsed[i] = br.ReadUInt16();
+            for (int i = 0; i < LANES; i++)
+                t.RingMax[i] = br.ReadUInt16();
+            for (int i = 0; i < LANES; i++)
+                t.RingSize[i] = br.ReadUInt16();
+
+            for (int i = 0; i < PORTS; i++)
+            {
+                t.Rx[i] = br.ReadUInt32();
+                t.Tx[i] = br.ReadUInt32();
+                t.Lost[i] = br.ReadUInt32();
+                t.Overrun[i, 0] = br.ReadUInt32();
+                t.Overrun[i, 1] = br.ReadUInt32();
+                t.Errors[i] = br.ReadUInt32();
+            }
+
+            for (int i = 0; i < PORTS; i++)
+            {
+                t.Bitrate[i] = br.ReadUInt32();
+                t.Sample[i] = br.ReadUInt16();
+                t.Autobaud[i] = br.ReadByte();
+                t.Silent[i] = br.ReadByte() != 0;
+            }
+
+            for (int l = 0; l < LANES; l++)
+                for (int b = 0; b < LATENCY_BUCKETS; b++)
+                    t.Latency[l, b] = br.ReadUInt32();
+
+            for (int i = 0; i < PORTS; i++)
+            {
+                t.GenSent[i] = br.ReadUInt32();
+                t.GenStarved[i] = br.ReadUInt32();
+                t.GenLoad[i] = br.ReadUInt16();
+                t.GenTarget[i] = br.ReadUInt16();
+            }
+
+            return t;
+        }
+    }
+}
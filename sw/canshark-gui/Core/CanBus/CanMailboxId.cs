@@ -5,12 +5,47 @@ using System.Text;
 using System.Threading.Tasks;
 
 
-public sealed class CanMailboxId
+public struct CanMailboxId : IEquatable<CanMailboxId>
 {
     private byte _Value;
 
+    public static explicit operator byte(CanMailboxId mbox)
+    {
+        return mbox._Value;
+    }
+
+    public static explicit operator CanMailboxId(byte value)
+    {
+        return new CanMailboxId() { _Value = value };
+    }
+
     public bool IsTx { get { return (_Value & 0x80) != 0; } }
 
+    public bool Equals(CanMailboxId other)
+    {
+        return _Value == other._Value;
+    }
+
+    public static bool operator ==(CanMailboxId a, CanMailboxId b)
+    {
+        return a._Value == b._Value;
+    }
+
+    public static bool operator !=(CanMailboxId a, CanMailboxId b)
+    {
+        return a._Value != b._Value;
+    }
+
+    public override bool Equals(object obj)
+    {
+        return (obj is CanMailboxId) && Equals((CanMailboxId)obj);
+    }
+
+    public override int GetHashCode()
+    {
+        return _Value;
+    }
+
     public static CanMailboxId Mailbox(bool isTx, byte mbox)
     {
         return new CanMailboxId() { _Value = (byte)(mbox | (isTx ? 0x80u : 0u)) };
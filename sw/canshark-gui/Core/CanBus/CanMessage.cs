@@ -1,8 +1,13 @@
 ﻿using System;
 using System.Collections;
 using System.Collections.Generic;
+using Wireshark;
 
-public sealed class CanMessage 
+/// <summary>
+/// Captured frame, a value with the payload inline. Arrays and queues of them
+/// hold the frames without an object per frame.
+/// </summary>
+public struct CanMessage 
 {
     public CanSourceId Source;
     public CanMailboxId Mailbox;
@@ -10,10 +15,15 @@ public sealed class CanMessage
 
     public UInt32 Sec;
     public UInt32 Usec;
-    public byte[] Data = new byte[0];
+    public UInt64 Payload;              // data bytes, the first one lowest
+    public byte Length;                 // data bytes used
     public UInt16 Time;
+    public UInt64 BitTime;              // Time unwrapped by the board, bits above 16 zero from old firmware
+    public bool Backlog;                // captured before the board was online
+    public bool Passive;                // port was listen only
 
     public CanMessage(CanSourceId src, CanMailboxId mbox, CanObjectId cob)
+        : this()
     {
         Source = src;
         Mailbox = mbox;
@@ -21,11 +31,30 @@ public sealed class CanMessage
     }
 
     public CanMessage(CanSourceId src, CanMailboxId mbox, CanObjectId cob, byte[] data)
+        : this(src, mbox, cob)
     {
-        Source = src;
-        Mailbox = mbox;
-        COB = cob;
-        Data = data;
+        Length = (byte)Math.Min(data.Length, 8);
+        for (int i = 0; i < Length; i++)
+            Payload |= (UInt64)data[i] << (i * 8);
+    }
+
+    /// <summary>
+    /// Data byte, no bounds check against Length
+    /// </summary>
+    public byte this[int i] { get { return (byte)(Payload >> (i * 8)); } }
+
+    /// <summary>
+    /// Copy of the data, allocates, for the views only
+    /// </summary>
+    public byte[] Data
+    {
+        get
+        {
+            byte[] d = new byte[Length];
+            for (int i = 0; i < d.Length; i++)
+                d[i] = this[i];
+            return d;
+        }
     }
 
  
@@ -54,21 +83,11 @@ public sealed class CanMessage
             ba.AddBit(false); // r1            
         }
 
-        ba.AddBitsMsb((uint)Data.Length, 4);    // DLC
-        for (int i = 0; i < Data.Length; i++)
-            ba.AddBitsMsb((uint)Data[i], 8);
+        ba.AddBitsMsb((uint)Length, 4);         // DLC
+        for (int i = 0; i < Length; i++)
+            ba.AddBitsMsb((uint)this[i], 8);
 
-        // vypocet crc dle speciikace
-
-        uint CRC = 0;
-        foreach (bool bit in ba.Bits())
-        {
-            CRC <<= 1;
-            if (bit ^ ((CRC & 0x8000) != 0))
-                CRC ^= 0x4599;
-            CRC &= 0x7FFF;
-        }
-        ba.AddBitsMsb(CRC, 15);                   // ToDo CRC computation
+        ba.AddBitsMsb(FrameBits.Crc(this), 15);   // CRC
         ba.AddBit(true); // CRC delimiter
         ba.AddBit(false); // ACK
         ba.AddBit(true); // ACK delimiter
@@ -76,28 +95,34 @@ public sealed class CanMessage
         return ba;
     }
 
+    // stuffed from SOF to the end of CRC, the complementary bit counts in the next run
     public BitArray GetBitsStuffed()
     {
-        int nstuff = 0;
+        int stuffed = FrameLengthUnstuffed - FrameBits.TRAILER;
+        int n = 0;
+        int count = 0;
         bool last = false;
         BitArray ba = new BitArray();
         foreach (bool bit in GetBitsUnstuffed().Bits())
         {
-            if (bit == last)
-                nstuff++;
-            else
+            ba.AddBit(bit);
+            if (n++ >= stuffed)
+                continue;
+
+            if ((count == 0) || (bit != last))
             {
-                nstuff = 1;
+                count = 1;
                 last = bit;
             }
+            else
+                count++;
 
-            if (nstuff > 5)
+            if (count == 5)
             {
                 ba.AddBit(!last);
-                nstuff = 1;
+                last = !last;
+                count = 1;
             }
-
-            ba.AddBit(bit);
         }
 
         return ba;
@@ -105,11 +130,60 @@ public sealed class CanMessage
 
     // 7 consecutive bits EOF not present
     // 3 consecutive bits IFS not present
-    public int FrameLengthUnstuffed { get { return Data.Length * 8 + (COB.IdIsExt ? 57 : 38); } }
+    public int FrameLengthUnstuffed { get { return Length * 8 + (COB.IdIsExt ? 54 : 34) + FrameBits.TRAILER; } }
 
     // 7 consecutive bits EOF not present
     // 3 consecutive bits IFS not present
-    public int FrameLengthStuffed { get { return (Data.Length * 8 + (COB.IdIsExt ? 57 : 38)) * 7 / 6; } }
+    public int FrameLengthStuffed { get { return FrameBits.Length(ref this); } }
+
+    /// <summary>
+    /// Capture record length in the link type, bytes
+    /// </summary>
+    public int SerializeLen(DataLinkType link)
+    {
+        return (link == DataLinkType.DLT_CAN_SOCKETCAN) ? 16 : 8 + Length;
+    }
 
+    /// <summary>
+    /// Capture record, DLT_USER0 is the record of dissector/canshark.lua with the
+    /// console source byte. DLT_CAN_SOCKETCAN is struct can_frame with the id in
+    /// network byte order, EFF, RTR and ERR flags are the same bits as in the COB.
+    /// </summary>
+    public void SerializeTo(DataLinkType link, byte[] buffer, int offset)
+    {
+        uint cob = COB;
+
+        if (link == DataLinkType.DLT_CAN_SOCKETCAN)
+        {
+            uint id = COB.IdIsExt ? cob : (cob & 0xE0000000) | COB.IdStd;
+
+            buffer[offset++] = (byte)(id >> 24);
+            buffer[offset++] = (byte)(id >> 16);
+            buffer[offset++] = (byte)(id >> 8);
+            buffer[offset++] = (byte)id;
+            buffer[offset++] = Length;
+            buffer[offset++] = 0;                   // flags
+            buffer[offset++] = 0;                   // reserved
+            buffer[offset++] = 0;                   // len8_dlc
+
+            // padded to 8, bytes past the length are zero
+            for (int i = 0; i < 8; i++)
+                buffer[offset++] = this[i];
+            return;
+        }
+
+        buffer[offset++] = (byte)(cob >> 24);
+        buffer[offset++] = (byte)(cob >> 16);
+        buffer[offset++] = (byte)(cob >> 8);
+        buffer[offset++] = (byte)cob;
+        buffer[offset++] = Length;
+        buffer[offset++] = (byte)((Source.Port + 1) | (Mailbox.IsTx ? 0x08 : 0) | (((byte)Mailbox & 0x03) << 4) |
+                                  (Passive ? 0x40 : 0) | (Backlog ? 0x80 : 0));
+        buffer[offset++] = (byte)Time;
+        buffer[offset++] = (byte)(Time >> 8);
+
+        for (int i = 0; i < Length; i++)
+            buffer[offset++] = this[i];
+    }
 }
 
@@ -1,7 +1,7 @@
 ﻿using System;
 
 
-public sealed class CanObjectId
+public struct CanObjectId : IEquatable<CanObjectId>
 {
     #region Private
     private UInt32 _Value;
@@ -32,10 +32,25 @@ public sealed class CanObjectId
             return string.Format("{0:X3}", IdStd);
     }
 
+    public bool Equals(CanObjectId other)
+    {
+        return _Value == other._Value;
+    }
+
+    public static bool operator ==(CanObjectId a, CanObjectId b)
+    {
+        return a._Value == b._Value;
+    }
+
+    public static bool operator !=(CanObjectId a, CanObjectId b)
+    {
+        return a._Value != b._Value;
+    }
+
     public override bool Equals(object obj)
     {
         if (obj is CanObjectId)
-            return _Value.Equals((obj as CanObjectId)._Value);
+            return Equals((CanObjectId)obj);
 
         return _Value.Equals(obj);
     }
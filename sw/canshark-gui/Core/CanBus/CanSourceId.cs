@@ -1,10 +1,22 @@
 ﻿using System;
-public sealed class CanSourceId
+public struct CanSourceId : IEquatable<CanSourceId>
 {
     #region Private
     private UInt16 _Value;
     #endregion
 
+    #region Conversions
+    public static explicit operator UInt16(CanSourceId src)
+    {
+        return src._Value;
+    }
+
+    public static explicit operator CanSourceId(UInt16 value)
+    {
+        return new CanSourceId() { _Value = value };
+    }
+    #endregion
+
     #region Variables
     public byte Board { get { return (byte)((_Value >> 8) & 0xFF); } }
     public byte Port { get { return (byte)(_Value & 0xFF); } }
@@ -16,12 +28,24 @@ public sealed class CanSourceId
         return string.Format("{0:D}.CAN{1:D}", Board, Port);
     }
 
-    public override bool Equals(object obj)
+    public bool Equals(CanSourceId other)
     {
-        if (obj is CanSourceId)
-            return _Value.Equals((obj as CanSourceId)._Value);
+        return _Value == other._Value;
+    }
 
-        return base.Equals(obj);
+    public static bool operator ==(CanSourceId a, CanSourceId b)
+    {
+        return a._Value == b._Value;
+    }
+
+    public static bool operator !=(CanSourceId a, CanSourceId b)
+    {
+        return a._Value != b._Value;
+    }
+
+    public override bool Equals(object obj)
+    {
+        return (obj is CanSourceId) && Equals((CanSourceId)obj);
     }
 
     public override int GetHashCode()
@@ -0,0 +1,215 @@
+﻿using System;
+
+/// <summary>
+/// Bit level layout of the frame on the wire, without allocations. The bits
+/// from SOF to the data are kept MSB first in two words, CRC-15 is computed
+/// by bytes from a table and the stuff bits are counted by a table of the run
+/// state, a byte at a step.
+/// </summary>
+public static class FrameBits
+{
+    public const UInt16 CRC_POLY = 0x4599;
+
+    // CRC delimiter, ACK slot, ACK delimiter; EOF and IFS not counted
+    public const int TRAILER = 3;
+
+    // stuffing run state, last bit value * 5 + equal bits 0..4
+    private const int STATES = 10;
+
+    private static readonly UInt16[] _Crc = CrcTable();
+    private static readonly byte[] _Stuff = StuffTable();               // stuff bits << 4 | next state
+
+    private static UInt16[] CrcTable()
+    {
+        UInt16[] table = new UInt16[256];
+
+        for (int i = 0; i < 256; i++)
+        {
+            UInt16 crc = (UInt16)(i << 7);
+            for (int b = 0; b < 8; b++)
+                crc = (UInt16)((((crc & 0x4000) != 0) ? (crc << 1) ^ CRC_POLY : crc << 1) & 0x7FFF);
+            table[i] = crc;
+        }
+
+        return table;
+    }
+
+    private static byte[] StuffTable()
+    {
+        byte[] table = new byte[STATES * 256];
+
+        for (int s = 0; s < STATES; s++)
+        {
+            for (int v = 0; v < 256; v++)
+            {
+                int state = s, stuff = 0;
+                for (int b = 7; b >= 0; b--)
+                    stuff += Step(ref state, ((v >> b) & 1) != 0);
+                table[s * 256 + v] = (byte)((stuff << 4) | state);
+            }
+        }
+
+        return table;
+    }
+
+    /// <summary>
+    /// One bit through the run state, 1 when a stuff bit follows it
+    /// </summary>
+    private static int Step(ref int state, bool bit)
+    {
+        int last = state / 5;
+        int count = state % 5;
+
+        if ((count == 0) || ((last != 0) != bit))
+            count = 1;
+        else
+            count++;
+
+        if (count == 5)
+        {
+            // complementary bit starts the run of the other value
+            state = (bit ? 0 : 5) + 1;
+            return 1;
+        }
+
+        state = (bit ? 5 : 0) + count;
+        return 0;
+    }
+
+    #region 128 bit stream
+    private static void Append(ref UInt64 hi, ref UInt64 lo, UInt64 value, int bits)
+    {
+        hi = (hi << bits) | (lo >> (64 - bits));
+        lo = (lo << bits) | (value & ((1UL << bits) - 1));
+    }
+
+    /// <summary>
+    /// 8 bits ending at the offset from the right
+    /// </summary>
+    private static int Byte(UInt64 hi, UInt64 lo, int offset)
+    {
+        if (offset >= 64)
+            return (int)(hi >> (offset - 64)) & 0xFF;
+        if (offset > 56)
+            return (int)((lo >> offset) | (hi << (64 - offset))) & 0xFF;
+        return (int)(lo >> offset) & 0xFF;
+    }
+
+    /// <summary>
+    /// SOF to the end of the data, right aligned, the count of bits returned
+    /// </summary>
+    private static int Header(ref CanMessage msg, out UInt64 hi, out UInt64 lo)
+    {
+        hi = 0;
+        lo = 0;
+
+        UInt64 h;
+        int n;
+
+        if (!msg.COB.IdIsExt)
+        {
+            // SOF, ID, RTR, IDE, r0, DLC
+            h = ((UInt64)msg.COB.IdStd << 7) | msg.Length;
+            n = 1 + 11 + 3 + 4;
+        }
+        else
+        {
+            // SOF, ID, SRR, IDE, ID extension, RTR, r1, r0, DLC
+            h = ((UInt64)msg.COB.IdStd << 27) | (3UL << 25) | ((UInt64)msg.COB.IdExt << 7) | msg.Length;
+            n = 1 + 11 + 2 + 18 + 3 + 4;
+        }
+
+        lo = h;
+        if (msg.Length == 0)
+            return n;
+
+        // first data byte is the lowest one of the payload, on the wire it goes first
+        UInt64 d = msg.Payload;
+        d = (d >> 32) | (d << 32);
+        d = ((d & 0xFFFF0000FFFF0000) >> 16) | ((d & 0x0000FFFF0000FFFF) << 16);
+        d = ((d & 0xFF00FF00FF00FF00) >> 8) | ((d & 0x00FF00FF00FF00FF) << 8);
+
+        int bits = msg.Length * 8;
+        d >>= 64 - bits;
+        if (bits > 32)
+        {
+            Append(ref hi, ref lo, d >> 32, bits - 32);
+            Append(ref hi, ref lo, d, 32);
+        }
+        else
+            Append(ref hi, ref lo, d, bits);
+
+        return n + bits;
+    }
+
+    private static UInt16 Crc(UInt64 hi, UInt64 lo, int bits)
+    {
+        // leading zero bits keep the zero initial value, padded to whole bytes
+        int crc = 0;
+        for (int offset = (bits + 7) / 8 * 8 - 8; offset >= 0; offset -= 8)
+            crc = ((crc << 8) ^ _Crc[((crc >> 7) ^ Byte(hi, lo, offset)) & 0xFF]) & 0x7FFF;
+
+        return (UInt16)crc;
+    }
+    #endregion
+
+    /// <summary>
+    /// CRC-15 of the frame
+    /// </summary>
+    public static UInt16 Crc(CanMessage msg)
+    {
+        return Crc(ref msg);
+    }
+
+    private static UInt16 Crc(ref CanMessage msg)
+    {
+        UInt64 hi, lo;
+        int bits = Header(ref msg, out hi, out lo);
+
+        return Crc(hi, lo, bits);
+    }
+
+    /// <summary>
+    /// Stuff bits inserted from SOF to the end of the CRC
+    /// </summary>
+    public static int StuffBits(CanMessage msg)
+    {
+        return StuffBits(ref msg);
+    }
+
+    private static int StuffBits(ref CanMessage msg)
+    {
+        UInt64 hi, lo;
+        int bits = Header(ref msg, out hi, out lo);
+
+        Append(ref hi, ref lo, Crc(hi, lo, bits), 15);
+        bits += 15;
+
+        int state = 0, stuff = 0, offset = bits - 8;
+        for (; offset >= 0; offset -= 8)
+        {
+            byte next = _Stuff[state * 256 + Byte(hi, lo, offset)];
+            stuff += next >> 4;
+            state = next & 0x0F;
+        }
+
+        // rest of the bits, less than a byte
+        for (int b = offset + 7; b >= 0; b--)
+            stuff += Step(ref state, ((lo >> b) & 1) != 0);
+
+        return stuff;
+    }
+
+    /// <summary>
+    /// Bits on the wire from SOF to the ACK delimiter, EOF and IFS not counted
+    /// </summary>
+    public static int Length(CanMessage msg)
+    {
+        return Length(ref msg);
+    }
+
+    internal static int Length(ref CanMessage msg)
+    {
+        return (msg.COB.IdIsExt ? 54 : 34) + msg.Length * 8 + StuffBits(ref msg) + TRAILER;
+    }
+}
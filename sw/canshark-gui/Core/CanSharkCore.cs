@@ -10,39 +10,16 @@ namespace Core
         public static ConcurrentDictionary<int, object> Boards = new ConcurrentDictionary<int, object>();      // List of all boards that receives packets
         public static BlockingCollection<CanSourceId> Sources = new BlockingCollection<CanSourceId>();      // List of all CAN ports
 
-        public static ConcurrentQueue<CanMessage> InputQueue = new ConcurrentQueue<CanMessage>();           // Queue of unprocessed packets
         public static ConcurrentBag<IAnalyzer> Analyzers = new ConcurrentBag<IAnalyzer>();                  // List of all analyzers
-
-        public static void Analyze()
-        {
-            foreach (IAnalyzer anal in Analyzers)
-                if (anal.IsRunning)
-                    return;
-
-            CanMessage[] msgs = new CanMessage[InputQueue.Count];
-
-            for (int i = 0; i < msgs.Length; i++)
-                if (!InputQueue.TryDequeue(out msgs[i]))
-                {
-                    Array.Resize(ref msgs, i - 1);
-                    break;
-                }
-
-            foreach (IAnalyzer anal in Analyzers)
-                anal.Analyze(msgs);
-
-        }
-
-        private static byte _BoardId = 0;
-        private static object _BoardIdLocker = new object();
-        public static byte GetNewBoardId()
-        {
-            lock (_BoardIdLocker)
-                return _BoardId++;
-        }
+        public static AnalyzerPipeline Pipeline = new AnalyzerPipeline();                                   // Frames from the boards to the analyzers
+        public static ConcurrentDictionary<byte, BoardTelemetry> Telemetry = new ConcurrentDictionary<byte, BoardTelemetry>();  // Last health record of each board
+        public static ConcurrentDictionary<byte, BoardAnnounce> Announces = new ConcurrentDictionary<byte, BoardAnnounce>();    // Last identity of each board
+        public static BoardRegistry Registry = new BoardRegistry(BoardRegistry.DefaultPath);                // Board IDs stable across runs
 
         public static void Dispose()
         {
+            Pipeline.Dispose();
+
             // Dispose all data sources
             IDisposable brd;
             while (DataSources.TryTake(out brd))
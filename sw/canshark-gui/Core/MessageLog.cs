@@ -0,0 +1,333 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.IO.MemoryMappedFiles;
+using System.Linq;
+
+namespace Core
+{
+    /// <summary>
+    /// Frames of one source in the order appended. They are kept by columns in
+    /// segments of fixed size, a full segment is sealed and spilled to a memory
+    /// mapped temp file, so only the open segment and a few mapped views take the
+    /// memory. Frame by the index is O(1), the time lookup expects the host time
+    /// of the frames not to go back.
+    /// </summary>
+    public sealed class MessageLog : IDisposable
+    {
+        public const int SEGMENT = 1 << 18;         // frames, power of 2
+        public const int VIEWS = 4;                 // sealed segments mapped at once
+
+        private const int FLAG_BACKLOG = 0x01;
+        private const int FLAG_PASSIVE = 0x02;
+
+        // sealed segment file, column after column
+        private const long COL_SOURCE = 0;
+        private const long COL_MAILBOX = COL_SOURCE + 2L * SEGMENT;
+        private const long COL_COB = COL_MAILBOX + 1L * SEGMENT;
+        private const long COL_SEC = COL_COB + 4L * SEGMENT;
+        private const long COL_USEC = COL_SEC + 4L * SEGMENT;
+        private const long COL_PAYLOAD = COL_USEC + 4L * SEGMENT;
+        private const long COL_LENGTH = COL_PAYLOAD + 8L * SEGMENT;
+        private const long COL_TIME = COL_LENGTH + 1L * SEGMENT;
+        private const long COL_BITTIME = COL_TIME + 2L * SEGMENT;
+        private const long COL_FLAGS = COL_BITTIME + 8L * SEGMENT;
+        private const long SEGMENT_BYTES = COL_FLAGS + 1L * SEGMENT;
+
+        private sealed class Segment
+        {
+            public UInt16[] Source;
+            public byte[] Mailbox;
+            public UInt32[] Cob;
+            public UInt32[] Sec;
+            public UInt32[] Usec;
+            public UInt64[] Payload;
+            public byte[] Length;
+            public UInt16[] Time;
+            public UInt64[] BitTime;
+            public byte[] Flags;
+
+            public int Count;
+            public UInt64 Last;                     // us, host time of the last frame
+
+            // sealed only
+            public string Path;
+            public MemoryMappedFile File;
+            public MemoryMappedViewAccessor View;
+
+            public Segment()
+            {
+                Source = new UInt16[SEGMENT];
+                Mailbox = new byte[SEGMENT];
+                Cob = new UInt32[SEGMENT];
+                Sec = new UInt32[SEGMENT];
+                Usec = new UInt32[SEGMENT];
+                Payload = new UInt64[SEGMENT];
+                Length = new byte[SEGMENT];
+                Time = new UInt16[SEGMENT];
+                BitTime = new UInt64[SEGMENT];
+                Flags = new byte[SEGMENT];
+            }
+        }
+
+        #region Variables
+        private object _Lock = new object();
+        private List<Segment> _Segments = new List<Segment>();
+        private LinkedList<Segment> _Mapped = new LinkedList<Segment>();    // most recent first
+        private Segment _Open = new Segment();
+        private long _Count;
+        private bool _Disposed;
+        #endregion
+
+        public long Count { get { lock (_Lock) return _Count; } }
+
+        /// <summary>
+        /// Segments spilled to the disk
+        /// </summary>
+        public int Sealed { get { lock (_Lock) return _Segments.Count; } }
+
+        public static UInt64 HostTime(CanMessage msg)
+        {
+            return (UInt64)msg.Sec * 1000000 + msg.Usec;
+        }
+
+        #region Append
+        public void Append(CanMessage[] msgs, int offset, int count)
+        {
+            lock (_Lock)
+            {
+                if (_Disposed)
+                    return;
+
+                for (int i = offset; i < offset + count; i++)
+                    Add(ref msgs[i]);
+            }
+        }
+
+        private void Add(ref CanMessage msg)
+        {
+            Segment s = _Open;
+            int i = s.Count;
+
+            s.Source[i] = (UInt16)msg.Source;
+            s.Mailbox[i] = (byte)msg.Mailbox;
+            s.Cob[i] = msg.COB;
+            s.Sec[i] = msg.Sec;
+            s.Usec[i] = msg.Usec;
+            s.Payload[i] = msg.Payload;
+            s.Length[i] = msg.Length;
+            s.Time[i] = msg.Time;
+            s.BitTime[i] = msg.BitTime;
+            s.Flags[i] = (byte)((msg.Backlog ? FLAG_BACKLOG : 0) | (msg.Passive ? FLAG_PASSIVE : 0));
+
+            s.Last = HostTime(msg);
+            s.Count++;
+            _Count++;
+
+            if (s.Count == SEGMENT)
+            {
+                Seal(s);
+                _Open = new Segment();
+            }
+        }
+
+        private void Seal(Segment s)
+        {
+            string dir = System.IO.Path.Combine(System.IO.Path.GetTempPath(), "canshark");
+            Directory.CreateDirectory(dir);
+
+            s.Path = System.IO.Path.Combine(dir, Guid.NewGuid().ToString("N") + ".seg");
+            s.File = MemoryMappedFile.CreateFromFile(s.Path, FileMode.CreateNew, null, SEGMENT_BYTES);
+
+            using (MemoryMappedViewAccessor w = s.File.CreateViewAccessor(0, SEGMENT_BYTES, MemoryMappedFileAccess.Write))
+            {
+                w.WriteArray(COL_SOURCE, s.Source, 0, SEGMENT);
+                w.WriteArray(COL_MAILBOX, s.Mailbox, 0, SEGMENT);
+                w.WriteArray(COL_COB, s.Cob, 0, SEGMENT);
+                w.WriteArray(COL_SEC, s.Sec, 0, SEGMENT);
+                w.WriteArray(COL_USEC, s.Usec, 0, SEGMENT);
+                w.WriteArray(COL_PAYLOAD, s.Payload, 0, SEGMENT);
+                w.WriteArray(COL_LENGTH, s.Length, 0, SEGMENT);
+                w.WriteArray(COL_TIME, s.Time, 0, SEGMENT);
+                w.WriteArray(COL_BITTIME, s.BitTime, 0, SEGMENT);
+                w.WriteArray(COL_FLAGS, s.Flags, 0, SEGMENT);
+            }
+
+            s.Source = null;
+            s.Mailbox = null;
+            s.Cob = null;
+            s.Sec = null;
+            s.Usec = null;
+            s.Payload = null;
+            s.Length = null;
+            s.Time = null;
+            s.BitTime = null;
+            s.Flags = null;
+
+            _Segments.Add(s);
+        }
+        #endregion
+
+        #region Read
+        /// <summary>
+        /// Frame by the index, maps the sealed segment when not mapped yet
+        /// </summary>
+        public CanMessage this[long index]
+        {
+            get
+            {
+                lock (_Lock)
+                {
+                    if ((index < 0) || (index >= _Count) || _Disposed)
+                        throw new ArgumentOutOfRangeException("index");
+
+                    int seg = (int)(index / SEGMENT);
+                    int i = (int)(index % SEGMENT);
+
+                    if (seg == _Segments.Count)
+                        return Get(_Open, i);
+
+                    return Get(Map(_Segments[seg]), i);
+                }
+            }
+        }
+
+        private static CanMessage Get(Segment s, int i)
+        {
+            byte flags = s.Flags[i];
+
+            return new CanMessage((CanSourceId)s.Source[i], (CanMailboxId)s.Mailbox[i], s.Cob[i])
+            {
+                Sec = s.Sec[i],
+                Usec = s.Usec[i],
+                Payload = s.Payload[i],
+                Length = s.Length[i],
+                Time = s.Time[i],
+                BitTime = s.BitTime[i],
+                Backlog = (flags & FLAG_BACKLOG) != 0,
+                Passive = (flags & FLAG_PASSIVE) != 0,
+            };
+        }
+
+        private static CanMessage Get(MemoryMappedViewAccessor v, int i)
+        {
+            byte flags = v.ReadByte(COL_FLAGS + i);
+
+            return new CanMessage((CanSourceId)v.ReadUInt16(COL_SOURCE + 2L * i), (CanMailboxId)v.ReadByte(COL_MAILBOX + i), v.ReadUInt32(COL_COB + 4L * i))
+            {
+                Sec = v.ReadUInt32(COL_SEC + 4L * i),
+                Usec = v.ReadUInt32(COL_USEC + 4L * i),
+                Payload = v.ReadUInt64(COL_PAYLOAD + 8L * i),
+                Length = v.ReadByte(COL_LENGTH + i),
+                Time = v.ReadUInt16(COL_TIME + 2L * i),
+                BitTime = v.ReadUInt64(COL_BITTIME + 8L * i),
+                Backlog = (flags & FLAG_BACKLOG) != 0,
+                Passive = (flags & FLAG_PASSIVE) != 0,
+            };
+        }
+
+        /// <summary>
+        /// View of the sealed segment, the least recently used one is unmapped
+        /// </summary>
+        private MemoryMappedViewAccessor Map(Segment s)
+        {
+            if (s.View != null)
+            {
+                if (_Mapped.First.Value != s)
+                {
+                    _Mapped.Remove(s);
+                    _Mapped.AddFirst(s);
+                }
+                return s.View;
+            }
+
+            if (_Mapped.Count == VIEWS)
+            {
+                Segment old = _Mapped.Last.Value;
+                _Mapped.RemoveLast();
+                old.View.Dispose();
+                old.View = null;
+            }
+
+            s.View = s.File.CreateViewAccessor(0, SEGMENT_BYTES, MemoryMappedFileAccess.Read);
+            _Mapped.AddFirst(s);
+            return s.View;
+        }
+
+        private UInt64 TimeAt(int seg, int i)
+        {
+            if (seg == _Segments.Count)
+                return (UInt64)_Open.Sec[i] * 1000000 + _Open.Usec[i];
+
+            MemoryMappedViewAccessor v = Map(_Segments[seg]);
+            return (UInt64)v.ReadUInt32(COL_SEC + 4L * i) * 1000000 + v.ReadUInt32(COL_USEC + 4L * i);
+        }
+
+        /// <summary>
+        /// Index of the first frame at the host time or later, Count when none
+        /// </summary>
+        public long IndexOf(UInt64 us)
+        {
+            lock (_Lock)
+            {
+                if (_Disposed)
+                    return 0;
+
+                // segment by the last frame, then the frame inside
+                int lo = 0, hi = _Segments.Count;
+                while (lo < hi)
+                {
+                    int mid = (lo + hi) / 2;
+                    if (_Segments[mid].Last < us)
+                        lo = mid + 1;
+                    else
+                        hi = mid;
+                }
+
+                int seg = lo;
+                int first = 0, last = (seg == _Segments.Count) ? _Open.Count : SEGMENT;
+                while (first < last)
+                {
+                    int mid = (first + last) / 2;
+                    if (TimeAt(seg, mid) < us)
+                        first = mid + 1;
+                    else
+                        last = mid;
+                }
+
+                return (long)seg * SEGMENT + first;
+            }
+        }
+        #endregion
+
+        public void Dispose()
+        {
+            lock (_Lock)
+            {
+                if (_Disposed)
+                    return;
+                _Disposed = true;
+
+                foreach (Segment s in _Segments)
+                {
+                    if (s.View != null)
+                        s.View.Dispose();
+                    s.File.Dispose();
+
+                    try
+                    {
+                        System.IO.File.Delete(s.Path);
+                    }
+                    catch (IOException)
+                    {
+                    }
+                }
+
+                _Segments.Clear();
+                _Mapped.Clear();
+                _Open = null;
+                _Count = 0;
+            }
+        }
+    }
+}
@@ -0,0 +1,291 @@
+﻿using System;
+using System.Collections.Concurrent;
+using System.Collections.Generic;
+using System.IO;
+using System.Text;
+using System.Threading;
+
+namespace Wireshark
+{
+    /// <summary>
+    /// pcapng writer, https://www.ietf.org/archive/id/draft-ietf-opsawg-pcapng-01.html
+    /// Blocks are serialized into large buffers on the calling thread, full buffers
+    /// are written whole by the writer thread, a partial one after FLUSH ms. Every
+    /// interface has its own link type, the frames are serialized in it.
+    /// </summary>
+    public sealed class PcapNgWriter : IDisposable
+    {
+        public const int BUFFER = 1 << 20;      // bytes, one write
+        public const int BUFFERS = 8;
+        public const int FLUSH = 100;           // ms
+        public const byte TSRESOL = 9;          // ns
+
+        private const UInt32 BT_SHB = 0x0A0D0D0A;
+        private const UInt32 BT_IDB = 0x00000001;
+        private const UInt32 BT_EPB = 0x00000006;
+        private const UInt32 BYTE_ORDER = 0x1A2B3C4D;
+
+        private const UInt16 OPT_END = 0;
+        private const UInt16 SHB_USERAPPL = 4;
+        private const UInt16 IF_NAME = 2;
+        private const UInt16 IF_DESCRIPTION = 3;
+        private const UInt16 IF_TSRESOL = 9;
+        private const UInt16 EPB_FLAGS = 2;
+
+        private const UInt32 EPB_INBOUND = 1;
+        private const UInt32 EPB_OUTBOUND = 2;
+
+        private struct Chunk
+        {
+            public byte[] Data;
+            public int Length;
+        }
+
+        #region Variables
+        private Stream _Stream;
+        private object _Lock = new object();
+        private byte[] _Cur;
+        private int _Pos;
+        private BlockingCollection<Chunk> _Full = new BlockingCollection<Chunk>();
+        private BlockingCollection<byte[]> _Free = new BlockingCollection<byte[]>();
+        private List<DataLinkType> _Links = new List<DataLinkType>();
+        private Thread _Thread;
+        private volatile bool _Failed;
+        private bool _Closed;
+        #endregion
+
+        public long Frames;             // written by the caller
+        public long Bytes;              // written to the stream
+
+        /// <summary>
+        /// False after the stream failed, the frames are dropped then
+        /// </summary>
+        public bool Connected { get { return !_Failed; } }
+
+        public PcapNgWriter(Stream stm, string application)
+        {
+            _Stream = stm;
+
+            for (int i = 0; i < BUFFERS; i++)
+                _Free.Add(new byte[BUFFER]);
+            _Cur = _Free.Take();
+
+            // section header
+            lock (_Lock)
+            {
+                int len = 28 + Opt(application) + 4;
+                int p = Begin(BT_SHB, len);
+                Put32(_Cur, ref p, BYTE_ORDER);
+                Put16(_Cur, ref p, 1);
+                Put16(_Cur, ref p, 0);
+                Put64(_Cur, ref p, UInt64.MaxValue);    // section length unknown
+                PutOpt(_Cur, ref p, SHB_USERAPPL, application);
+                Put32(_Cur, ref p, OPT_END);
+                End(p, len);
+            }
+
+            _Thread = new Thread(thread) { IsBackground = true, Name = "pcapng" };
+            _Thread.Start();
+        }
+
+        #region Serialization
+        private static void Put16(byte[] b, ref int p, UInt16 v)
+        {
+            b[p++] = (byte)v;
+            b[p++] = (byte)(v >> 8);
+        }
+
+        private static void Put32(byte[] b, ref int p, UInt32 v)
+        {
+            b[p++] = (byte)v;
+            b[p++] = (byte)(v >> 8);
+            b[p++] = (byte)(v >> 16);
+            b[p++] = (byte)(v >> 24);
+        }
+
+        private static void Put64(byte[] b, ref int p, UInt64 v)
+        {
+            Put32(b, ref p, (UInt32)v);
+            Put32(b, ref p, (UInt32)(v >> 32));
+        }
+
+        private static int Pad(int len)
+        {
+            return (len + 3) & ~3;
+        }
+
+        // option with the string value, bytes taken
+        private static int Opt(string value)
+        {
+            return 4 + Pad(Encoding.UTF8.GetByteCount(value));
+        }
+
+        private static void PutOpt(byte[] b, ref int p, UInt16 code, string value)
+        {
+            int n = Encoding.UTF8.GetBytes(value, 0, value.Length, b, p + 4);
+            Put16(b, ref p, code);
+            Put16(b, ref p, (UInt16)n);
+            p += n;
+            while ((p & 3) != 0)
+                b[p++] = 0;
+        }
+
+        // room for the block in the buffer, lock held
+        private int Begin(UInt32 type, int len)
+        {
+            if (_Pos + len > BUFFER)
+                Swap(true);
+
+            int p = _Pos;
+            Put32(_Cur, ref p, type);
+            Put32(_Cur, ref p, (UInt32)len);
+            return p;
+        }
+
+        private void End(int p, int len)
+        {
+            Put32(_Cur, ref p, (UInt32)len);
+            _Pos = p;
+        }
+
+        // buffer queued for the write, lock held
+        private void Swap(bool wait)
+        {
+            byte[] next;
+            if (!_Free.TryTake(out next))
+            {
+                if (!wait)
+                    return;
+
+                next = _Free.Take();
+            }
+
+            _Full.Add(new Chunk() { Data = _Cur, Length = _Pos });
+            _Cur = next;
+            _Pos = 0;
+        }
+        #endregion
+
+        /// <summary>
+        /// Interface description, the id returned
+        /// </summary>
+        public int AddInterface(DataLinkType link, UInt32 snaplen, string name, string description)
+        {
+            lock (_Lock)
+            {
+                int len = 20 + Opt(name) + Opt(description) + 8 + 4;
+                int p = Begin(BT_IDB, len);
+                Put16(_Cur, ref p, (UInt16)link);
+                Put16(_Cur, ref p, 0);
+                Put32(_Cur, ref p, snaplen);
+                PutOpt(_Cur, ref p, IF_NAME, name);
+                PutOpt(_Cur, ref p, IF_DESCRIPTION, description);
+                Put16(_Cur, ref p, IF_TSRESOL);
+                Put16(_Cur, ref p, 1);
+                Put32(_Cur, ref p, TSRESOL);            // value byte, padding
+                Put32(_Cur, ref p, OPT_END);
+                End(p, len);
+
+                _Links.Add(link);
+                return _Links.Count - 1;
+            }
+        }
+
+        /// <summary>
+        /// Enhanced packet in the link type of the interface, direction in the flags
+        /// </summary>
+        public void WriteFrame(int iface, UInt64 ns, ref CanMessage msg)
+        {
+            if (_Failed)
+                return;
+
+            lock (_Lock)
+            {
+                if (_Closed)
+                    return;
+
+                DataLinkType link = _Links[iface];
+                int dlen = msg.SerializeLen(link);
+                int len = 28 + Pad(dlen) + 12 + 4;
+
+                int p = Begin(BT_EPB, len);
+                Put32(_Cur, ref p, (UInt32)iface);
+                Put32(_Cur, ref p, (UInt32)(ns >> 32));
+                Put32(_Cur, ref p, (UInt32)ns);
+                Put32(_Cur, ref p, (UInt32)dlen);
+                Put32(_Cur, ref p, (UInt32)dlen);
+                msg.SerializeTo(link, _Cur, p);
+                p += dlen;
+                while ((p & 3) != 0)
+                    _Cur[p++] = 0;
+                Put16(_Cur, ref p, EPB_FLAGS);
+                Put16(_Cur, ref p, 4);
+                Put32(_Cur, ref p, msg.Mailbox.IsTx ? EPB_OUTBOUND : EPB_INBOUND);
+                Put32(_Cur, ref p, OPT_END);
+                End(p, len);
+
+                Frames++;
+            }
+        }
+
+        private void thread()
+        {
+            while (!_Full.IsCompleted)
+            {
+                Chunk c;
+
+                if (!_Full.TryTake(out c, FLUSH))
+                {
+                    // idle, the partial buffer goes out; never waits, the buffers are all free here
+                    lock (_Lock)
+                        if (_Pos > 0)
+                            Swap(false);
+
+                    if (!_Full.TryTake(out c))
+                        continue;
+                }
+
+                try
+                {
+                    if (!_Failed)
+                    {
+                        _Stream.Write(c.Data, 0, c.Length);
+                        if (_Full.Count == 0)
+                            _Stream.Flush();
+
+                        Bytes += c.Length;
+                    }
+                }
+                catch (IOException)
+                {
+                    _Failed = true;
+                }
+                catch (ObjectDisposedException)
+                {
+                    _Failed = true;
+                }
+
+                _Free.Add(c.Data);
+            }
+        }
+
+        /// <summary>
+        /// The rest is written, the stream stays open
+        /// </summary>
+        public void Dispose()
+        {
+            lock (_Lock)
+            {
+                if (_Closed)
+                    return;
+                _Closed = true;
+
+                if (_Pos > 0)
+                    Swap(true);
+                _Full.CompleteAdding();
+            }
+
+            _Thread.Join();
+        }
+    }
+}
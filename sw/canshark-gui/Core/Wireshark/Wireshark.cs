@@ -16,7 +16,8 @@ namespace Wireshark
 
     public enum DataLinkType : uint
     {
-        DLT_USER0 = 147,
+        DLT_USER0 = 147,                // canshark record, dissector/canshark.lua
+        DLT_CAN_SOCKETCAN = 227,        // struct can_frame, Wireshark's own CAN dissector
     }
 
     class WiresharkPcapProtocol : IDisposable
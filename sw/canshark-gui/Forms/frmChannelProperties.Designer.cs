@@ -59,6 +59,7 @@
             this.btnCancel = new System.Windows.Forms.Button();
             this.btnOK = new System.Windows.Forms.Button();
             this.pgTimingStatistics = new System.Windows.Forms.PropertyGrid();
+            this.cbListenOnly = new System.Windows.Forms.CheckBox();
             this.tabControl1.SuspendLayout();
             this.tpBusTiming.SuspendLayout();
             ((System.ComponentModel.ISupportInitialize)(this.pictureBox1)).BeginInit();
@@ -78,7 +79,8 @@
             "125 kbps",
             "50 kbps",
             "20 kbps",
-            "10 kbps"});
+            "10 kbps",
+            "Autodetect"});
             this.cbTimingStandard.Location = new System.Drawing.Point(23, 29);
             this.cbTimingStandard.Name = "cbTimingStandard";
             this.cbTimingStandard.Size = new System.Drawing.Size(138, 21);
@@ -213,6 +215,7 @@
             // 
             // tpBusTiming
             // 
+            this.tpBusTiming.Controls.Add(this.cbListenOnly);
             this.tpBusTiming.Controls.Add(this.pgTimingStatistics);
             this.tpBusTiming.Controls.Add(this.pictureBox1);
             this.tpBusTiming.Controls.Add(this.tbTimingPrescaler);
@@ -394,6 +397,16 @@
             this.btnOK.Text = "OK";
             this.btnOK.UseVisualStyleBackColor = true;
             // 
+            // cbListenOnly
+            // 
+            this.cbListenOnly.AutoSize = true;
+            this.cbListenOnly.Location = new System.Drawing.Point(6, 205);
+            this.cbListenOnly.Name = "cbListenOnly";
+            this.cbListenOnly.Size = new System.Drawing.Size(118, 17);
+            this.cbListenOnly.TabIndex = 22;
+            this.cbListenOnly.Text = "Listen only (silent)";
+            this.cbListenOnly.UseVisualStyleBackColor = true;
+            // 
             // pgTimingStatistics
             // 
             this.pgTimingStatistics.CommandsVisibleIfAvailable = false;
@@ -445,6 +458,7 @@
         private System.Windows.Forms.RadioButton rbTimingPrecise;
         private System.Windows.Forms.TabControl tabControl1;
         private System.Windows.Forms.TabPage tpBusTiming;
+        private System.Windows.Forms.CheckBox cbListenOnly;
         private System.Windows.Forms.TabPage tpStatistics;
         private System.Windows.Forms.TabPage tpTrigger;
         private System.Windows.Forms.PictureBox pictureBox1;
@@ -7,6 +7,8 @@ using System.Linq;
 using System.Text;
 using System.Threading.Tasks;
 using System.Windows.Forms;
+using Boards;
+using Core;
 
 namespace canshark.Forms
 {
@@ -48,21 +50,34 @@ namespace canshark.Forms
 
         }
 
+        // items of cbTimingStandard, followed by autodetect
+        private static readonly UInt32[] StandardRates = { 1000000, 800000, 500000, 250000, 125000, 50000, 20000, 10000 };
+        private const UInt16 StandardSample = 875;
+        private const int AutobaudTimeout = 10000;      // ms, bus may be idle for a while
+
         public frmChannelProperties()
         {
             InitializeComponent();
         }
 
-        public static bool Execute()
+        public static bool Execute(CanSourceId src)
         {
             using (frmChannelProperties frm = new frmChannelProperties())
             {
                 frm.pgTimingStatistics.SelectedObject = new TimingResult();
 
+                BoardTelemetry telem;
+                if (CanSharkCore.Telemetry.TryGetValue(src.Board, out telem))
+                {
+                    frm.cbTimingStandard.SelectedIndex = Array.IndexOf(StandardRates, telem.Bitrate[src.Port]);
+                    frm.cbListenOnly.Checked = telem.Silent[src.Port];
+                }
+
                 // save config
                 if (frm.ShowDialog() == DialogResult.OK)
                 {
                     // Apply all changes
+                    frm.ApplyTiming(src);
                     return true;
                 }
                 else
@@ -73,6 +88,29 @@ namespace canshark.Forms
             }
         }
 
+        private void ApplyTiming(CanSourceId src)
+        {
+            object brd;
+            if (!CanSharkCore.Boards.TryGetValue(src.Board, out brd) || !(brd is EthBoard.BoardInfo))
+                return;
+
+            EthBoard.BoardInfo board = brd as EthBoard.BoardInfo;
+
+            // mode first, so the new timing never drives the bus of passive port
+            board.SetSilent(src.Port, cbListenOnly.Checked);
+
+            if (!rbTimingStandard.Checked)
+                return;
+
+            int idx = cbTimingStandard.SelectedIndex;
+
+            // the board replies once it is locked, telemetry shows the result
+            if (idx == StandardRates.Length)
+                board.Autobaud(src.Port, AutobaudTimeout);
+            else if (idx >= 0)
+                board.SetTiming(src.Port, StandardRates[idx], StandardSample);
+        }
+
         private void rbTiming_CheckedChanged(object sender, EventArgs e)
         {
             cbTimingStandard.Enabled = rbTimingStandard.Checked;
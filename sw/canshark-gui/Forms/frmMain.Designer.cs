@@ -46,6 +46,7 @@
             this.dataGridViewTextBoxColumn15 = new System.Windows.Forms.DataGridViewTextBoxColumn();
             this.dataGridViewTextBoxColumn16 = new System.Windows.Forms.DataGridViewTextBoxColumn();
             this.button3 = new System.Windows.Forms.Button();
+            this.button4 = new System.Windows.Forms.Button();
             this.tabControl2 = new System.Windows.Forms.TabControl();
             this.tpSource0 = new System.Windows.Forms.TabPage();
             this.splitter1 = new System.Windows.Forms.Splitter();
@@ -187,6 +188,16 @@
             this.button3.UseVisualStyleBackColor = true;
             this.button3.Click += new System.EventHandler(this.button3_Click);
             // 
+            // button4
+            // 
+            this.button4.Location = new System.Drawing.Point(1169, 38);
+            this.button4.Name = "button4";
+            this.button4.Size = new System.Drawing.Size(102, 23);
+            this.button4.TabIndex = 18;
+            this.button4.Text = "Capture...";
+            this.button4.UseVisualStyleBackColor = true;
+            this.button4.Click += new System.EventHandler(this.button4_Click);
+            // 
             // tabControl2
             // 
             this.tabControl2.Controls.Add(this.tpSource0);
@@ -267,7 +278,7 @@
             this.frameStatistics1.Location = new System.Drawing.Point(0, 0);
             this.frameStatistics1.Name = "frameStatistics1";
             this.frameStatistics1.Padding = new System.Windows.Forms.Padding(3, 3, 3, 0);
-            this.frameStatistics1.Size = new System.Drawing.Size(150, 89);
+            this.frameStatistics1.Size = new System.Drawing.Size(150, 119);
             this.frameStatistics1.TabIndex = 13;
             // 
             // frameCanopenCycleLog1
@@ -349,7 +360,7 @@
             this.frameStatistics2.Location = new System.Drawing.Point(0, 0);
             this.frameStatistics2.Name = "frameStatistics2";
             this.frameStatistics2.Padding = new System.Windows.Forms.Padding(3, 3, 3, 0);
-            this.frameStatistics2.Size = new System.Drawing.Size(150, 89);
+            this.frameStatistics2.Size = new System.Drawing.Size(150, 119);
             this.frameStatistics2.TabIndex = 14;
             // 
             // splitter3
@@ -420,6 +431,7 @@
             this.panel1.Controls.Add(this.trackBar1);
             this.panel1.Controls.Add(this.label3);
             this.panel1.Controls.Add(this.button3);
+            this.panel1.Controls.Add(this.button4);
             this.panel1.Controls.Add(this.label2);
             this.panel1.Controls.Add(this.label1);
             this.panel1.Dock = System.Windows.Forms.DockStyle.Top;
@@ -465,6 +477,7 @@
         private System.Windows.Forms.DataGridViewTextBoxColumn dataGridViewTextBoxColumn15;
         private System.Windows.Forms.DataGridViewTextBoxColumn dataGridViewTextBoxColumn16;
         private System.Windows.Forms.Button button3;
+        private System.Windows.Forms.Button button4;
         private System.Windows.Forms.TabControl tabControl2;
         private System.Windows.Forms.TabPage tpSource0;
         private System.Windows.Forms.TabPage tpSource1;
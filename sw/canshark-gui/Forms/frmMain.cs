@@ -9,9 +9,11 @@ using System.ComponentModel;
 using System.Data;
 using System.Diagnostics;
 using System.Drawing;
+using System.IO;
 using System.Linq;
 using System.Text;
 using System.Windows.Forms;
+using Wireshark;
 
 namespace canshark_gui
 {
@@ -21,6 +23,7 @@ namespace canshark_gui
         CanBusHistogram HistogramData = new CanBusHistogram();
         PortStatistics PortStats = new PortStatistics();
         AnalyseMessageLog MessageLog = new AnalyseMessageLog();
+        CaptureWriter CaptureFile = new CaptureWriter();
 
         public frmMain()
         {
@@ -35,6 +38,7 @@ namespace canshark_gui
             CanSharkCore.Analyzers.Add(HistogramData);
             CanSharkCore.Analyzers.Add(PortStats);
             CanSharkCore.Analyzers.Add(MessageLog);
+            CanSharkCore.Analyzers.Add(CaptureFile);
 
             frameStatistics1.SetSource(PortStats, CanSourceId.Source(0, 0));
             frameStatistics2.SetSource(PortStats, CanSourceId.Source(0, 1));
@@ -82,10 +86,6 @@ namespace canshark_gui
 
             Benchmark.Add(sw.ElapsedTicks);
 
-            CanSharkCore.Analyze();
-
-            Benchmark.Add(sw.ElapsedTicks);
-
             label1.Text = Benchmark[0].ToString();
             label2.Text = (Benchmark[1] - Benchmark[0]).ToString();
             label3.Text = (Benchmark[2] - Benchmark[1]).ToString();
@@ -100,19 +100,43 @@ namespace canshark_gui
 
         private void button1_Click(object sender, EventArgs e)
         {
-            frmChannelProperties.Execute();
+            frmChannelProperties.Execute(CanSourceId.Source(0, 0));
         }
 
         private void button2_Click(object sender, EventArgs e)
         {
-            frmChannelProperties.Execute();
+            frmChannelProperties.Execute(CanSourceId.Source(0, 1));
+        }
+
+        private void button4_Click(object sender, EventArgs e)
+        {
+            if (CaptureFile.IsCapturing)
+            {
+                CaptureFile.Stop();
+                button4.Text = "Capture...";
+                return;
+            }
+
+            using (SaveFileDialog dlg = new SaveFileDialog())
+            {
+                // SocketCAN opens with the compiled dissectors, canshark records need dissector/canshark.lua
+                dlg.Filter = "SocketCAN capture (*.pcapng)|*.pcapng|canshark capture (*.pcapng)|*.pcapng";
+                dlg.DefaultExt = "pcapng";
+
+                if (dlg.ShowDialog(this) != DialogResult.OK)
+                    return;
+
+                DataLinkType format = (dlg.FilterIndex == 2) ? DataLinkType.DLT_USER0 : DataLinkType.DLT_CAN_SOCKETCAN;
+                CaptureFile.Start(new FileStream(dlg.FileName, FileMode.Create, FileAccess.Write), format);
+                button4.Text = "Stop capture";
+            }
         }
 
         private void button3_Click(object sender, EventArgs e)
         {
             Random r = new Random();
 
-            CanSharkCore.InputQueue.Enqueue(
+            CanSharkCore.Pipeline.Post(
                 new CanMessage(
                     CanSourceId.Source(0, 0),
                     CanMailboxId.Mailbox(true, 0x00),
@@ -122,7 +146,7 @@ namespace canshark_gui
                         Usec = 0
                     });
 
-            CanSharkCore.InputQueue.Enqueue(
+            CanSharkCore.Pipeline.Post(
                 new CanMessage(
                     CanSourceId.Source(0, 1),
                     CanMailboxId.Mailbox(true, 0x00),
@@ -138,7 +162,7 @@ namespace canshark_gui
                 while (id == 0x80)
                     id = (uint)r.Next(0x800);
 
-                CanSharkCore.InputQueue.Enqueue(
+                CanSharkCore.Pipeline.Post(
                     new CanMessage(
                         CanSourceId.Source(0, (byte)(i % 2)),
                         CanMailboxId.Mailbox(false, 0x00),
@@ -13,7 +13,7 @@ namespace canshark.Frames
 {
     public partial class FrameCanopenCycleLog : UserControl
     {
-        CanSourceId _Source = null;
+        CanSourceId _Source;
         CanopenCycle _Stats = null;
 
         public FrameCanopenCycleLog()
@@ -32,7 +32,15 @@ namespace canshark.Frames
             CanopenCycle.Result value;
             if (_Stats.Results.TryGetValue(_Source, out value))
             {
-                lperiod.Text = (value.SyncPeriod * 1000).ToString("F3") + " ms";
+                // cycle jitter, the period and the SYNC to the end of its last frame
+                lperiod.Text = string.Format("{0:F3} ms   period min/p50/p99/max {1:F3} / {2:F3} / {3:F3} / {4:F3} ms   span p50/p99 {5:F3} / {6:F3} ms",
+                    value.SyncPeriod * 1000,
+                    value.Seconds(value.Period.Percentile(0)) * 1000,
+                    value.Seconds(value.Period.Percentile(50)) * 1000,
+                    value.Seconds(value.Period.Percentile(99)) * 1000,
+                    value.Seconds(value.Period.Percentile(100)) * 1000,
+                    value.Seconds(value.Span.Percentile(50)) * 1000,
+                    value.Seconds(value.Span.Percentile(99)) * 1000);
                 viewCanopenCycle1.UpdateData(value.CycleLog.Values.OrderBy((x) => x.delay).ToArray());
             }
 
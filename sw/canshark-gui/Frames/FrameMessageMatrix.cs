@@ -13,7 +13,7 @@ namespace canshark.Frames
 {
     public partial class FrameMessageMatrix : UserControl
     {
-        CanSourceId _Source = null;
+        CanSourceId _Source;
         CanBusHistogram _Stats = null;
 
         public FrameMessageMatrix()
@@ -51,16 +51,13 @@ namespace canshark.Frames
                 return;
 
             CanBusHistogram.Result value;
-            int v;
 
             string str = "@" + matrix.MouseHoveredId.ToString() + "=";
 
             if (!_Stats.Results.TryGetValue(_Source, out value))
                 str += "<no data>";
-            else if (value.StatsTotal.TryGetValue(matrix.MouseHoveredId, out v))
-                str += v.ToString();
             else
-                str += "0";
+                str += value.GetCount(matrix.MouseHoveredId).ToString();
             
             
 
@@ -18,7 +18,7 @@ namespace canshark.Frames
             InitializeComponent();
         }
 
-        CanSourceId _Source = null;
+        CanSourceId _Source;
         AnalyseMessageLog _Stats = null;
 
         public void SetSource(AnalyseMessageLog stats, CanSourceId id)
@@ -35,6 +35,10 @@
             this.ltxframes = new System.Windows.Forms.Label();
             this.label3 = new System.Windows.Forms.Label();
             this.lload = new System.Windows.Forms.Label();
+            this.label4 = new System.Windows.Forms.Label();
+            this.llost = new System.Windows.Forms.Label();
+            this.label5 = new System.Windows.Forms.Label();
+            this.lring = new System.Windows.Forms.Label();
             this.SuspendLayout();
             // 
             // Caption
@@ -110,10 +114,54 @@
             this.lload.Text = "0";
             this.lload.TextAlign = System.Drawing.ContentAlignment.MiddleLeft;
             // 
+            // label4
+            // 
+            this.label4.Font = new System.Drawing.Font("Microsoft Sans Serif", 8.25F, System.Drawing.FontStyle.Bold, System.Drawing.GraphicsUnit.Point, ((byte)(238)));
+            this.label4.Location = new System.Drawing.Point(6, 83);
+            this.label4.Name = "label4";
+            this.label4.Size = new System.Drawing.Size(70, 15);
+            this.label4.TabIndex = 8;
+            this.label4.Text = "Lost/Ovr";
+            this.label4.TextAlign = System.Drawing.ContentAlignment.MiddleRight;
+            // 
+            // llost
+            // 
+            this.llost.BackColor = System.Drawing.SystemColors.Window;
+            this.llost.Location = new System.Drawing.Point(82, 83);
+            this.llost.Name = "llost";
+            this.llost.Size = new System.Drawing.Size(60, 15);
+            this.llost.TabIndex = 9;
+            this.llost.Text = "0";
+            this.llost.TextAlign = System.Drawing.ContentAlignment.MiddleLeft;
+            // 
+            // label5
+            // 
+            this.label5.Font = new System.Drawing.Font("Microsoft Sans Serif", 8.25F, System.Drawing.FontStyle.Bold, System.Drawing.GraphicsUnit.Point, ((byte)(238)));
+            this.label5.Location = new System.Drawing.Point(6, 98);
+            this.label5.Name = "label5";
+            this.label5.Size = new System.Drawing.Size(70, 15);
+            this.label5.TabIndex = 10;
+            this.label5.Text = "Ring max";
+            this.label5.TextAlign = System.Drawing.ContentAlignment.MiddleRight;
+            // 
+            // lring
+            // 
+            this.lring.BackColor = System.Drawing.SystemColors.Window;
+            this.lring.Location = new System.Drawing.Point(82, 98);
+            this.lring.Name = "lring";
+            this.lring.Size = new System.Drawing.Size(60, 15);
+            this.lring.TabIndex = 11;
+            this.lring.Text = "0";
+            this.lring.TextAlign = System.Drawing.ContentAlignment.MiddleLeft;
+            // 
             // FrameStatistics
             // 
             this.AutoScaleDimensions = new System.Drawing.SizeF(6F, 13F);
             this.AutoScaleMode = System.Windows.Forms.AutoScaleMode.Font;
+            this.Controls.Add(this.lring);
+            this.Controls.Add(this.label5);
+            this.Controls.Add(this.llost);
+            this.Controls.Add(this.label4);
             this.Controls.Add(this.lload);
             this.Controls.Add(this.label3);
             this.Controls.Add(this.ltxframes);
@@ -137,5 +185,9 @@
         public System.Windows.Forms.Label ltxframes;
         private System.Windows.Forms.Label label3;
         public System.Windows.Forms.Label lload;
+        private System.Windows.Forms.Label label4;
+        public System.Windows.Forms.Label llost;
+        private System.Windows.Forms.Label label5;
+        public System.Windows.Forms.Label lring;
     }
 }
@@ -8,12 +8,13 @@ using System.Text;
 using System.Threading.Tasks;
 using System.Windows.Forms;
 using Analysis;
+using Core;
 
 namespace canshark.Frames
 {
     public partial class FrameStatistics : UserControl
     {
-        CanSourceId _Source = null;
+        CanSourceId _Source;
         PortStatistics _Stats = null;
 
         public FrameStatistics()
@@ -34,7 +35,17 @@ namespace canshark.Frames
             {
                 lrxframes.Text = value.nRx.ToString();
                 ltxframes.Text = value.nTx.ToString();
-                lload.Text = (value.load * 100).ToString("F1") + " %";
+                // last second, and its busiest 10 ms
+                lload.Text = string.Format("{0:F0}/{1:F0} %",
+                    value.GetLoad(PortStatistics.LOAD_1S) * 100,
+                    value.GetPeak(PortStatistics.LOAD_10MS, 1000000) * 100);
+            }
+
+            BoardTelemetry telem;
+            if (CanSharkCore.Telemetry.TryGetValue(_Source.Board, out telem) && (_Source.Port < BoardTelemetry.PORTS))
+            {
+                llost.Text = string.Format("{0} / {1} / {2}", telem.Lost[_Source.Port], telem.Overrun[_Source.Port, 0], telem.Overrun[_Source.Port, 1]);
+                lring.Text = telem.RingMax[1].ToString() + " / " + telem.RingSize[1].ToString();
             }
         }
     }